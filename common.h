@@ -80,6 +80,7 @@ extern uint8_t			colours_on;
 
 /* simple debug facility (originally from HGD code) */
 extern int			 dm_debug;
+extern int			 dm_threads;	/* 0 means one per core */
 extern char			*debug_names[];
 #define DM_D_ERROR		0
 #define DM_D_WARN		1
@@ -25,8 +25,16 @@
 #include "dm_elf.h"
 #include "dm_cfg.h"
 #include "dm_dom.h"
+#include "dm_loop.h"
+#include "dm_live.h"
+#include "dm_du.h"
+#include "dm_sccp.h"
+#include "dm_gvn.h"
+#include "dm_slot.h"
+#include "dm_sp.h"
 #include "dm_ssa.h"
 #include "dm_dwarf.h"
+#include "dm_eh.h"
 #include "dm_util.h"
 
 uint8_t				 colours_on = 1;
@@ -51,12 +59,15 @@ char *banner =
 "        	  (c) Ed Robbins 2011	<edd.robbins@gmail.com>\n";
 
 int				 dm_debug = DM_D_WARN;
+int				 dm_threads = 0;
 struct dm_file_info		file_info;
 
 int	dm_cmd_help();
 void	dm_parse_cmd(char *line);
 void	dm_update_prompt();
 void	dm_interp();
+char	*dm_complete_cmd(const char *text, int state);
+char	**dm_complete(const char *text, int start, int end);
 int	dm_dump_hex_pretty(uint8_t *buf, size_t sz, NADDR start_addr);
 int	dm_dump_hex(size_t bytes);
 int	dm_cmd_hex(char **args);
@@ -87,9 +98,17 @@ struct dm_cmd_sw {
 	{"dis", 0, dm_cmd_dis_noargs},	{"pd", 0, dm_cmd_dis_noargs},
 	{"dis", 1, dm_cmd_dis},		{"pd", 1, dm_cmd_dis},
 	{"dom", 0, dm_cmd_dom},
+	{"pdom", 0, dm_cmd_pdom},
+	{"loops", 0, dm_cmd_loops},
+	{"live", 0, dm_cmd_live},
+	{"dombench", 0, dm_cmd_dombench_noargs},
+	{"dombench", 1, dm_cmd_dombench},
+	{"ehfuncs", 0, dm_cmd_eh_funcs},
 	{"disf", 0, dm_cmd_dis_func},	{"pdf", 0, dm_cmd_dis_func},
 	{"findstr", 1, dm_cmd_findstr}, {"/", 1, dm_cmd_findstr},
 	{"funcs", 0, dm_cmd_dwarf_funcs}, {"f", 0, dm_cmd_dwarf_funcs},
+	{"funcs", 1, dm_cmd_dwarf_funcs_pattern},
+	{"f", 1, dm_cmd_dwarf_funcs_pattern},
 	{"help", 0, dm_cmd_help},	{"?", 0, dm_cmd_help},
 	{"hex", 0, dm_cmd_hex_noargs},  {"px", 0, dm_cmd_hex_noargs},
 	{"hex", 1, dm_cmd_hex},         {"px", 1, dm_cmd_hex},
@@ -99,9 +118,20 @@ struct dm_cmd_sw {
 	{"set", 0, dm_cmd_set_noargs},
 	{"set", 1, dm_cmd_set_one_arg},
 	{"set", 2, dm_cmd_set_two_args},
+	{"scope", 0, dm_cmd_scope_noargs},
+	{"scope", 1, dm_cmd_scope},
 	{"seek", 1, dm_cmd_seek},	{"s", 1, dm_cmd_seek},
 	{"sht", 0, dm_cmd_sht},
 	{"ssa", 0, dm_cmd_ssa},
+	{"ssastat", 0, dm_cmd_ssastat},
+	{"uses", 1, dm_cmd_uses},
+	{"def", 1, dm_cmd_def},
+	{"duslice", 1, dm_cmd_duslice},
+	{"sccp", 0, dm_cmd_sccp},
+	{"gvn", 0, dm_cmd_gvn},
+	{"slots", 0, dm_cmd_slots},
+	{"spdelta", 0, dm_cmd_spdelta_noargs},
+	{"spdelta", 1, dm_cmd_spdelta},
 	{NULL, 0, NULL}
 };
 
@@ -115,23 +145,38 @@ struct dm_help_rec {
 	{"  bits [set_to]",	"Get/set architecture (32 or 64)"},
 	{"  cfg",		"Show static CFG for current function"},
 	{"  debug [level]",	"Get/set debug level (0-3)"},
+	{"  def reg",		"Show definition of an SSA value"},
 	{"  dis/pd [ops]",	"Disassemble (8 or 'ops' operations)"},
-	{"  disf/pdf",		"Disassemble function (up until the next RET)"},
+	{"  disf/pdf",		"Disassemble to the end of the function"},
 	{"  dom",		"Show dominance tree and frontiers of cur func"},
-	{"  funcs/f",		"Show functions from dwarf data"},
+	{"  dombench [n]",	"Time dominator algorithms on synthetic CFGs"},
+	{"  duslice reg",	"Graph the def-use slice of an SSA value"},
+	{"  ehfuncs",		"Show function bounds from .eh_frame"},
+	{"  funcs/f [p]",	"Show functions from dwarf data ('p*' = prefix)"},
+	{"  gvn",		"Show redundant computations and loads"},
 	{"  help/?",		"Show this help"},
 	{"  hex/px [len]",	"Dump hex (64 or 'len' bytes)"},
 	{"  info/i",		"Show file information"},
+	{"  live",		"Show registers live in/out of each block"},
+	{"  loops",		"Show loop nesting forest of cur func"},
+	{"  pdom",		"Show post dominators and control dependences"},
 	{"  pht",		"Show program header table"},
-	{"  set [var] [val]",	"Show/ammend settings"},
+	{"  sccp",		"Propagate constants, resolve indirect jumps"},
+	{"  scope [addr]",	"Show inlined calls and blocks at an address"},
 	{"  seek/s addr",	"Seek to an address"},
+	{"  set [var] [val]",	"Show/ammend settings"},
 	{"  sht",		"Show section header table"},
+	{"  slots",		"Show stack slots and their spills/reloads"},
+	{"  spdelta [all]",	"Show stack pointer deltas, or check all funcs"},
 	{"  ssa",		"Output SSA form"},
+	{"  ssastat",		"Compare phi counts of minimal/semi/pruned SSA"},
+	{"  uses reg",		"Show definition and uses of an SSA value"},
 	{NULL, 0},
 };
 
 #define DM_MAX_PROMPT			32
 char			prompt[DM_MAX_PROMPT];
+struct dm_cmd_sw	*complete_cmd = NULL;
 
 #define DM_HEX_CHUNK           16
 /*
@@ -331,11 +376,61 @@ dm_update_prompt()
 	snprintf(prompt, DM_MAX_PROMPT, NADDR_FMT " dm> ", cur_addr);
 }
 
+/*
+ * readline generator for command names
+ */
+char *
+dm_complete_cmd(const char *text, int state)
+{
+	struct dm_cmd_sw	*cmd, *prev;
+	size_t			 len = strlen(text);
+
+	if (state == 0)
+		complete_cmd = dm_cmds;
+
+	for (cmd = complete_cmd; cmd->cmd != NULL; cmd++) {
+		if (strncmp(cmd->cmd, text, len) != 0)
+			continue;
+
+		/* commands appear once per arg count, only offer them once */
+		for (prev = dm_cmds; prev != cmd; prev++)
+			if (strcmp(prev->cmd, cmd->cmd) == 0)
+				break;
+
+		if (prev == cmd) {
+			complete_cmd = cmd + 1;
+			return (xstrdup(cmd->cmd));
+		}
+	}
+
+	complete_cmd = cmd;
+	return (NULL);
+}
+
+/*
+ * complete the first word as a command and the rest as symbol names
+ */
+char **
+dm_complete(const char *text, int start, int end)
+{
+	(void) end;
+
+	/* don't fall back on filename completion */
+	rl_attempted_completion_over = 1;
+
+	if (start == 0)
+		return (rl_completion_matches(text, dm_complete_cmd));
+
+	return (rl_completion_matches(text, dm_dwarf_complete));
+}
+
 void
 dm_interp()
 {
 	char			*line;
 
+	rl_attempted_completion_function = dm_complete;
+
 	dm_update_prompt();
 	while((line = readline(prompt)) != NULL) {
 		if (*line) {
@@ -381,6 +476,8 @@ usage()
 	printf("Usage: dismantle [args] <elf binary>\n\n");
 	printf("  Arguments:\n");
 	printf("    -a         Disable ANSII colours\n");
+	printf("    -j n       Use 'n' threads (default: one per core)\n");
+	printf("    -l         Load DWARF lazily, as it is needed\n");
 	printf("    -x lvl     Set debug level to 'lvl'\n");
 	printf("    -v         Show version and exit\n\n");
 }
@@ -388,14 +485,22 @@ usage()
 int
 main(int argc, char **argv)
 {
-	int			ch, getopt_err = 0, getopt_exit = 0;
-	GElf_Shdr		shdr;
+	int				 ch, getopt_err = 0, getopt_exit = 0;
+	struct dm_shdr_cache_entry	*shdr;
 
-	while ((ch = getopt(argc, argv, "ahx:v")) != -1) {
+	while ((ch = getopt(argc, argv, "ahj:lx:v")) != -1) {
 		switch (ch) {
 		case 'a':
 			colours_on = 0;
 			break;
+		case 'j':
+			dm_threads = atoi(optarg);
+			if (dm_threads < 0)
+				getopt_err = 1;
+			break;
+		case 'l':
+			dm_dwarf_lazy = 1;
+			break;
 		case 'x':
 			dm_debug = atoi(optarg);
 			if ((dm_debug < 0) || (dm_debug > 3))
@@ -438,6 +543,7 @@ main(int argc, char **argv)
 	/* parse elf and dwarf junk */
 	dm_init_elf();
 	dm_parse_pht();
+	dm_parse_eh_frame();
 	dm_parse_dwarf();
 
 	ud_init(&ud);
@@ -446,9 +552,8 @@ main(int argc, char **argv)
 	ud_set_syntax(&ud, UD_SYN_INTEL);
 
 	/* start at .text */
-	if (file_info.elf) {
-		dm_find_section(".text", &shdr);
-		dm_seek(shdr.sh_offset);
+	if ((file_info.elf) && (dm_find_section(".text", &shdr) == DM_OK)) {
+		dm_seek(shdr->offset);
 	} else {
 		dm_seek(0);
 	}
@@ -462,6 +567,7 @@ main(int argc, char **argv)
 	/* clean up */
 clean:
 	dm_clean_elf();
+	dm_clean_eh_frame();
 	dm_clean_dwarf();
 	dm_clean_settings();
 
@@ -566,6 +672,16 @@ dm_settings_init()
 	dm_setting_add_int("pref.ansi", -1, "Use ANSI colour terminal");
 	dm_setting_add_int("arch.bits", -1, "64 or 32 bit architecture");
 	dm_setting_add_int("dbg.level", -1, "Debug level");
+	dm_setting_add_str("dom.engine", "snca",
+	    "Dominator algorithm (snca=Semi-NCA, chk=Cooper/Harvey/Kennedy)");
+	dm_setting_add_int("dom.check", 0,
+	    "Cross check dominators with the other algorithm");
+	dm_setting_add_str("ssa.mode", "minimal",
+	    "SSA phi placement (minimal, semi or pruned)");
+	dm_setting_add_int("dis.source", 0,
+	    "Interleave source lines with disassembly (needs DWARF)");
+	dm_setting_add_int("dis.inline", 0,
+	    "Show inlined call stacks in disassembly (needs DWARF)");
 
 	return (DM_OK);
 }
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dm_arena.h"
+#include "dm_util.h"
+
+void *
+dm_arena_alloc(struct dm_arena *a, size_t sz)
+{
+	struct dm_arena_chunk	*c = a->head;
+	size_t			 chunk_sz;
+	void			*ptr;
+
+	/* keep everything 8 byte aligned */
+	sz = (sz + 7) & ~((size_t) 7);
+
+	if ((c == NULL) || (c->size - c->used < sz)) {
+		chunk_sz = sz > DM_ARENA_CHUNK ? sz : DM_ARENA_CHUNK;
+		c = xmalloc(sizeof(struct dm_arena_chunk) + chunk_sz);
+		c->used = 0;
+		c->size = chunk_sz;
+		c->next = a->head;
+		a->head = c;
+	}
+
+	ptr = c->data + c->used;
+	c->used += sz;
+
+	return (ptr);
+}
+
+char *
+dm_arena_strdup(struct dm_arena *a, const char *s)
+{
+	size_t			 len = strlen(s) + 1;
+	char			*dup;
+
+	dup = dm_arena_alloc(a, len);
+	memcpy(dup, s, len);
+
+	return (dup);
+}
+
+/*
+ * hand all of src's memory over to dst
+ */
+void
+dm_arena_move(struct dm_arena *dst, struct dm_arena *src)
+{
+	struct dm_arena_chunk	*c;
+
+	if (src->head == NULL)
+		return;
+
+	for (c = src->head; c->next != NULL; c = c->next)
+		;
+
+	/* src's full chunks go behind dst's current one */
+	if (dst->head != NULL) {
+		c->next = dst->head->next;
+		dst->head->next = src->head;
+	} else
+		dst->head = src->head;
+
+	src->head = NULL;
+}
+
+void
+dm_arena_free(struct dm_arena *a)
+{
+	struct dm_arena_chunk	*c, *nxt;
+
+	for (c = a->head; c != NULL; c = nxt) {
+		nxt = c->next;
+		free(c);
+	}
+	a->head = NULL;
+}
+
+void
+dm_intern_init(struct dm_intern *t, struct dm_arena *a)
+{
+	t->arena = a;
+	t->nslots = 256;
+	t->count = 0;
+	t->slots = xcalloc(t->nslots, sizeof(char *));
+}
+
+/* FNV-1a */
+size_t
+dm_intern_hash(const char *s)
+{
+	const unsigned char	*p;
+	size_t			 h = 2166136261u;
+
+	for (p = (const unsigned char *) s; *p; p++)
+		h = (h ^ *p) * 16777619u;
+
+	return (h);
+}
+
+/*
+ * return the one copy of string s, adding it if we haven't seen it
+ */
+char *
+dm_intern(struct dm_intern *t, const char *s)
+{
+	char			**old, **slot;
+	size_t			  old_n, i, h;
+
+	/* grow at half full, so probe sequences stay short */
+	if (t->count * 2 >= t->nslots) {
+		old = t->slots;
+		old_n = t->nslots;
+		t->nslots *= 2;
+		t->slots = xcalloc(t->nslots, sizeof(char *));
+		for (i = 0; i < old_n; i++) {
+			if (old[i] == NULL)
+				continue;
+			h = dm_intern_hash(old[i]);
+			while (t->slots[h & (t->nslots - 1)] != NULL)
+				h++;
+			t->slots[h & (t->nslots - 1)] = old[i];
+		}
+		free(old);
+	}
+
+	for (h = dm_intern_hash(s);; h++) {
+		slot = &t->slots[h & (t->nslots - 1)];
+		if (*slot == NULL)
+			break;
+		if (strcmp(*slot, s) == 0)
+			return (*slot);
+	}
+
+	*slot = dm_arena_strdup(t->arena, s);
+	t->count++;
+
+	return (*slot);
+}
+
+/*
+ * free the table, the strings live on in the arena
+ */
+void
+dm_intern_free(struct dm_intern *t)
+{
+	free(t->slots);
+	t->slots = NULL;
+	t->nslots = t->count = 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_ARENA_H
+#define __DM_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * A bump allocator. Everything allocated from an arena is freed at once
+ * with dm_arena_free().
+ */
+#define DM_ARENA_CHUNK		(64 * 1024)
+
+struct dm_arena_chunk {
+	struct dm_arena_chunk	*next;
+	size_t			 used;
+	size_t			 size;
+	char			 data[];
+};
+
+struct dm_arena {
+	struct dm_arena_chunk	*head;
+};
+
+/* a string interning table, backed by an arena */
+struct dm_intern {
+	struct dm_arena		*arena;
+	char			**slots;
+	size_t			 nslots;	/* always a power of 2 */
+	size_t			 count;
+};
+
+void	*dm_arena_alloc(struct dm_arena *a, size_t sz);
+char	*dm_arena_strdup(struct dm_arena *a, const char *s);
+void	 dm_arena_move(struct dm_arena *dst, struct dm_arena *src);
+void	 dm_arena_free(struct dm_arena *a);
+void	 dm_intern_init(struct dm_intern *t, struct dm_arena *a);
+size_t	 dm_intern_hash(const char *s);
+char	*dm_intern(struct dm_intern *t, const char *s);
+void	 dm_intern_free(struct dm_intern *t);
+
+#endif
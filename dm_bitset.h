@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_BITSET_H
+#define __DM_BITSET_H
+
+#include <stdint.h>
+
+/*
+ * Dense bitsets, stored as arrays of uint64_t. The atomic variant may be
+ * used by several threads on the same set at once.
+ */
+#define DM_BITSET_WORDS(n)	(((n) + 63) / 64)
+#define DM_BITSET_SET(b, i)	((b)[(i) / 64] |= (1ULL << ((i) % 64)))
+#define DM_BITSET_CLR(b, i)	((b)[(i) / 64] &= ~(1ULL << ((i) % 64)))
+#define DM_BITSET_ISSET(b, i)	(((b)[(i) / 64] >> ((i) % 64)) & 1)
+#define DM_BITSET_ATOMIC_SET(b, i)					\
+	__atomic_fetch_or(&(b)[(i) / 64], 1ULL << ((i) % 64),		\
+	    __ATOMIC_RELAXED)
+
+#endif
@@ -19,6 +19,8 @@
 #include "dm_cfg.h"
 #include "dm_gviz.h"
 #include "dm_dwarf.h"
+#include "dm_eh.h"
+#include "dm_util.h"
 
 /* Head of the list and a list iterator */
 struct ptrs	*p_head = NULL;
@@ -34,6 +36,17 @@ void **rpost; /* Pointers to nodes in reverse post-order */
 
 int fcalls_i = 0;
 
+/* Bounds of the function being recovered, if the unwind info knows them */
+NADDR func_start = 0;
+NADDR func_end = 0;
+NADDR func_entry = 0;
+int func_dwarf = 0;
+
+/* Indirect jump targets found in the current function, sorted by insn */
+struct dm_cfg_target *cfg_targets = NULL;
+int cfg_target_count = 0;
+int cfg_target_cap = 0;
+
 /*
  * Generate static CFG for a function.
  * Continues until it reaches ret, does not follow calls.
@@ -73,6 +86,24 @@ struct dm_cfg_node*
 dm_recover_cfg() {
 	NADDR	addr = cur_addr;
 	struct	dm_cfg_node *cfg = NULL;
+	struct	dm_eh_func *func = NULL;
+	struct	dm_dwarf_extent *ext = NULL;
+
+	/*
+	 * Find where the function ends so we don't run off into the next.
+	 * DWARF knows about all of a function's ranges, so prefer it.
+	 */
+	func_start = func_end = func_entry = 0;
+	func_dwarf = 0;
+	if (dm_dwarf_find_extent(addr, &ext) == DM_OK) {
+		func_start = ext->start;
+		func_end = ext->end;
+		func_entry = ext->entry;
+		func_dwarf = 1;
+	} else if (dm_eh_find_func(addr, &func) == DM_OK) {
+		func_start = func->offset;
+		func_end = func->offset_end;
+	}
 
 	/* Create first node */
 	cfg = dm_new_cfg_node(addr, 0);
@@ -152,6 +183,7 @@ dm_instruction_se_init()
 	for (c = 0; c < DM_UD_ENUM_HACK; c++) {
 		instructions[c].instruction = c;
 		instructions[c].write = 1;
+		instructions[c].kill = 0;
 		instructions[c].jump = 0;
 		instructions[c].ret = 0;
 		instructions[c].disjunctive = 0;
@@ -209,6 +241,41 @@ dm_instruction_se_init()
 	if (fcalls_i)
 		instructions[UD_Icall].jump = 2;
 
+	/*
+	 * These overwrite their destination without reading it first,
+	 * everything else that writes is read-modify-write (add, cmov..)
+	 */
+	instructions[UD_Imov].kill = 1;
+	instructions[UD_Imovzx].kill = 1;
+	instructions[UD_Imovsx].kill = 1;
+	instructions[UD_Imovsxd].kill = 1;
+	instructions[UD_Ilea].kill = 1;
+	instructions[UD_Ipop].kill = 1;
+	instructions[UD_Imovd].kill = 1;
+	instructions[UD_Imovq].kill = 1;
+	instructions[UD_Imovaps].kill = 1;
+	instructions[UD_Imovups].kill = 1;
+	instructions[UD_Imovapd].kill = 1;
+	instructions[UD_Imovupd].kill = 1;
+	instructions[UD_Imovdqa].kill = 1;
+	instructions[UD_Imovdqu].kill = 1;
+	instructions[UD_Iseto].kill = 1;
+	instructions[UD_Isetno].kill = 1;
+	instructions[UD_Isetb].kill = 1;
+	instructions[UD_Isetnb].kill = 1;
+	instructions[UD_Isetz].kill = 1;
+	instructions[UD_Isetnz].kill = 1;
+	instructions[UD_Isetbe].kill = 1;
+	instructions[UD_Iseta].kill = 1;
+	instructions[UD_Isets].kill = 1;
+	instructions[UD_Isetns].kill = 1;
+	instructions[UD_Isetp].kill = 1;
+	instructions[UD_Isetnp].kill = 1;
+	instructions[UD_Isetl].kill = 1;
+	instructions[UD_Isetge].kill = 1;
+	instructions[UD_Isetle].kill = 1;
+	instructions[UD_Isetg].kill = 1;
+
 	instructions[UD_Iadd].disjunctive = 1;
 
 	instructions[UD_Isub].disjunctive = 1;
@@ -234,8 +301,16 @@ dm_new_cfg_node(NADDR nstart, NADDR nend)
 	node->pre = 0;
 	node->rpost = 0;
 	node->idom = NULL;
+	node->dom_children = NULL;
+	node->dc_count = 0;
+	node->dom_pre = 0;
+	node->dom_post = 0;
 	node->df_set = NULL;
 	node->df_count = 0;
+	node->ipdom = NULL;
+	node->cd_set = NULL;
+	node->cd_count = 0;
+	node->loop = -1;
 	node->def_vars = NULL;
 	node->dv_count = 0;
 	node->phi_functions = NULL;
@@ -285,6 +360,12 @@ dm_gen_cfg_block(struct dm_cfg_node *node)
 		read = ud_disassemble(&ud);
 		hex = ud_insn_hex(&ud);
 
+		/* Check we haven't run off the end of the function */
+		if ((addr != node->start) && (!dm_is_target_in_func(addr))) {
+			addr -= oldRead;
+			break;
+		}
+
 		/* Check we haven't run into the start of another block */
 		if ((foundNode = dm_find_cfg_node_starting(addr))
 		    && (foundNode != node)) {
@@ -304,15 +385,26 @@ dm_gen_cfg_block(struct dm_cfg_node *node)
 		 * section */
 		local_target = 1;
 		if (instructions[ud.mnemonic].jump) {
-			target = dm_get_jump_target(ud);
+			target = dm_cfg_jump_target(ud);
 			if (!dm_is_target_in_text(target))
 				local_target = 0;
+			else if (!dm_is_target_in_func(target) &&
+			    (ud.mnemonic != UD_Icall))
+				local_target = 0; /* tail call */
 		}
 
+		/*
+		 * An unconditional jump we don't follow still ends the block,
+		 * whatever comes after it is not fall through
+		 */
+		if ((ud.mnemonic == UD_Ijmp) && (!local_target) &&
+		    (fcalls_i != 2))
+			break;
+
 		if (instructions[ud.mnemonic].jump && (local_target ||
 		    ((!local_target) && (fcalls_i == 2)))) {
 			/* Get the target of the jump instruction */
-			target = dm_get_jump_target(ud);
+			target = dm_cfg_jump_target(ud);
 
 			/* End the block here */
 			node->end = addr;
@@ -434,15 +526,15 @@ dm_gen_cfg_block(struct dm_cfg_node *node)
 int
 dm_is_target_in_text(NADDR addr)
 {
-	NADDR		start = 0, size = 0;
-	GElf_Shdr	shdr;
+	NADDR				 start = 0, size = 0;
+	struct dm_shdr_cache_entry	*shdr;
 
 	if ((dm_find_section(".text", &shdr)) == DM_FAIL) {
 		return (0);
 	}
 
-	start = shdr.sh_offset;
-	size = shdr.sh_size;
+	start = shdr->offset;
+	size = shdr->size;
 
 	if ((addr < start) || (addr > (start + size)))
 		return (0);
@@ -450,6 +542,28 @@ dm_is_target_in_text(NADDR addr)
 	return (1);
 }
 
+/*
+ * Is a jump target inside the function we are recovering? If we don't know
+ * the function bounds, assume it is.
+ */
+int
+dm_is_target_in_func(NADDR addr)
+{
+	struct dm_dwarf_extent	*ext;
+
+	if (!func_end)
+		return (1);
+
+	if ((addr >= func_start) && (addr < func_end))
+		return (1);
+
+	/* another range of the same function, eg. a cold part */
+	if ((func_dwarf) && (dm_dwarf_find_extent(addr, &ext) == DM_OK))
+		return (ext->entry == func_entry);
+
+	return (0);
+}
+
 struct dm_cfg_node *
 dm_split_cfg_block(struct dm_cfg_node *node, NADDR addr)
 {
@@ -593,6 +707,8 @@ dm_free_cfg()
 		if (p->ptr != NULL) {
 			free(((struct dm_cfg_node*)(p->ptr))->children);
 			free(((struct dm_cfg_node*)(p->ptr))->parents);
+			free(((struct dm_cfg_node*)(p->ptr))->dom_children);
+			free(((struct dm_cfg_node*)(p->ptr))->cd_set);
 		}
 		free(p->ptr);
 		p_prev = p;
@@ -624,15 +740,157 @@ dm_depth_first_walk(struct dm_cfg_node *cfg)
 void
 dm_dfw(struct dm_cfg_node *node)
 {
-	int c = 0;
+	struct dm_cfg_node	**stack = NULL;
+	int			 *next = NULL;
+	int			  depth = 0;
+
+	/* Keep our own stack, big functions make for deep walks */
+	stack = malloc(p_length * sizeof(void*));
+	next = malloc(p_length * sizeof(int));
+
 	node->visited = 1;
 	node->pre = i++;
-	for (;node->children[c] != NULL; c++)
-		if (!node->children[c]->visited)
-			dm_dfw(node->children[c]);
-	rpost[j] = node;
-	node->rpost = j--;
-	node->post = p_length - 1 - node->rpost;
+	stack[depth] = node;
+	next[depth++] = 0;
+	while (depth) {
+		node = stack[depth - 1];
+		if (node->children[next[depth - 1]] != NULL) {
+			node = node->children[next[depth - 1]++];
+			if (node->visited)
+				continue;
+			node->visited = 1;
+			node->pre = i++;
+			stack[depth] = node;
+			next[depth++] = 0;
+			continue;
+		}
+
+		rpost[j] = node;
+		node->rpost = j--;
+		node->post = p_length - 1 - node->rpost;
+		depth--;
+	}
+
+	free(stack);
+	free(next);
+}
+
+/*
+ * Make a CSR graph of the CFG. Vertex numbers are reverse post-order
+ * positions, so rpost[v] is the node of vertex v.
+ */
+void
+dm_cfg_graph(struct dm_graph *g)
+{
+	struct dm_cfg_node	*node = NULL;
+	int			*from = NULL, *to = NULL;
+	int			 v = 0, c = 0, m = 0, size = 0;
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		for (c = 0; node->children[c] != NULL; c++) {
+			if (m == size) {
+				size = size ? size * 2 : 64;
+				from = realloc(from, size * sizeof(int));
+				to = realloc(to, size * sizeof(int));
+			}
+			from[m] = v;
+			to[m++] = node->children[c]->rpost;
+		}
+	}
+
+	dm_graph_init(g, p_length, m, from, to);
+	free(from);
+	free(to);
+}
+
+/*
+ * Remember where an indirect jump or call goes. Returns DM_FAIL if it was
+ * already known.
+ */
+int
+dm_cfg_add_target(NADDR insn, NADDR target)
+{
+	int			 lo = 0, hi = cfg_target_count, mid = 0;
+
+	/* Find where it goes, the list stays sorted for bsearch */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cfg_targets[mid].insn == insn)
+			return (DM_FAIL);
+		if (cfg_targets[mid].insn < insn)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (cfg_target_count == cfg_target_cap) {
+		cfg_target_cap = cfg_target_cap ? cfg_target_cap * 2 : 16;
+		cfg_targets = xrealloc(cfg_targets,
+		    cfg_target_cap * sizeof(struct dm_cfg_target));
+	}
+	memmove(&cfg_targets[lo + 1], &cfg_targets[lo],
+	    (cfg_target_count - lo) * sizeof(struct dm_cfg_target));
+	cfg_targets[lo].insn = insn;
+	cfg_targets[lo].target = target;
+	cfg_target_count++;
+
+	return (DM_OK);
+}
+
+/*
+ * Forget the indirect targets, they are only good for the function they
+ * were found in
+ */
+void
+dm_cfg_free_targets()
+{
+	free(cfg_targets);
+	cfg_targets = NULL;
+	cfg_target_count = 0;
+	cfg_target_cap = 0;
+}
+
+int
+dm_cfg_find_target(NADDR insn, NADDR *target)
+{
+	struct dm_cfg_target	 key, *found = NULL;
+
+	key.insn = insn;
+	found = bsearch(&key, cfg_targets, cfg_target_count,
+	    sizeof(struct dm_cfg_target), dm_cfg_target_cmp);
+	if (found == NULL)
+		return (DM_FAIL);
+
+	*target = found->target;
+	return (DM_OK);
+}
+
+int
+dm_cfg_target_cmp(const void *t1, const void *t2)
+{
+	const struct dm_cfg_target *a = t1, *b = t2;
+
+	if (a->insn < b->insn)
+		return (-1);
+	return (a->insn > b->insn);
+}
+
+/*
+ * Where a jump or call goes. Register and memory operands only have a
+ * target if analysis has found one.
+ */
+NADDR
+dm_cfg_jump_target(struct ud ud)
+{
+	NADDR			 target = 0;
+
+	if (((ud.operand[0].type == UD_OP_REG) ||
+	    (ud.operand[0].type == UD_OP_MEM)) &&
+	    (dm_cfg_find_target(ud.pc - ud_insn_len(&ud), &target) == DM_OK))
+		return (target);
+
+	return (dm_get_jump_target(ud));
 }
 
 struct dm_cfg_node*
@@ -19,10 +19,12 @@
 
 #include "common.h"
 #include "dm_dis.h"
+#include "dm_graph.h"
 
 struct dm_instruction_se {
 	enum ud_mnemonic_code	instruction;
 	int			write;
+	int			kill;	/* Write doesn't read operand 0 */
 	int			jump;
 	int			ret;
 	int			disjunctive;
@@ -41,9 +43,19 @@ struct dm_cfg_node {
 	int			  post;    /* Post-order position */
 	int			  rpost;   /* Reverse Post-order position */
 	struct dm_cfg_node	 *idom;	   /* Immediate dominator of node */
+	struct dm_cfg_node	**dom_children; /* Nodes node idominates */
+	int			  dc_count;
+	int			  dom_pre; /* Dominator tree entry number */
+	int			  dom_post;/* Dominator tree exit number */
 	struct dm_cfg_node	**df_set;  /* Dominance frontier set of node */
 	int			  df_count;
-	enum ud_type		 *def_vars;/* Vars defined in this node */
+	struct dm_cfg_node	 *ipdom;   /* Immediate post dominator, NULL
+					    * if only the exit post dominates */
+	struct dm_cfg_node	**cd_set;  /* Nodes this one is control
+					    * dependent on (post dom frontier) */
+	int			  cd_count;
+	int			  loop;    /* Innermost loop, -1 if none */
+	int			 *def_vars;/* Vars defined in this node */
 	int			  dv_count;
 	struct phi_function	 *phi_functions;/* Vars requiring phi funcs */
 	int			  pf_count;
@@ -52,7 +64,7 @@ struct dm_cfg_node {
 };
 
 struct phi_function {
-	enum ud_type		   var;
+	int			   var;	/* DM_REG_* number */
 	int			   arguments;
 	int			   index;
 	int			  *indexes;
@@ -61,10 +73,21 @@ struct phi_function {
 	int			   d_count;
 };
 
+/* Most registers an instruction can write implicitly */
+#define DM_SSA_MAX_CLOBBERS	12
+
 struct instruction {
 	struct ud		   ud;
 	int			   index[3][2];
+	int			   cl_index[DM_SSA_MAX_CLOBBERS]; /* Versions
+					    * made by implicit writes, as
+					    * dm_ssa_insn_clobbers() lists
+					    * them, or -1 */
 	int			   cast[3];
+	int			   slot[3];	/* Stack slot operands, or -1 */
+	int			   sindex[3][2]; /* Their versions, as index */
+	int			   sp_delta; /* rsp less rsp on entry */
+	int			   fp_delta; /* Likewise rbp, see dm_sp() */
 	struct type_constraint	***constraints; /* Constraints */
 	int			  *c_counts; /*# conjunctions */
 	int			   d_count; /*# disjunctions */
@@ -128,6 +151,15 @@ struct type_constraint {
 	struct type_descriptor	  *right;
 };
 
+/*
+ * The target of an indirect jump or call found by analysis (e.g. sccp),
+ * which CFG recovery follows from then on
+ */
+struct dm_cfg_target {
+	NADDR		insn;	/* Address of the jump */
+	NADDR		target;
+};
+
 /*
  * A linked list of all the CFG blocks so we can free them at the end.
  * XXX queue.h
@@ -142,6 +174,7 @@ void			dm_instruction_se_init();
 int			dm_cmd_cfg(char **args);
 
 int			dm_is_target_in_text(NADDR addr);
+int			dm_is_target_in_func(NADDR addr);
 struct dm_cfg_node*	dm_recover_cfg();
 void			dm_init_cfg();
 struct dm_cfg_node*	dm_new_cfg_node(NADDR nstart, NADDR nend);
@@ -150,6 +183,7 @@ void			dm_graph_cfg();
 void			dm_free_cfg();
 struct dm_cfg_node*	dm_gen_cfg_block(struct dm_cfg_node *node);
 
+void			dm_cfg_graph(struct dm_graph *g);
 void			dm_dfw(struct dm_cfg_node *node);
 struct dm_cfg_node*	dm_get_unvisited_node();
 void			dm_depth_first_walk(struct dm_cfg_node *cfg);
@@ -162,4 +196,10 @@ struct dm_cfg_node*	dm_find_cfg_node_starting(NADDR addr);
 struct dm_cfg_node*	dm_find_cfg_node_ending(NADDR addr);
 struct dm_cfg_node*	dm_find_cfg_node_containing(NADDR addr);
 
+int			dm_cfg_add_target(NADDR insn, NADDR target);
+int			dm_cfg_find_target(NADDR insn, NADDR *target);
+void			dm_cfg_free_targets();
+int			dm_cfg_target_cmp(const void *t1, const void *t2);
+NADDR			dm_cfg_jump_target(struct ud ud);
+
 #endif
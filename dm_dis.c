@@ -17,6 +17,7 @@
 
 #include "dm_dis.h"
 #include "dm_dwarf.h"
+#include "dm_eh.h"
 
 ud_t			ud;
 NADDR			cur_addr;
@@ -42,7 +43,7 @@ dm_cmd_seek(char **args)
 	NADDR				 to;
 	int				 ret = DM_FAIL;
 	struct dm_dwarf_sym_cache_entry	*sym;
-	GElf_Shdr			 shdr;
+	struct dm_shdr_cache_entry	*shdr;
 
 	/* seeking to a section? */
 	if (args[0][0] == '.') {
@@ -51,7 +52,7 @@ dm_cmd_seek(char **args)
 			    "section non-existant: %s", args[0]);
 			goto clean;
 		}
-		to = shdr.sh_offset;
+		to = shdr->offset;
 	} else {
 		/* we first try to find a dwarf sym of that name */
 		if (dm_dwarf_find_sym(args[0], &sym) == DM_OK)
@@ -72,9 +73,9 @@ clean:
 int
 dm_disasm_op(NADDR addr)
 {
-	struct dm_dwarf_sym_cache_entry		*sym, *label_sym;
+	struct dm_dwarf_sym_cache_entry		*label_sym;
 	unsigned int				 read;
-	char					*hex;
+	char					*hex, desc[128];
 	NADDR					 target = 0;
 	uint8_t					 colour_set = 0;
 
@@ -89,6 +90,9 @@ dm_disasm_op(NADDR addr)
 		printf("%s\n  %s%s():%s\n%s\n", DM_RULE, ANSII_GREEN,
 		    label_sym->name, ANSII_WHITE, DM_RULE);
 
+	dm_dwarf_show_inline(addr);
+	dm_dwarf_show_source(addr);
+
 	hex = ud_insn_hex(&ud);
 
 	/* colourise control flow */
@@ -106,11 +110,9 @@ dm_disasm_op(NADDR addr)
 
 	if (ud.mnemonic == UD_Icall) {
 		target = dm_get_jump_target(ud);
-		/* if the target was a symbol we know, then say so */
-		if (dm_dwarf_find_sym_at_offset(target, &sym) == DM_OK) {
-			printf("\t(%s)", sym->name);
-
-		}
+		/* if the target was in a function we know, then say so */
+		if (dm_dwarf_describe_offset(target, desc, sizeof(desc)))
+			printf("\t(%s)", desc);
 	}
 
 	if (colour_set) /* reset colour */
@@ -127,6 +129,7 @@ dm_cmd_dis(char **args)
 	int	ops = strtoll(args[0], NULL, 0), i;
 	NADDR	addr = cur_addr;
 
+	dm_dwarf_source_reset();
 	printf("\n");
 	for (i = 0; i < ops; i++) {
 		addr = dm_disasm_op(addr);
@@ -139,19 +142,40 @@ dm_cmd_dis(char **args)
 	return (0);
 }
 
+/*
+ * disassemble to the end of the function. if the debug info or the unwind
+ * tables tell us where that is then use it, otherwise guess it is the
+ * next RET
+ */
 int
 dm_cmd_dis_func(char **args)
 {
-	NADDR	addr = cur_addr;
+	NADDR			 addr = cur_addr, end = 0;
+	struct dm_eh_func	*func;
+	struct dm_dwarf_extent	*ext;
 
 	(void) args;
 
+	if (dm_dwarf_find_extent(cur_addr, &ext) == DM_OK)
+		end = ext->end;
+	else if (dm_eh_find_func(cur_addr, &func) == DM_OK)
+		end = func->offset_end;
+
+	dm_dwarf_source_reset();
 	printf("\n");
-	do {
-		addr = dm_disasm_op(addr);
-		if (!addr)
-			break;
-	} while (ud.mnemonic != UD_Iret);
+	if (end) {
+		while (addr < end) {
+			addr = dm_disasm_op(addr);
+			if (!addr)
+				break;
+		}
+	} else {
+		do {
+			addr = dm_disasm_op(addr);
+			if (!addr)
+				break;
+		} while (ud.mnemonic != UD_Iret);
+	}
 	printf("\n");
 
 	dm_seek(cur_addr); /* rewind back */
@@ -15,9 +15,13 @@
  */
 
 #define _GNU_SOURCE
+#include <time.h>
+
 #include "dm_dom.h"
 #include "dm_cfg.h"
 #include "dm_gviz.h"
+#include "dm_util.h"
+#include "dm_bitset.h"
 
 extern struct ptrs *p_head;
 extern struct ptrs *p;
@@ -74,114 +78,321 @@ dm_cmd_dom(char **args)
 	return (0);
 }
 
+/*
+ * Which dominator engine does the user want?
+ */
+int
+dm_dom_engine()
+{
+	struct dm_setting	*s = NULL;
+
+	if ((dm_find_setting("dom.engine", &s) == DM_OK) &&
+	    (strcmp(s->val.sval, "chk") == 0))
+		return (DM_DOM_ENGINE_CHK);
+
+	return (DM_DOM_ENGINE_SNCA);
+}
+
 /*
  * Find immediate dominators of all nodes in CFG
  */
 void
 dm_dom(struct dm_cfg_node *cfg)
 {
-	struct dm_cfg_node	*node = NULL, *new_idom = NULL;
-	int			 changed = 1, i = 0, j = 0, k = 0;
+	struct dm_graph		 g;
+	struct dm_setting	*check = NULL;
+	int			*idom = NULL, engine = dm_dom_engine();
+	int			 i = 0;
+
+	dm_cfg_graph(&g);
+	idom = xmalloc(p_length * sizeof(int));
+	dm_graph_idom(&g, cfg->rpost, idom, engine);
+
+	/* Cross check against the other engine if asked to */
+	if ((dm_find_setting("dom.check", &check) == DM_OK) &&
+	    (check->val.ival))
+		dm_dom_check(&g, cfg->rpost, idom, engine);
 
-	/* We use the 'visited' field to indicate a node has been processed */
 	for (i = 0; i < p_length; i++)
-		((struct dm_cfg_node*)rpost[i])->visited = 0;
-
-	/* First node dominates itself */
-	cfg->idom = cfg;
-	cfg->visited = 1;
-
-	while (changed) {
-		changed = 0;
-		/* For all nodes except start node, in reverse post-order */
-		for (i = 1; i < p_length; i++) {
-			node = (struct dm_cfg_node*)rpost[i];
-
-			/*new_idom = node->parents[0];
-			j = 0;*/
-			/* new_idom = first processed parent of node */
-			for (j = 0; j < node->p_count; j++)
-				if (node->parents[j]->visited) {
-					new_idom = node->parents[j];
-					break;
-				}
+		((struct dm_cfg_node*)rpost[i])->idom = (idom[i] == -1) ?
+		    NULL : (struct dm_cfg_node*)rpost[idom[i]];
 
-			/* For all other parents of node */
-			for (k = 0; k < node->p_count; k++)
-				if ((j != k) && (node->parents[k]->idom !=
-				    NULL))
-					new_idom =
-					    dm_intersect(node->parents[k],
-					    new_idom);
-			if (node->idom != new_idom) {
-				node->idom = new_idom;
-				changed = 1;
-			}
-			node->visited = 1;
+	free(idom);
+	dm_graph_free(&g);
+
+	dm_dom_tree(cfg);
+}
+
+/*
+ * Run the engine we didn't use and complain about any difference
+ */
+void
+dm_dom_check(struct dm_graph *g, int root, int *idom, int engine)
+{
+	int			*other = NULL, i = 0, bad = 0;
+
+	other = xmalloc(g->n * sizeof(int));
+	dm_graph_idom(g, root, other, engine == DM_DOM_ENGINE_SNCA ?
+	    DM_DOM_ENGINE_CHK : DM_DOM_ENGINE_SNCA);
+
+	for (i = 0; i < g->n; i++) {
+		if (idom[i] != other[i]) {
+			DPRINTF(DM_D_WARN, "Dominator engines disagree on "
+			    "vertex %d: %d vs %d", i, idom[i], other[i]);
+			bad++;
 		}
 	}
+
+	if (!bad)
+		DPRINTF(DM_D_INFO, "Dominator engines agree on %d vertices",
+		    g->n);
+
+	free(other);
 }
 
 /*
- * Find intersecting dominator of two nodes
+ * Build the dominator tree child lists and number the tree depth first,
+ * so that dominance can be checked with two comparisons
  */
-struct dm_cfg_node*
-dm_intersect(struct dm_cfg_node *b1, struct dm_cfg_node *b2)
+void
+dm_dom_tree(struct dm_cfg_node *cfg)
 {
-	struct dm_cfg_node	*finger1 = b1, *finger2 = b2;
-	while (finger1->post != finger2->post) {
-		while (finger1->post < finger2->post)
-			finger1 = finger1->idom;
-		while (finger2->post < finger1->post)
-			finger2 = finger2->idom;
+	struct dm_cfg_node	 *node = NULL, *idom = NULL;
+	struct dm_cfg_node	**stack = NULL;
+	int			 *next = NULL;
+	int			  i = 0, depth = 0, count = 0;
+
+	for (i = 0; i < p_length; i++) {
+		node = (struct dm_cfg_node*)rpost[i];
+		free(node->dom_children);
+		node->dom_children = NULL;
+		node->dc_count = 0;
+		node->dom_pre = node->dom_post = -1;
+	}
+
+	/* In reverse post-order, so children come out in a stable order */
+	for (i = 0; i < p_length; i++) {
+		node = (struct dm_cfg_node*)rpost[i];
+		idom = node->idom;
+		if ((idom == NULL) || (idom == node))
+			continue;
+		idom->dom_children = xrealloc(idom->dom_children,
+		    ++idom->dc_count * sizeof(void*));
+		idom->dom_children[idom->dc_count - 1] = node;
 	}
-	return finger1;
+
+	/* Walk the tree with our own stack, the tree can be deep */
+	stack = xmalloc(p_length * sizeof(void*));
+	next = xmalloc(p_length * sizeof(int));
+	stack[0] = cfg;
+	next[0] = 0;
+	depth = 1;
+	cfg->dom_pre = count++;
+	while (depth) {
+		node = stack[depth - 1];
+		if (next[depth - 1] < node->dc_count) {
+			node = node->dom_children[next[depth - 1]++];
+			node->dom_pre = count++;
+			stack[depth] = node;
+			next[depth++] = 0;
+		} else {
+			node->dom_post = count++;
+			depth--;
+		}
+	}
+
+	free(stack);
+	free(next);
+}
+
+/*
+ * Does a dominate b? Nodes outside the dominator tree dominate nothing.
+ */
+int
+dm_dominates(struct dm_cfg_node *a, struct dm_cfg_node *b)
+{
+	if ((a->dom_pre < 0) || (b->dom_pre < 0))
+		return (0);
+
+	return ((a->dom_pre <= b->dom_pre) && (b->dom_post <= a->dom_post));
 }
 
 /*
- * Build dominance frontier sets for all nodes
+ * Build dominance frontier sets for all nodes. Graphs whose bit matrix is
+ * small get a bitset row per block, which makes duplicates free; big ones
+ * are done in two passes, counting first so each set is allocated
+ * exactly once.
  */
 void
 dm_dom_frontiers()
 {
-	struct dm_cfg_node *node = NULL, *runner = NULL;
-	int i = 0, j = 0, duplicate = 0;
+	struct dm_dom_df_job	 job;
+	struct dm_cfg_node	*node = NULL;
+	uint64_t		*row = NULL, w;
+	int			 v = 0, k = 0, nthreads = 1;
+
+	memset(&job, 0, sizeof(job));
+	if (p_length >= DM_DOM_DF_PAR_MIN)
+		nthreads = dm_nthreads();
+
+	if ((size_t)p_length * DM_BITSET_WORDS(p_length) * sizeof(uint64_t) <=
+	    DM_DOM_DF_DENSE_BYTES) {
+		job.words = DM_BITSET_WORDS(p_length);
+		job.bits = xcalloc((size_t)p_length * job.words,
+		    sizeof(uint64_t));
+		dm_dom_df_run(&job, nthreads);
+
+		/* Compact the rows into arrays, in reverse post-order */
+		for (v = 0; v < p_length; v++) {
+			node = (struct dm_cfg_node*)rpost[v];
+			row = job.bits + (size_t)v * job.words;
+			node->df_count = 0;
+			for (k = 0; k < job.words; k++)
+				node->df_count += __builtin_popcountll(row[k]);
+			if (!node->df_count)
+				continue;
+			node->df_set = xmalloc(node->df_count * sizeof(void*));
+			node->df_count = 0;
+			for (k = 0; k < job.words; k++)
+				for (w = row[k]; w; w &= w - 1)
+					node->df_set[node->df_count++] =
+					    rpost[k * 64 + __builtin_ctzll(w)];
+		}
+		free(job.bits);
+		return;
+	}
 
-	/* For all nodes */
-	for (p = p_head; p != NULL; p = p->next) {
-		node = (struct dm_cfg_node*)p->ptr;
-		/* For all parents of node */
-		for (i = 0; (i < node->p_count) && (node->p_count > 1); i++) {
+	job.count = xcalloc(p_length, sizeof(int));
+	job.fill = xcalloc(p_length, sizeof(int));
+	job.pass = 1;
+	dm_dom_df_run(&job, nthreads);
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		node->df_count = job.count[v];
+		if (node->df_count)
+			node->df_set = xmalloc(node->df_count * sizeof(void*));
+	}
+
+	job.pass = 2;
+	job.next = 0;
+	dm_dom_df_run(&job, nthreads);
+
+	/* Threads fill in any order, put sets back into reverse post-order */
+	if (nthreads > 1) {
+		for (v = 0; v < p_length; v++) {
+			node = (struct dm_cfg_node*)rpost[v];
+			qsort(node->df_set, node->df_count, sizeof(void*),
+			    dm_dom_df_cmp);
+		}
+	}
+
+	free(job.count);
+	free(job.fill);
+}
+
+/*
+ * Walk the join nodes of the job. Each join node's runner walks touch
+ * nothing but the frontier sets, so they can be spread over threads.
+ */
+void
+dm_dom_df_run(struct dm_dom_df_job *job, int nthreads)
+{
+	struct dm_dom_df_worker	*workers = NULL;
+	int			*stamp = NULL, i = 0;
+
+	if (nthreads > 1) {
+		DPRINTF(DM_D_INFO, "Building frontiers of %d blocks with "
+		    "%d threads", p_length, nthreads);
+
+		workers = xcalloc(nthreads, sizeof(struct dm_dom_df_worker));
+		for (i = 0; i < nthreads; i++) {
+			workers[i].job = job;
+			if (pthread_create(&workers[i].tid, NULL,
+			    dm_dom_df_worker, &workers[i]) != 0) {
+				DPRINTF(DM_D_WARN, "Can't start thread");
+				break;
+			}
+			workers[i].started = 1;
+		}
+
+		for (i = 0; i < nthreads; i++)
+			if (workers[i].started)
+				pthread_join(workers[i].tid, NULL);
+		free(workers);
+	}
+
+	/* Whatever the workers didn't get to (if any), we do here */
+	stamp = xmalloc(p_length * sizeof(int));
+	memset(stamp, 0xff, p_length * sizeof(int));
+	dm_dom_df_work(job, stamp);
+	free(stamp);
+}
+
+void *
+dm_dom_df_worker(void *arg)
+{
+	struct dm_dom_df_worker	*w = arg;
+	int			*stamp = NULL;
+
+	stamp = xmalloc(p_length * sizeof(int));
+	memset(stamp, 0xff, p_length * sizeof(int));
+	dm_dom_df_work(w->job, stamp);
+	free(stamp);
+
+	return (NULL);
+}
+
+/*
+ * Claim join nodes one at a time and walk up from each parent to the
+ * join node's idom. stamp[] records the last join node that reached a
+ * block, once a walk hits a stamped block the rest of it has been done.
+ */
+void
+dm_dom_df_work(struct dm_dom_df_job *job, int *stamp)
+{
+	struct dm_cfg_node	*node = NULL, *runner = NULL;
+	int			 v = 0, i = 0, r = 0, slot = 0;
+
+	while ((v = __atomic_fetch_add(&job->next, 1,
+	    __ATOMIC_RELAXED)) < p_length) {
+		node = (struct dm_cfg_node*)rpost[v];
+		/* Unreachable nodes have no idom to stop at */
+		if ((node->p_count < 2) || (node->idom == NULL))
+			continue;
+
+		for (i = 0; i < node->p_count; i++) {
 			runner = node->parents[i];
-			while (runner != node->idom) {
-				/* Don't add duplicate nodes to the set */
-				duplicate = 0;
-				for (j = 0; j < runner->df_count; j++)
-					if (runner->df_set[j] == node) {
-						duplicate = 1;
-						break;
-					}
-				/* Add node to runners frontier set */
-				if (!duplicate) {
-					runner->df_set = realloc(
-					    runner->df_set,
-					    ++runner->df_count * sizeof(void*));
-					runner->df_set[
-					    runner->df_count - 1] = node;
+			while ((runner != NULL) && (runner != node->idom)) {
+				r = runner->rpost;
+				if (stamp[r] == v)
+					break;
+				stamp[r] = v;
+
+				if (job->bits != NULL)
+					DM_BITSET_ATOMIC_SET(job->bits +
+					    (size_t)r * job->words, v);
+				else if (job->pass == 1)
+					__atomic_fetch_add(&job->count[r], 1,
+					    __ATOMIC_RELAXED);
+				else {
+					slot = __atomic_fetch_add(&job->fill[r],
+					    1, __ATOMIC_RELAXED);
+					runner->df_set[slot] = node;
 				}
 				runner = runner->idom;
 			}
 		}
-		/*printf("Dominance frontier set of %d = [", node->rpost);
-		for (i = 0; i < node->df_count; i++) {
-			printf("%d", node->df_set[i]->rpost);
-			if (i != node->df_count - 1)
-				printf(", ");
-		}
-		printf("]\n");*/
 	}
+}
 
+int
+dm_dom_df_cmp(const void *a, const void *b)
+{
+	const struct dm_cfg_node *n1 = *(struct dm_cfg_node * const *)a;
+	const struct dm_cfg_node *n2 = *(struct dm_cfg_node * const *)b;
 
+	return (n1->rpost - n2->rpost);
 }
 
 /*
@@ -190,8 +401,14 @@ dm_dom_frontiers()
 void
 dm_dom_frontiers_free()
 {
-	for (p = p_head; p != NULL; p = p->next)
-		free(((struct dm_cfg_node*)p->ptr)->df_set);
+	struct dm_cfg_node *node = NULL;
+
+	for (p = p_head; p != NULL; p = p->next) {
+		node = (struct dm_cfg_node*)p->ptr;
+		free(node->df_set);
+		node->df_set = NULL;
+		node->df_count = 0;
+	}
 }
 
 /*
@@ -227,6 +444,297 @@ dm_graph_dom()
 	dm_display_graph("dom.dot");
 }
 
+/*
+ * Show post dominators and control dependences of the current function
+ */
+int
+dm_cmd_pdom(char **args)
+{
+	struct dm_cfg_node	*cfg = NULL, *node = NULL;
+	int			i = 0, j = 0;
+
+	(void) args;
+
+	/* Initialise structures */
+	dm_init_cfg();
+
+	/* Get CFG */
+	cfg = dm_recover_cfg();
+
+	/* Build post dominator tree and control dependences */
+	dm_pdom(cfg);
+	dm_cdg();
+
+	for (i = 0; i < p_length; i++) {
+		node = (struct dm_cfg_node*)rpost[i];
+		printf("Block %d (start: " NADDR_FMT ", end: " NADDR_FMT
+		    ")\n\tImmediate post dominator: ", node->post,
+		    node->start, node->end);
+		if (node->ipdom)
+			printf("%d\n", node->ipdom->post);
+		else
+			printf("exit\n");
+		if (node->cd_count) {
+			printf("\tControl dependent on: ");
+			for (j = 0; j < node->cd_count; j++)
+				printf("%d ", node->cd_set[j]->post);
+			printf("\n");
+		}
+	}
+
+	/* Display post dominator tree and control dependence graph */
+	dm_graph_pdom();
+	dm_graph_cdg();
+
+	/* Free all CFG structures */
+	dm_free_cfg();
+
+	return (0);
+}
+
+/*
+ * Blocks that leave the function: returns (or anything else with no
+ * successors) and jumps out of the function
+ */
+int
+dm_pdom_is_exit(struct dm_cfg_node *node)
+{
+	return ((node->children[0] == NULL) || (node->nonlocal));
+}
+
+/*
+ * Find immediate post dominators of all nodes in CFG. This is the
+ * dominator engine run on the reversed CFG from a virtual exit vertex
+ * (numbered p_length), which every exit block leads to. Blocks that can
+ * never reach an exit (infinite loops) are given an edge to the exit too,
+ * deepest block first, so that every block gets a post dominator.
+ */
+void
+dm_pdom(struct dm_cfg_node *cfg)
+{
+	struct dm_graph		 g;
+	struct dm_cfg_node	*node = NULL;
+	struct dm_setting	*check = NULL;
+	int			*from = NULL, *to = NULL, *ipdom = NULL;
+	int			*stack = NULL, engine = dm_dom_engine();
+	int			 v = 0, c = 0, m = 0, size = 0, extra = 0;
+	int			 exit_v = p_length;
+	char			*seen = NULL;
+
+	(void) cfg;
+
+	/* Reversed edges, plus exit -> each exit block */
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		for (c = 0; ; c++) {
+			if (m + 1 >= size) {
+				size = size ? size * 2 : 64;
+				from = xrealloc(from, size * sizeof(int));
+				to = xrealloc(to, size * sizeof(int));
+			}
+			if (node->children[c] == NULL)
+				break;
+			from[m] = node->children[c]->rpost;
+			to[m++] = v;
+		}
+		if (dm_pdom_is_exit(node)) {
+			from[m] = exit_v;
+			to[m++] = v;
+		}
+	}
+	dm_graph_init(&g, p_length + 1, m, from, to);
+
+	/* Find blocks the exit can't reach and hook them up */
+	seen = xcalloc(p_length + 1, 1);
+	stack = xmalloc((p_length + 1) * sizeof(int));
+	dm_pdom_mark(&g, exit_v, seen, stack);
+	for (v = p_length - 1; v >= 0; v--) {
+		if (seen[v])
+			continue;
+		if (m + 1 >= size) {
+			size *= 2;
+			from = xrealloc(from, size * sizeof(int));
+			to = xrealloc(to, size * sizeof(int));
+		}
+		from[m] = exit_v;
+		to[m++] = v;
+		extra++;
+		dm_pdom_mark(&g, v, seen, stack);
+	}
+	if (extra) {
+		DPRINTF(DM_D_INFO, "%d blocks never reach an exit", extra);
+		dm_graph_free(&g);
+		dm_graph_init(&g, p_length + 1, m, from, to);
+	}
+	free(seen);
+	free(stack);
+	free(from);
+	free(to);
+
+	ipdom = xmalloc((p_length + 1) * sizeof(int));
+	dm_graph_idom(&g, exit_v, ipdom, engine);
+
+	if ((dm_find_setting("dom.check", &check) == DM_OK) &&
+	    (check->val.ival))
+		dm_dom_check(&g, exit_v, ipdom, engine);
+
+	for (v = 0; v < p_length; v++)
+		((struct dm_cfg_node*)rpost[v])->ipdom =
+		    ((ipdom[v] == exit_v) || (ipdom[v] == -1)) ?
+		    NULL : (struct dm_cfg_node*)rpost[ipdom[v]];
+
+	free(ipdom);
+	dm_graph_free(&g);
+}
+
+/*
+ * Mark everything reachable from v in g
+ */
+void
+dm_pdom_mark(struct dm_graph *g, int v, char *seen, int *stack)
+{
+	int			 sp = 0, e = 0, w = 0;
+
+	seen[v] = 1;
+	stack[sp++] = v;
+	while (sp) {
+		v = stack[--sp];
+		for (e = g->succ_idx[v]; e < g->succ_idx[v + 1]; e++) {
+			w = g->succ[e];
+			if (!seen[w]) {
+				seen[w] = 1;
+				stack[sp++] = w;
+			}
+		}
+	}
+}
+
+/*
+ * Build the control dependence graph from the post dominator tree. For
+ * each edge a -> b, every block from b up the ipdom chain to (but not
+ * including) ipdom(a) is control dependent on a, which gives post
+ * dominance frontiers the same way dm_dom_frontiers() gives dominance
+ * frontiers. Counted first so each set is allocated once.
+ */
+void
+dm_cdg()
+{
+	struct dm_cfg_node	*node = NULL, *runner = NULL;
+	int			*stamp = NULL;
+	int			 pass = 0, v = 0, c = 0;
+
+	stamp = xmalloc(p_length * sizeof(int));
+	for (pass = 0; pass < 2; pass++) {
+		memset(stamp, 0xff, p_length * sizeof(int));
+		for (v = 0; v < p_length; v++) {
+			node = (struct dm_cfg_node*)rpost[v];
+			/* Only branches make anything control dependent */
+			if ((node->children[0] == NULL) ||
+			    (node->children[1] == NULL))
+				continue;
+			for (c = 0; node->children[c] != NULL; c++) {
+				runner = node->children[c];
+				while ((runner != NULL) &&
+				    (runner != node->ipdom)) {
+					if (stamp[runner->rpost] == v)
+						break;
+					stamp[runner->rpost] = v;
+					if (pass)
+						runner->cd_set[
+						    runner->cd_count++] = node;
+					else
+						runner->cd_count++;
+					runner = runner->ipdom;
+				}
+			}
+		}
+
+		if (pass)
+			break;
+		for (v = 0; v < p_length; v++) {
+			node = (struct dm_cfg_node*)rpost[v];
+			free(node->cd_set);
+			node->cd_set = NULL;
+			if (node->cd_count)
+				node->cd_set = xmalloc(node->cd_count *
+				    sizeof(void*));
+			node->cd_count = 0;
+		}
+	}
+	free(stamp);
+}
+
+/*
+ * Build a graphviz graph of the post dominator tree and display it
+ */
+void
+dm_graph_pdom()
+{
+	struct dm_cfg_node *node = NULL;
+	FILE *fp = dm_new_graph("pdom.dot");
+	char *itoa1 = NULL, *itoa2 = NULL;
+
+	if (!fp) return;
+
+	dm_add_label(fp, "exit", "exit");
+	for (p = p_head; p != NULL; p = p->next) {
+		node = (struct dm_cfg_node*)(p->ptr);
+
+		asprintf(&itoa1, "%d", node->post);
+		asprintf(&itoa2, "%d\\nstart: " NADDR_FMT "\\nend: "
+		    NADDR_FMT, node->post, node->start, node->end);
+		dm_add_label(fp, itoa1, itoa2);
+		free(itoa2);
+
+		if (node->ipdom) {
+			asprintf(&itoa2, "%d", node->ipdom->post);
+			dm_add_edge(fp, itoa2, itoa1);
+			free(itoa2);
+		}
+		else
+			dm_add_edge(fp, "exit", itoa1);
+
+		free(itoa1);
+	}
+	dm_end_graph(fp);
+	dm_display_graph("pdom.dot");
+}
+
+/*
+ * Build a graphviz graph of the control dependences and display it. An
+ * edge a -> b means whether b runs is decided by the branch ending a.
+ */
+void
+dm_graph_cdg()
+{
+	struct dm_cfg_node *node = NULL;
+	FILE *fp = dm_new_graph("cdg.dot");
+	char *itoa1 = NULL, *itoa2 = NULL;
+	int i = 0;
+
+	if (!fp) return;
+
+	for (p = p_head; p != NULL; p = p->next) {
+		node = (struct dm_cfg_node*)(p->ptr);
+
+		asprintf(&itoa1, "%d", node->post);
+		asprintf(&itoa2, "%d\\nstart: " NADDR_FMT "\\nend: "
+		    NADDR_FMT, node->post, node->start, node->end);
+		dm_add_label(fp, itoa1, itoa2);
+		free(itoa2);
+
+		for (i = 0; i < node->cd_count; i++) {
+			asprintf(&itoa2, "%d", node->cd_set[i]->post);
+			dm_add_edge(fp, itoa2, itoa1);
+			free(itoa2);
+		}
+
+		free(itoa1);
+	}
+	dm_end_graph(fp);
+	dm_display_graph("cdg.dot");
+}
+
 /*void
 dm_get_predecessors(struct dm_cfg_node *node, struct ptrs *predecessors)
 {
@@ -239,3 +747,106 @@ dm_get_predecessors(struct dm_cfg_node *node, struct ptrs *predecessors)
 	}
 }*/
 
+/*
+ * Make a random CFG-like graph of n blocks for benchmarking: fall
+ * through edges, short forward branches, loop back edges and the odd
+ * jump anywhere to make it irreducible
+ */
+void
+dm_dom_bench_graph(struct dm_graph *g, int n)
+{
+	int		*from = NULL, *to = NULL, i = 0, m = 0, r = 0;
+
+	from = xmalloc(4 * (size_t)n * sizeof(int));
+	to = xmalloc(4 * (size_t)n * sizeof(int));
+
+	srandom(n);
+	for (i = 0; i < n; i++) {
+		if (i + 1 < n) {
+			from[m] = i;
+			to[m++] = i + 1;
+		}
+		if ((i + 2 < n) && (random() % 3 == 0)) {
+			r = (n - i - 2 > 16) ? 16 : n - i - 2;
+			from[m] = i;
+			to[m++] = i + 2 + random() % r;
+		}
+		if ((i > 0) && (random() % 8 == 0)) {
+			r = (i > 64) ? 64 : i;
+			from[m] = i;
+			to[m++] = i - 1 - random() % r;
+		}
+		if (random() % 32 == 0) {
+			from[m] = i;
+			to[m++] = random() % n;
+		}
+	}
+
+	dm_graph_init(g, n, m, from, to);
+	free(from);
+	free(to);
+}
+
+double
+dm_dom_bench_ms()
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
+
+/*
+ * Compare the dominator engines on synthetic CFGs of 10 blocks up to
+ * 'max' blocks
+ */
+int
+dm_cmd_dombench(char **args)
+{
+	struct dm_graph		 g;
+	int			 max = strtol(args[0], NULL, 0), n = 0;
+	int			*chk = NULL, *snca = NULL;
+	double			 t0, t1, t2;
+
+	printf("\n%s\n", DM_RULE);
+	printf("%-10s | %-10s | %-12s | %-12s | %s\n", "Blocks", "Edges",
+	    "CHK (ms)", "SNCA (ms)", "Agree");
+	printf("%s\n", DM_RULE);
+
+	for (n = 10; n <= max; n *= 10) {
+		dm_dom_bench_graph(&g, n);
+		chk = xmalloc(n * sizeof(int));
+		snca = xmalloc(n * sizeof(int));
+
+		t0 = dm_dom_bench_ms();
+		dm_graph_idom_chk(&g, 0, chk);
+		t1 = dm_dom_bench_ms();
+		dm_graph_idom_snca(&g, 0, snca);
+		t2 = dm_dom_bench_ms();
+
+		printf("%-10d | %-10d | %12.3f | %12.3f | %s\n", n, g.m,
+		    t1 - t0, t2 - t1,
+		    memcmp(chk, snca, n * sizeof(int)) ? "NO" : "yes");
+
+		free(chk);
+		free(snca);
+		dm_graph_free(&g);
+
+		/* Stop before n * 10 can overflow */
+		if (n > max / 10)
+			break;
+	}
+	printf("%s\n\n", DM_RULE);
+
+	return (DM_OK);
+}
+
+int
+dm_cmd_dombench_noargs(char **args)
+{
+	char	*arg = "1000000";
+
+	(void) args;
+
+	return (dm_cmd_dombench(&arg));
+}
@@ -17,14 +17,60 @@
 #ifndef __DM_DOM_H
 #define __DM_DOM_H
 
+#include <pthread.h>
+
 #include "common.h"
 #include "dm_cfg.h"
 
+/*
+ * Frontiers are built as bitsets while the p_length^2 bit matrix fits in
+ * this many bytes (about 5800 blocks), and sparse above that
+ */
+#define DM_DOM_DF_DENSE_BYTES	(4 * 1024 * 1024)
+/* Below this many blocks it isn't worth starting threads */
+#define DM_DOM_DF_PAR_MIN	4096
+
+/* Frontier job, shared by all threads */
+struct dm_dom_df_job {
+	int			 next;	/* Next join node to claim */
+	int			 pass;	/* Sparse pass, 1 counts, 2 fills */
+	uint64_t		*bits;	/* Dense: a row of bits per block */
+	int			 words;	/* Dense: words per row */
+	int			*count;	/* Sparse: frontier size per block */
+	int			*fill;	/* Sparse: next free slot per block */
+};
+
+struct dm_dom_df_worker {
+	pthread_t		 tid;
+	int			 started;
+	struct dm_dom_df_job	*job;
+};
+
 int			dm_cmd_dom(char **args);
-struct dm_cfg_node*	dm_intersect(struct dm_cfg_node *b1,
-			    struct dm_cfg_node *b2);
+int			dm_cmd_dombench(char **args);
+int			dm_cmd_dombench_noargs(char **args);
+int			dm_dom_engine();
 void			dm_dom(struct dm_cfg_node *cfg);
+void			dm_dom_check(struct dm_graph *g, int root, int *idom,
+			    int engine);
+void			dm_dom_bench_graph(struct dm_graph *g, int n);
+double			dm_dom_bench_ms();
+void			dm_dom_tree(struct dm_cfg_node *cfg);
+int			dm_dominates(struct dm_cfg_node *a,
+			    struct dm_cfg_node *b);
 void			dm_dom_frontiers();
+void			dm_dom_df_run(struct dm_dom_df_job *job, int nthreads);
+void			*dm_dom_df_worker(void *arg);
+void			dm_dom_df_work(struct dm_dom_df_job *job, int *stamp);
+int			dm_dom_df_cmp(const void *a, const void *b);
 void			dm_dom_frontiers_free();
 void			dm_graph_dom();
+int			dm_cmd_pdom(char **args);
+int			dm_pdom_is_exit(struct dm_cfg_node *node);
+void			dm_pdom(struct dm_cfg_node *cfg);
+void			dm_pdom_mark(struct dm_graph *g, int v, char *seen,
+			    int *stack);
+void			dm_cdg();
+void			dm_graph_pdom();
+void			dm_graph_cdg();
 #endif
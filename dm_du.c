@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "dm_du.h"
+#include "dm_gviz.h"
+#include "dm_util.h"
+
+extern struct dm_instruction_se *instructions;
+extern struct ptrs		*p_head;
+extern struct ptrs		*p;
+extern struct dm_ssa_index	*indices;
+
+/*
+ * Build SSA of the current function and its def-use chains, and find the
+ * value the user named. DM_FAIL if there isn't one.
+ */
+int
+dm_du_open(struct dm_du *du, char *name, int *val)
+{
+	dm_ssa_open();
+	dm_du_build(du);
+
+	if (dm_du_parse(du, name, val) != DM_OK) {
+		fprintf(stderr, "No SSA value '%s' in this function\n", name);
+		dm_du_free(du);
+		dm_ssa_close();
+		return (DM_FAIL);
+	}
+	return (DM_OK);
+}
+
+/*
+ * Show where an SSA value is defined and everywhere it is used
+ */
+int
+dm_cmd_uses(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_du		 du;
+	int			 val = 0, i = 0;
+
+	if (dm_du_open(&du, args[0], &val) != DM_OK) {
+		dm_seek(addr);
+		return (DM_FAIL);
+	}
+
+	printf("  Defined by:\n");
+	dm_du_print_site(&du.def[val]);
+	printf("  %d uses:\n", du.use_idx[val + 1] - du.use_idx[val]);
+	for (i = du.use_idx[val]; i < du.use_idx[val + 1]; i++)
+		dm_du_print_site(&du.use[i]);
+
+	dm_du_free(&du);
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Show where an SSA value is defined
+ */
+int
+dm_cmd_def(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_du		 du;
+	int			 val = 0;
+
+	if (dm_du_open(&du, args[0], &val) != DM_OK) {
+		dm_seek(addr);
+		return (DM_FAIL);
+	}
+
+	dm_du_print_site(&du.def[val]);
+
+	dm_du_free(&du);
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Draw the values an SSA value is computed from and the values computed
+ * from it
+ */
+int
+dm_cmd_duslice(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_du		 du;
+	int			 val = 0;
+
+	if (dm_du_open(&du, args[0], &val) != DM_OK) {
+		dm_seek(addr);
+		return (DM_FAIL);
+	}
+
+	dm_graph_duslice(&du, val);
+
+	dm_du_free(&du);
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Number the values of the SSA form just built and record where each is
+ * defined and used. Uses are counted in one pass and stored in a second,
+ * so each value's uses are contiguous.
+ */
+void
+dm_du_build(struct dm_du *du)
+{
+	struct dm_cfg_node	*node = NULL;
+	struct phi_function	*phi = NULL;
+	struct dm_du_site	 site;
+	int			*fill = NULL, uses[DM_SSA_MAX_USES];
+	int			 defs[DM_SSA_MAX_CLOBBERS];
+	int			 reg = 0, pass = 0, i = 0, j = 0, k = 0;
+	int			 count = 0, def = 0, val = 0, n_defs = 0;
+
+	du->base[0] = 0;
+	for (reg = 0; reg < DM_REG_COUNT; reg++)
+		du->base[reg + 1] = du->base[reg] + indices[reg].count + 1;
+	du->n = du->base[DM_REG_COUNT];
+
+	/* Anything not defined in the function is defined on entry */
+	du->def = xcalloc(du->n, sizeof(struct dm_du_site));
+	du->use_idx = xcalloc(du->n + 1, sizeof(int));
+	du->use = NULL;
+	for (i = 0; i < du->n; i++)
+		du->def[i].kind = DM_DU_ENTRY;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (p = p_head; p != NULL; p = p->next) {
+			node = (struct dm_cfg_node*)p->ptr;
+			site.node = node;
+
+			site.kind = DM_DU_PHI;
+			for (i = 0; i < node->pf_count; i++) {
+				phi = &node->phi_functions[i];
+				site.i = i;
+				if (pass == 0)
+					du->def[DM_DU_VALUE(du, phi->var,
+					    phi->index)] = site;
+				for (j = 0; j < phi->arguments; j++) {
+					if ((phi->indexes[j] < 0) ||
+					    (phi->indexes[j] >
+					    indices[phi->var].count))
+						continue;
+					val = DM_DU_VALUE(du, phi->var,
+					    phi->indexes[j]);
+					if (pass == 0)
+						du->use_idx[val + 1]++;
+					else
+						du->use[fill[val]++] = site;
+				}
+			}
+
+			site.kind = DM_DU_INSN;
+			for (i = 0; i < node->i_count; i++) {
+				site.i = i;
+				count = dm_du_insn(du, node->instructions[i],
+				    uses, &def);
+				if ((pass == 0) && (def != -1))
+					du->def[def] = site;
+				if (pass == 0) {
+					n_defs = dm_du_insn_clobbers(du,
+					    node->instructions[i], defs);
+					for (k = 0; k < n_defs; k++)
+						du->def[defs[k]] = site;
+				}
+				for (k = 0; k < count; k++) {
+					if (pass == 0)
+						du->use_idx[uses[k] + 1]++;
+					else
+						du->use[fill[uses[k]]++] = site;
+				}
+			}
+		}
+
+		if (pass == 0) {
+			for (i = 0; i < du->n; i++)
+				du->use_idx[i + 1] += du->use_idx[i];
+			du->use = xmalloc((du->use_idx[du->n] + 1) *
+			    sizeof(struct dm_du_site));
+			fill = xmalloc(du->n * sizeof(int));
+			memcpy(fill, du->use_idx, du->n * sizeof(int));
+		}
+	}
+	free(fill);
+}
+
+void
+dm_du_free(struct dm_du *du)
+{
+	free(du->def);
+	free(du->use_idx);
+	free(du->use);
+	du->def = du->use = NULL;
+	du->use_idx = NULL;
+	du->n = 0;
+}
+
+/*
+ * The values an instruction reads and the one it defines (-1 if none),
+ * going by the versions renaming gave its operands. A value read twice
+ * is only returned once. Returns how many uses there are.
+ */
+int
+dm_du_insn(struct dm_du *du, struct instruction *insn, int *uses, int *def)
+{
+	struct ud_operand	*op = NULL;
+	int			 regs[6], vers[6];
+	int			 count = 0, n = 0, i = 0, j = 0, val = 0;
+
+	*def = -1;
+	for (i = 0; i < 3; i++) {
+		op = &insn->ud.operand[i];
+		if (op->type == UD_OP_MEM) {
+			regs[n] = dm_ssa_reg(op->base);
+			vers[n++] = insn->index[i][0];
+			regs[n] = dm_ssa_reg(op->index);
+			vers[n++] = insn->index[i][1];
+		} else if (op->type != UD_OP_REG)
+			continue;
+		else if ((i == 0) && instructions[insn->ud.mnemonic].write) {
+			/* The old value is kept in [0][1] if it is read */
+			regs[n] = dm_ssa_reg(op->base);
+			*def = DM_DU_VALUE(du, regs[n], insn->index[0][0]);
+			vers[n++] = insn->index[0][1];
+		} else {
+			regs[n] = dm_ssa_reg(op->base);
+			vers[n++] = insn->index[i][0];
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((regs[i] == DM_REG_NONE) || (vers[i] < 0))
+			continue;
+		val = DM_DU_VALUE(du, regs[i], vers[i]);
+		for (j = 0; j < count; j++)
+			if (uses[j] == val)
+				break;
+		if (j == count)
+			uses[count++] = val;
+	}
+	return (count);
+}
+
+/*
+ * The values an instruction defines by writing registers implicitly, a
+ * call's return value for one. Returns how many there are.
+ */
+int
+dm_du_insn_clobbers(struct dm_du *du, struct instruction *insn, int *defs)
+{
+	int			 regs[DM_SSA_MAX_CLOBBERS];
+	int			 n = 0, k = 0, count = 0;
+
+	n = dm_ssa_insn_clobbers(&insn->ud, regs);
+	for (k = 0; k < n; k++)
+		if (insn->cl_index[k] >= 0)
+			defs[count++] = DM_DU_VALUE(du, regs[k],
+			    insn->cl_index[k]);
+	return (count);
+}
+
+/*
+ * Like dm_du_insn() for any site. Phi functions can have any number of
+ * arguments, so the uses array grows as needed.
+ */
+int
+dm_du_site_uses(struct dm_du *du, struct dm_du_site *s, int **uses,
+    int *cap, int *def)
+{
+	struct phi_function	*phi = NULL;
+	int			 i = 0;
+
+	if (*cap < DM_SSA_MAX_USES) {
+		*cap = DM_SSA_MAX_USES;
+		*uses = xrealloc(*uses, *cap * sizeof(int));
+	}
+	*def = -1;
+	switch (s->kind) {
+	case DM_DU_PHI:
+		phi = &s->node->phi_functions[s->i];
+		if (*cap < phi->arguments) {
+			*cap = phi->arguments;
+			*uses = xrealloc(*uses, *cap * sizeof(int));
+		}
+		for (i = 0; i < phi->arguments; i++)
+			(*uses)[i] = DM_DU_VALUE(du, phi->var, phi->indexes[i]);
+		*def = DM_DU_VALUE(du, phi->var, phi->index);
+		return (phi->arguments);
+	case DM_DU_INSN:
+		return (dm_du_insn(du, s->node->instructions[s->i], *uses,
+		    def));
+	}
+	return (0);
+}
+
+/*
+ * Find the value named like the SSA listing does, e.g. rax_7. Any name
+ * of the register will do, so eax_7 and al_7 are the same value.
+ */
+int
+dm_du_parse(struct dm_du *du, char *name, int *val)
+{
+	char			*under = strrchr(name, '_'), *end = NULL;
+	long			 ver = 0;
+	int			 r = 0, reg = 0;
+
+	if ((under == NULL) || (under[1] == '\0'))
+		return (DM_FAIL);
+
+	ver = strtol(under + 1, &end, 10);
+	if (*end != '\0')
+		return (DM_FAIL);
+
+	for (r = UD_R_AL; r <= UD_R_RIP; r++) {
+		if ((strlen(ud_reg_tab[r - UD_R_AL]) ==
+		    (size_t)(under - name)) &&
+		    (strncmp(ud_reg_tab[r - UD_R_AL], name, under - name) == 0))
+			break;
+	}
+	if (r > UD_R_RIP)
+		return (DM_FAIL);
+
+	reg = dm_ssa_reg(r);
+	if ((reg == DM_REG_NONE) || (ver < 0) || (ver > indices[reg].count))
+		return (DM_FAIL);
+
+	*val = DM_DU_VALUE(du, reg, ver);
+	return (DM_OK);
+}
+
+/*
+ * Which register a value is a version of
+ */
+int
+dm_du_reg(struct dm_du *du, int val)
+{
+	int			 lo = 0, hi = DM_REG_COUNT - 1, mid = 0;
+
+	/* The last base not above val */
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (du->base[mid] <= val)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return (lo);
+}
+
+void
+dm_du_name(struct dm_du *du, int val, char *buf, size_t len)
+{
+	int			 reg = dm_du_reg(du, val);
+
+	snprintf(buf, len, "%s_%d", dm_ssa_reg_name(reg),
+	    val - du->base[reg]);
+}
+
+/*
+ * Describe a site in one line of SSA assembler
+ */
+void
+dm_du_site_text(struct dm_du_site *s, char *buf, size_t len)
+{
+	struct instruction	 insn;
+	struct phi_function	*phi = NULL;
+	size_t			 off = 0;
+	int			 i = 0;
+
+	switch (s->kind) {
+	case DM_DU_ENTRY:
+		snprintf(buf, len, "function entry");
+		break;
+	case DM_DU_PHI:
+		phi = &s->node->phi_functions[s->i];
+		off = snprintf(buf, len, "Block %d: mov %s_%d, phi(",
+		    s->node->post, dm_ssa_reg_name(phi->var), phi->index);
+		for (i = 0; (i < phi->arguments) && (off < len); i++)
+			off += snprintf(buf + off, len - off, "%s%s_%d",
+			    i ? ", " : "", dm_ssa_reg_name(phi->var),
+			    phi->indexes[i]);
+		if (off < len)
+			snprintf(buf + off, len - off, ")");
+		break;
+	case DM_DU_INSN:
+		/* Translate a copy, the original's text may be printed */
+		insn = *s->node->instructions[s->i];
+		insn.ud.insn_buffer[0] = 0;
+		insn.ud.insn_fill = 0;
+		dm_translate_intel_ssa(&insn);
+		snprintf(buf, len, "Block %d: " NADDR_FMT ": %s",
+		    s->node->post, insn.ud.pc - ud_insn_len(&insn.ud),
+		    insn.ud.insn_buffer);
+		break;
+	}
+}
+
+void
+dm_du_print_site(struct dm_du_site *s)
+{
+	char			 buf[256];
+
+	dm_du_site_text(s, buf, sizeof(buf));
+	printf("\t%s\n", buf);
+}
+
+/*
+ * Build a graphviz graph of the values an SSA value is computed from,
+ * transitively, and the values computed from it, and display it. An edge
+ * a -> b means a is used to compute b.
+ */
+void
+dm_graph_duslice(struct dm_du *du, int val)
+{
+	FILE			*fp = dm_new_graph("duslice.dot");
+	struct dm_du_site	*s = NULL;
+	char			*seen = NULL, name1[32], name2[32], text[256];
+	char			*label = NULL;
+	int			*queue = NULL, *uses = NULL;
+	int			 head = 0, tail = 0, cap = 0, count = 0;
+	int			 dir = 0, v = 0, i = 0, def = 0;
+
+	if (!fp) return;
+
+	seen = xmalloc(du->n);
+	queue = xmalloc(du->n * sizeof(int));
+
+	/* Backwards along definitions, then forwards along uses */
+	for (dir = 0; dir < 2; dir++) {
+		memset(seen, 0, du->n);
+		head = tail = 0;
+		queue[tail++] = val;
+		seen[val] = 1;
+		while (head < tail) {
+			v = queue[head++];
+			dm_du_name(du, v, name1, sizeof(name1));
+			if (dir == 0) {
+				dm_du_site_text(&du->def[v], text,
+				    sizeof(text));
+				asprintf(&label, "%s\\n%s", name1, text);
+				dm_add_label(fp, name1, label);
+				free(label);
+
+				count = dm_du_site_uses(du, &du->def[v],
+				    &uses, &cap, &def);
+				for (i = 0; i < count; i++) {
+					dm_du_name(du, uses[i], name2,
+					    sizeof(name2));
+					dm_add_edge(fp, name2, name1);
+					if (!seen[uses[i]]) {
+						seen[uses[i]] = 1;
+						queue[tail++] = uses[i];
+					}
+				}
+				continue;
+			}
+			for (i = du->use_idx[v]; i < du->use_idx[v + 1]; i++) {
+				s = &du->use[i];
+				count = dm_du_site_uses(du, s, &uses, &cap,
+				    &def);
+				if (def == -1) {
+					/* A store, compare or branch */
+					dm_du_site_text(s, text, sizeof(text));
+					asprintf(&label, "%s:%d", name1, i);
+					dm_add_label(fp, label, text);
+					dm_add_edge(fp, name1, label);
+					free(label);
+					continue;
+				}
+				dm_du_name(du, def, name2, sizeof(name2));
+				dm_add_edge(fp, name1, name2);
+				if (seen[def])
+					continue;
+				seen[def] = 1;
+				queue[tail++] = def;
+				dm_du_site_text(s, text, sizeof(text));
+				asprintf(&label, "%s\\n%s", name2, text);
+				dm_add_label(fp, name2, label);
+				free(label);
+			}
+		}
+	}
+	free(uses);
+	free(queue);
+	free(seen);
+	dm_end_graph(fp);
+	dm_display_graph("duslice.dot");
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_DU_H
+#define __DM_DU_H
+
+#include "common.h"
+#include "dm_ssa.h"
+
+/* Where an SSA value is defined or used */
+#define DM_DU_ENTRY		0	/* Version 0, live in to the function */
+#define DM_DU_PHI		1
+#define DM_DU_INSN		2
+
+struct dm_du_site {
+	struct dm_cfg_node	*node;
+	int			 kind;	/* DM_DU_* */
+	int			 i;	/* Into phi_functions or instructions */
+};
+
+/*
+ * Def-use chains of the current SSA form. Each value (register and
+ * version) has a dense number, base[reg] + version. Its definition is
+ * def[value] and its uses are use[use_idx[value]] up to
+ * use[use_idx[value + 1]].
+ */
+struct dm_du {
+	int			 n;
+	int			 base[DM_REG_COUNT + 1];
+	struct dm_du_site	*def;
+	int			*use_idx;
+	struct dm_du_site	*use;
+};
+
+#define DM_DU_VALUE(du, reg, ver)	((du)->base[(reg)] + (ver))
+
+int		dm_cmd_uses(char **args);
+int		dm_cmd_def(char **args);
+int		dm_cmd_duslice(char **args);
+int		dm_du_open(struct dm_du *du, char *name, int *val);
+void		dm_du_build(struct dm_du *du);
+void		dm_du_free(struct dm_du *du);
+int		dm_du_insn(struct dm_du *du, struct instruction *insn,
+		    int *uses, int *def);
+int		dm_du_insn_clobbers(struct dm_du *du,
+		    struct instruction *insn, int *defs);
+int		dm_du_site_uses(struct dm_du *du, struct dm_du_site *s,
+		    int **uses, int *cap, int *def);
+int		dm_du_parse(struct dm_du *du, char *name, int *val);
+int		dm_du_reg(struct dm_du *du, int val);
+void		dm_du_name(struct dm_du *du, int val, char *buf, size_t len);
+void		dm_du_site_text(struct dm_du_site *s, char *buf, size_t len);
+void		dm_du_print_site(struct dm_du_site *s);
+void		dm_graph_duslice(struct dm_du *du, int val);
+
+#endif
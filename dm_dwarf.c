@@ -34,61 +34,215 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
+#include <string.h>
 
 #include <libdwarf.h>
 #include <dwarf.h>
 
 #include "tree.h"
 #include "dm_dwarf.h"
+#include "dm_dis.h"
+#include "dm_util.h"
 #include "common.h"
 
 extern FILE		*f;
 
-RB_HEAD(dm_dwarf_sym_cache_, dm_dwarf_sym_cache_entry)
-    dm_dwarf_sym_cache = RB_INITIALIZER(&dm_dwarf_sym_cache);
-RB_GENERATE(dm_dwarf_sym_cache_,
-    dm_dwarf_sym_cache_entry, entry, dm_dwarf_sym_rb_cmp);
+/*
+ * The symbol cache. Symbols live in one vector sorted by name, with a
+ * second array of indices into it sorted by offset. Names live in the
+ * dwarf_names arena. They are interned per batch only, so equal names
+ * from two batches may be different pointers. Pointers handed out by
+ * the lookup functions are only good until the next lookup, since
+ * loading a CU may move the vector.
+ */
+struct dm_dwarf_sym_cache_entry	*dwarf_syms = NULL;
+size_t				 dwarf_syms_count = 0;
+size_t				 dwarf_syms_size = 0;
+size_t				*dwarf_syms_by_off = NULL;
+size_t				 dwarf_syms_by_off_count = 0;
+size_t				*dwarf_syms_by_link = NULL;
+size_t				 dwarf_syms_by_link_count = 0;
+size_t				 dwarf_complete_next = 0;
+size_t				 dwarf_complete_end = 0;
+struct dm_arena			 dwarf_names = { NULL };
+
+/*
+ * Function extents, sorted by start offset. extents_max_end[i] is the
+ * greatest end of extents 0..i, which lets a containment query stop
+ * walking back as soon as nothing earlier can reach the address.
+ */
+struct dm_dwarf_extent		*dwarf_extents = NULL;
+size_t				 dwarf_extents_count = 0;
+ADDR64				*dwarf_extents_max_end = NULL;
+
+/*
+ * Code scopes: functions, inlined calls and lexical blocks. Sorted by
+ * start, outermost first, so each scope's enclosing scope comes before
+ * it and is recorded as its parent.
+ */
+struct dm_dwarf_scope		*dwarf_scopes = NULL;
+size_t				 dwarf_scopes_count = 0;
+struct dm_dwarf_scope		*dwarf_scope_shown = NULL;
+
+/*
+ * The line table, sorted by offset. Decoded the first time it is
+ * needed. An entry with line 0 marks the end of a sequence.
+ */
+struct dm_dwarf_line		*dwarf_lines = NULL;
+size_t				 dwarf_lines_count = 0;
+int				 dwarf_lines_loaded = 0;
+struct dm_dwarf_line		*dwarf_line_shown = NULL;
+
+/* source files we have read, for interleaving with disassembly */
+struct dm_dwarf_src		*dwarf_srcs = NULL;
+size_t				 dwarf_srcs_count = 0;
+
+/*
+ * Lazy mode. Rather than walking every DIE at startup, we keep the
+ * Dwarf_Debug open and only index which CU covers which addresses
+ * (.debug_aranges) and which CU defines which global names
+ * (.debug_pubnames). A CU's DIEs are loaded the first time something
+ * asks about an address or name inside it.
+ */
+int				 dm_dwarf_lazy = 0;
+Dwarf_Debug			 lazy_dbg = 0;
+int				 lazy_all_expanded = 0;
+struct dm_dwarf_cu_range	*cu_ranges = NULL;
+size_t				 cu_ranges_count = 0;
+struct dm_dwarf_cu_name		*cu_names = NULL;
+size_t				 cu_names_count = 0;
+
+RB_HEAD(dm_dwarf_cu_tree_, dm_dwarf_cu)
+    dm_dwarf_cu_tree = RB_INITIALIZER(&dm_dwarf_cu_tree);
+RB_GENERATE(dm_dwarf_cu_tree_, dm_dwarf_cu, entry, dm_dwarf_cu_rb_cmp);
 
 int
-dm_dwarf_sym_rb_cmp(struct dm_dwarf_sym_cache_entry *s1,
-    struct dm_dwarf_sym_cache_entry *s2)
+dm_dwarf_sym_name_cmp(const void *s1, const void *s2)
+{
+	const struct dm_dwarf_sym_cache_entry	*e1 = s1, *e2 = s2;
+	int					 ret;
+
+	if ((ret = strcmp(e1->name, e2->name)) != 0)
+		return (ret);
+
+	/* same name, lowest address first for determinism */
+	if (e1->vaddr < e2->vaddr)
+		return (-1);
+
+	return (e1->vaddr > e2->vaddr);
+}
+
+int
+dm_dwarf_sym_link_cmp(const void *i1, const void *i2)
+{
+	return (strcmp(dwarf_syms[*(const size_t *) i1].linkage,
+	    dwarf_syms[*(const size_t *) i2].linkage));
+}
+
+int
+dm_dwarf_sym_off_cmp(const void *i1, const void *i2)
+{
+	ADDR64		o1 = dwarf_syms[*(const size_t *) i1].offset;
+	ADDR64		o2 = dwarf_syms[*(const size_t *) i2].offset;
+
+	if (o1 < o2)
+		return (-1);
+
+	return (o1 > o2);
+}
+
+void
+dm_dwarf_print_sym(struct dm_dwarf_sym_cache_entry *sym, size_t n)
 {
-	return (strcmp(s1->name, s2->name));
+	/* reprint headers evert 20 lines */
+	if (n % 20 == 0) {
+		printf("%s\n", DM_RULE);
+		printf("%-32s | %-10s | %-10s | %-6s\n",
+		    "Function", "Virtual", "Offset", "Size");
+		printf("%s\n", DM_RULE);
+	}
+
+	if (!sym->offset_err)
+		printf("%-32s | " ADDR_FMT_64 " | " ADDR_FMT_64
+		    " | %6lu\n", sym->name, sym->vaddr, sym->offset,
+		    (unsigned long) (sym->offset_end ?
+		    sym->offset_end - sym->offset : 0));
+	else
+		printf("%-32s | " ADDR_FMT_64 " | %-10s | %6s\n",
+		    sym->name, sym->vaddr, "???", "???");
 }
 
 int
 dm_cmd_dwarf_funcs(char **args)
 {
 
-	struct dm_dwarf_sym_cache_entry		*sym;
-	int					n = 0;
+	size_t					n;
 
 	(void) args;
 
+	/* we're about to show everything, so we need everything */
+	if (lazy_dbg)
+		dm_dwarf_expand_all();
+
 	printf("\n");
-	RB_FOREACH(sym, dm_dwarf_sym_cache_, &dm_dwarf_sym_cache) {
+	for (n = 0; n < dwarf_syms_count; n++)
+		dm_dwarf_print_sym(&dwarf_syms[n], n);
 
-		/* reprint headers evert 20 lines */
-		if (n % 20 == 0) {
-			printf("%s\n", DM_RULE);
-			printf("%-40s | %-10s | %-10s\n", "Function", "Virtual", "Offset");
-			printf("%s\n", DM_RULE);
-		}
+	printf("%s\n\n", DM_RULE);
+	return (DM_OK);
+}
 
-		if (!sym->offset_err)
-			printf("%-40s | " ADDR_FMT_64 " | " ADDR_FMT_64 "\n",
-			    sym->name, sym->vaddr, sym->offset);
-		else
-			printf("%-40s | " ADDR_FMT_64 " | %s\n",
-			    sym->name, sym->vaddr, "???");
-		n++;
+/*
+ * show functions matching a pattern. "pat*" matches names (or linkage
+ * names) starting with "pat", anything else matches names containing it.
+ */
+int
+dm_cmd_dwarf_funcs_pattern(char **args)
+{
+	char					*pat = args[0];
+	size_t					 len = strlen(pat), i, first;
+	size_t					 count, shown = 0;
+	struct dm_dwarf_sym_cache_entry		*sym;
+
+	if (lazy_dbg)
+		dm_dwarf_expand_all();
+
+	printf("\n");
+	if ((len > 0) && (pat[len - 1] == '*')) {
+		pat = xstrdup(pat);
+		pat[len - 1] = 0;
+
+		count = dm_dwarf_prefix_range(pat, &first);
+		for (i = first; i < first + count; i++)
+			dm_dwarf_print_sym(&dwarf_syms[i], shown++);
+
+		/* linkage names which matched, but whose name did not */
+		count = dm_dwarf_link_prefix_range(pat, &first);
+		for (i = first; i < first + count; i++) {
+			sym = &dwarf_syms[dwarf_syms_by_link[i]];
+			if (strncmp(sym->name, pat, len - 1) != 0)
+				dm_dwarf_print_sym(sym, shown++);
+		}
+		free(pat);
+	} else {
+		for (i = 0; i < dwarf_syms_count; i++) {
+			sym = &dwarf_syms[i];
+			if ((strstr(sym->name, pat) != NULL) ||
+			    ((sym->linkage) && (strstr(sym->linkage, pat))))
+				dm_dwarf_print_sym(sym, shown++);
+		}
 	}
 
-	printf("%s\n\n", DM_RULE);
+	if (shown)
+		printf("%s\n", DM_RULE);
+	printf("%lu matches\n\n", (unsigned long) shown);
+
 	return (DM_OK);
 }
 
@@ -109,6 +263,15 @@ dm_parse_dwarf()
 
 	file_info.dwarf = 1;
 
+	if (dm_dwarf_lazy) {
+		if (dm_dwarf_lazy_init(dbg) == DM_OK) {
+			/* keep dbg open, we load CUs as we need them */
+			lazy_dbg = dbg;
+			return (DM_OK);
+		}
+		DPRINTF(DM_D_INFO, "Can't load DWARF lazily, loading it all");
+	}
+
 	if (dm_dwarf_recurse_cu(dbg) != DM_OK)
 		goto error;
 
@@ -122,8 +285,104 @@ error:
 	return (ret);
 }
 
+/*
+ * load every CU, not counting those already loaded in lazy mode
+ */
 int
 dm_dwarf_recurse_cu(Dwarf_Debug dbg)
+{
+	struct dm_dwarf_job		 job;
+	size_t				 old_count = dwarf_syms_count;
+	size_t				 old_extents = dwarf_extents_count;
+	size_t				 old_scopes = dwarf_scopes_count;
+	size_t				 old_lines = dwarf_lines_count;
+	int				 ret = DM_FAIL;
+
+	memset(&job, 0, sizeof(job));
+	/* in lazy mode a CU's line table comes in with it */
+	job.cu_fn = (dbg == lazy_dbg) ? dm_dwarf_load_cu :
+	    dm_dwarf_recurse_die;
+
+	if (dm_dwarf_list_cus(dbg, &job, dm_dwarf_lazy) != DM_OK)
+		goto clean;
+
+	dm_dwarf_run_job(dbg, &job);
+	dm_dwarf_sort_syms(old_count);
+	dm_dwarf_sort_extents(old_extents);
+	dm_dwarf_sort_scopes(old_scopes);
+	dm_dwarf_sort_lines(old_lines);
+
+	ret = DM_OK;
+clean:
+	free(job.cus);
+
+	return (ret);
+}
+
+/*
+ * run job->cu_fn over each CU in the job. CUs are independent of each
+ * other, so if we have more than one core we farm them out to worker
+ * threads. the results are merged into the global tables.
+ */
+int
+dm_dwarf_run_job(Dwarf_Debug dbg, struct dm_dwarf_job *job)
+{
+	struct dm_dwarf_worker		*workers = NULL;
+	struct dm_dwarf_batch		 batch;
+	Dwarf_Die			 cu_die;
+	Dwarf_Error			 error;
+	int				 nthreads, i;
+
+	nthreads = dm_nthreads();
+	if ((size_t) nthreads > job->count)
+		nthreads = job->count;
+
+	if (nthreads > 1) {
+		DPRINTF(DM_D_INFO, "Parsing %lu CUs with %d threads",
+		    (unsigned long) job->count, nthreads);
+
+		workers = xcalloc(nthreads, sizeof(struct dm_dwarf_worker));
+		for (i = 0; i < nthreads; i++) {
+			workers[i].job = job;
+			dm_dwarf_batch_init(&workers[i].batch);
+			if (pthread_create(&workers[i].tid, NULL,
+			    dm_dwarf_worker, &workers[i]) != 0) {
+				DPRINTF(DM_D_WARN, "Can't start thread");
+				break;
+			}
+			workers[i].started = 1;
+		}
+
+		for (i = 0; i < nthreads; i++) {
+			if (workers[i].started)
+				pthread_join(workers[i].tid, NULL);
+			dm_dwarf_merge_batch(&workers[i].batch);
+		}
+		free(workers);
+	}
+
+	/* whatever the workers didn't get to (if any), we do here */
+	dm_dwarf_batch_init(&batch);
+	for (; job->next < job->count; job->next++) {
+		if (dwarf_offdie(dbg, job->cus[job->next],
+		    &cu_die, &error) != DW_DLV_OK) {
+			DPRINTF(DM_D_DEBUG, "dwarf_offdie");
+			continue;
+		}
+		job->cu_fn(dbg, cu_die, &batch);
+		dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+	}
+	dm_dwarf_merge_batch(&batch);
+
+	return (DM_OK);
+}
+
+/*
+ * walk the CU headers, collecting the offsets of the CU DIEs. if
+ * skip_loaded is set, CUs already loaded by lazy mode are left out.
+ */
+int
+dm_dwarf_list_cus(Dwarf_Debug dbg, struct dm_dwarf_job *job, int skip_loaded)
 {
 	Dwarf_Unsigned		cu_header_length = 0;
 	Dwarf_Half		version_stamp = 0;
@@ -131,11 +390,13 @@ dm_dwarf_recurse_cu(Dwarf_Debug dbg)
 	Dwarf_Half		address_size = 0;
 	Dwarf_Unsigned		next_cu_header = 0;
 	Dwarf_Error		error;
-	int			cu_number = 0, res;
+	int			res;
 	Dwarf_Die		no_die = 0;
 	Dwarf_Die		cu_die = 0;
+	Dwarf_Off		cu_die_off;
+	size_t			size = 0;
 
-	for(;;++cu_number) {
+	for (;;) {
 		no_die = cu_die = 0;
 		res = DW_DLV_ERROR;
 
@@ -163,72 +424,429 @@ dm_dwarf_recurse_cu(Dwarf_Debug dbg)
 			return (DM_FAIL);
 		}
 
-		dm_dwarf_recurse_die(dbg, cu_die);
+		res = dwarf_dieoffset(cu_die, &cu_die_off, &error);
 		dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+		if (res != DW_DLV_OK) {
+			DPRINTF(DM_D_DEBUG, "dwarf_dieoffset");
+			continue;
+		}
+
+		/* in lazy mode, skip CUs we already loaded */
+		if ((skip_loaded) && (!dm_dwarf_mark_cu(cu_die_off)))
+			continue;
+
+		if (job->count == size) {
+			size = size ? size * 2 : 64;
+			job->cus = xrealloc(job->cus, size * sizeof(Dwarf_Off));
+		}
+		job->cus[job->count++] = cu_die_off;
 	}
 }
 
-int
-dm_dwarf_recurse_die(Dwarf_Debug dbg, Dwarf_Die in_die)
+/*
+ * a worker thread. libdwarf handles are not safe to share, so each
+ * worker opens the file and gets a Dwarf_Debug of its own, then takes
+ * CUs off the job until there are none left.
+ */
+void *
+dm_dwarf_worker(void *arg)
 {
-	int			res = DW_DLV_ERROR;
-	Dwarf_Die		cur_die = in_die, child = 0, sib_die = 0;
-	Dwarf_Error		error;
+	struct dm_dwarf_worker		*w = arg;
+	struct dm_dwarf_job		*job = w->job;
+	Dwarf_Debug			 dbg = 0;
+	Dwarf_Error			 error;
+	Dwarf_Die			 cu_die;
+	size_t				 i;
+	int				 fd;
 
-	dm_dwarf_inspect_die(dbg, in_die);
+	if ((fd = open(file_info.name, O_RDONLY)) == -1) {
+		DPRINTF(DM_D_WARN, "open: %s", strerror(errno));
+		return (NULL);
+	}
 
-	for (;;) {
-		sib_die = 0;
+	if (dwarf_init(fd, DW_DLC_READ, 0, 0, &dbg, &error) != DW_DLV_OK) {
+		DPRINTF(DM_D_WARN, "dwarf_init failed in worker");
+		close(fd);
+		return (NULL);
+	}
 
-		res = dwarf_child(cur_die,&child,&error);
-		if (res == DW_DLV_ERROR) {
-			DPRINTF(DM_D_DEBUG, "dwarf_child");
-			return (DM_FAIL);
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count) {
+		if (dwarf_offdie(dbg, job->cus[i], &cu_die, &error) !=
+		    DW_DLV_OK) {
+			DPRINTF(DM_D_DEBUG, "dwarf_offdie");
+			continue;
 		}
+		job->cu_fn(dbg, cu_die, &w->batch);
+		dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+	}
 
-		if (res == DW_DLV_OK)
-			dm_dwarf_recurse_die(dbg, child);
+	dwarf_finish(dbg, &error);
+	close(fd);
+
+	return (NULL);
+}
+
+void
+dm_dwarf_batch_init(struct dm_dwarf_batch *b)
+{
+	memset(b, 0, sizeof(*b));
+	dm_intern_init(&b->names, &b->arena);
+}
+
+struct dm_dwarf_sym_cache_entry *
+dm_dwarf_batch_add(struct dm_dwarf_batch *b)
+{
+	if (b->count == b->size) {
+		b->size = b->size ? b->size * 2 : 64;
+		b->syms = xrealloc(b->syms,
+		    b->size * sizeof(struct dm_dwarf_sym_cache_entry));
+	}
+
+	return (&b->syms[b->count++]);
+}
+
+struct dm_dwarf_extent *
+dm_dwarf_batch_add_extent(struct dm_dwarf_batch *b)
+{
+	if (b->extents_count == b->extents_size) {
+		b->extents_size = b->extents_size ? b->extents_size * 2 : 64;
+		b->extents = xrealloc(b->extents,
+		    b->extents_size * sizeof(struct dm_dwarf_extent));
+	}
+
+	return (&b->extents[b->extents_count++]);
+}
+
+struct dm_dwarf_scope *
+dm_dwarf_batch_add_scope(struct dm_dwarf_batch *b)
+{
+	if (b->scopes_count == b->scopes_size) {
+		b->scopes_size = b->scopes_size ? b->scopes_size * 2 : 64;
+		b->scopes = xrealloc(b->scopes,
+		    b->scopes_size * sizeof(struct dm_dwarf_scope));
+	}
+
+	return (&b->scopes[b->scopes_count++]);
+}
+
+void
+dm_dwarf_add_scope(struct dm_dwarf_batch *b, ADDR64 start, ADDR64 end,
+    char *name, int tag, char *call_file, uint32_t call_line)
+{
+	struct dm_dwarf_scope		*sc;
+
+	sc = dm_dwarf_batch_add_scope(b);
+	sc->start = start;
+	sc->end = end;
+	sc->name = name;
+	sc->tag = tag;
+	sc->call_file = call_file;
+	sc->call_line = call_line;
+	sc->parent = -1;
+}
+
+/*
+ * remember the current CU's file table, which DW_AT_call_file indexes
+ */
+void
+dm_dwarf_batch_cu_files(Dwarf_Debug dbg, Dwarf_Die cu_die,
+    struct dm_dwarf_batch *b)
+{
+	char				**files;
+	Dwarf_Signed			  count, i;
+	Dwarf_Error			  error;
+
+	b->cu_nfiles = 0;
+	if (dwarf_srcfiles(cu_die, &files, &count, &error) != DW_DLV_OK)
+		return;
+
+	b->cu_files = xrealloc(b->cu_files, (count ? count : 1) *
+	    sizeof(char *));
+	for (i = 0; i < count; i++) {
+		b->cu_files[i] = dm_intern(&b->names, files[i]);
+		dwarf_dealloc(dbg, files[i], DW_DLA_STRING);
+	}
+	dwarf_dealloc(dbg, files, DW_DLA_LIST);
+	b->cu_nfiles = count;
+}
+
+struct dm_dwarf_line *
+dm_dwarf_batch_add_line(struct dm_dwarf_batch *b)
+{
+	if (b->lines_count == b->lines_size) {
+		b->lines_size = b->lines_size ? b->lines_size * 2 : 256;
+		b->lines = xrealloc(b->lines,
+		    b->lines_size * sizeof(struct dm_dwarf_line));
+	}
+
+	return (&b->lines[b->lines_count++]);
+}
+
+/*
+ * move a batch of symbols and lines onto the end of the global vectors.
+ * only the main thread may call this. the caller must sort the vectors
+ * once all batches are in.
+ */
+void
+dm_dwarf_merge_batch(struct dm_dwarf_batch *b)
+{
+	if (dwarf_syms_count + b->count > dwarf_syms_size) {
+		dwarf_syms_size = dwarf_syms_count + b->count;
+		dwarf_syms = xrealloc(dwarf_syms, dwarf_syms_size *
+		    sizeof(struct dm_dwarf_sym_cache_entry));
+	}
+
+	memcpy(&dwarf_syms[dwarf_syms_count], b->syms,
+	    b->count * sizeof(struct dm_dwarf_sym_cache_entry));
+	dwarf_syms_count += b->count;
+
+	if (b->extents_count) {
+		dwarf_extents = xrealloc(dwarf_extents, (dwarf_extents_count +
+		    b->extents_count) * sizeof(struct dm_dwarf_extent));
+		memcpy(&dwarf_extents[dwarf_extents_count], b->extents,
+		    b->extents_count * sizeof(struct dm_dwarf_extent));
+		dwarf_extents_count += b->extents_count;
+	}
+
+	if (b->scopes_count) {
+		dwarf_scopes = xrealloc(dwarf_scopes, (dwarf_scopes_count +
+		    b->scopes_count) * sizeof(struct dm_dwarf_scope));
+		memcpy(&dwarf_scopes[dwarf_scopes_count], b->scopes,
+		    b->scopes_count * sizeof(struct dm_dwarf_scope));
+		dwarf_scopes_count += b->scopes_count;
+	}
+
+	if (b->lines_count) {
+		dwarf_lines = xrealloc(dwarf_lines, (dwarf_lines_count +
+		    b->lines_count) * sizeof(struct dm_dwarf_line));
+		memcpy(&dwarf_lines[dwarf_lines_count], b->lines,
+		    b->lines_count * sizeof(struct dm_dwarf_line));
+		dwarf_lines_count += b->lines_count;
+	}
+
+	/* the names have to outlive the batch */
+	dm_arena_move(&dwarf_names, &b->arena);
+	dm_intern_free(&b->names);
+
+	free(b->syms);
+	free(b->extents);
+	free(b->scopes);
+	free(b->cu_files);
+	free(b->lines);
+	b->syms = NULL;
+	b->extents = NULL;
+	b->scopes = NULL;
+	b->cu_files = NULL;
+	b->scopes_count = b->scopes_size = b->cu_nfiles = 0;
+	b->lines = NULL;
+	b->count = b->size = 0;
+	b->extents_count = b->extents_size = 0;
+	b->lines_count = b->lines_size = 0;
+}
+
+/*
+ * base[0 .. old_count) is sorted and base[old_count .. count) is new. sort
+ * just the new entries and merge them in from the back, so the cost of a
+ * load is linear in what's already there rather than a full sort.
+ */
+void
+dm_dwarf_merge_sorted(void *base, size_t old_count, size_t count,
+    size_t size, int (*cmp)(const void *, const void *))
+{
+	uint8_t				*b = base, *tail;
+	size_t				 i = old_count, j = count - old_count;
+	size_t				 k = count;
+
+	if (count == old_count)
+		return;
+
+	qsort(b + old_count * size, count - old_count, size, cmp);
+	if (old_count == 0)
+		return;
+
+	tail = xmalloc((count - old_count) * size);
+	memcpy(tail, b + old_count * size, (count - old_count) * size);
+	while (j > 0) {
+		k--;
+		if ((i > 0) && (cmp(b + (i - 1) * size,
+		    tail + (j - 1) * size) > 0)) {
+			memcpy(b + k * size, b + (i - 1) * size, size);
+			i--;
+		} else {
+			memcpy(b + k * size, tail + (j - 1) * size, size);
+			j--;
+		}
+	}
+	free(tail);
+}
+
+/*
+ * symbols from old_count onwards are new and unsorted. sort them, merge
+ * them with the already sorted ones (dropping duplicate names) and merge
+ * the new ones into the offset and linkage indices. old symbols move
+ * when new ones are merged in between, so the indices are renumbered.
+ */
+void
+dm_dwarf_sort_syms(size_t old_count)
+{
+	struct dm_dwarf_sym_cache_entry		*merged;
+	size_t					*renum, *added;
+	size_t					 i, j, n, k, added_count = 0;
+	size_t					 old_off, old_link;
+
+	qsort(&dwarf_syms[old_count], dwarf_syms_count - old_count,
+	    sizeof(struct dm_dwarf_sym_cache_entry), dm_dwarf_sym_name_cmp);
+
+	merged = xcalloc(dwarf_syms_count ? dwarf_syms_count : 1,
+	    sizeof(struct dm_dwarf_sym_cache_entry));
+	renum = xcalloc(old_count ? old_count : 1, sizeof(size_t));
+	added = xcalloc(dwarf_syms_count ? dwarf_syms_count : 1,
+	    sizeof(size_t));
+
+	i = 0;
+	j = old_count;
+	n = 0;
+	while ((i < old_count) || (j < dwarf_syms_count)) {
+		if ((j == dwarf_syms_count) || ((i < old_count) &&
+		    (dm_dwarf_sym_name_cmp(&dwarf_syms[i],
+		    &dwarf_syms[j]) <= 0)))
+			k = i++;
+		else
+			k = j++;
+
+		/* one symbol per name, as before */
+		if ((n > 0) && (strcmp(merged[n - 1].name,
+		    dwarf_syms[k].name) == 0)) {
+			if (k < old_count)
+				renum[k] = SIZE_MAX;
+			continue;
+		}
+
+		if (k < old_count)
+			renum[k] = n;
+		else
+			added[added_count++] = n;
+		merged[n++] = dwarf_syms[k];
+	}
+
+	free(dwarf_syms);
+	dwarf_syms = merged;
+	dwarf_syms_count = n;
+	dwarf_syms_size = dwarf_syms_count ? dwarf_syms_count : 1;
+
+	/* renumber the old entries, which keeps them in order */
+	old_off = 0;
+	for (i = 0; i < dwarf_syms_by_off_count; i++)
+		if (renum[dwarf_syms_by_off[i]] != SIZE_MAX)
+			dwarf_syms_by_off[old_off++] =
+			    renum[dwarf_syms_by_off[i]];
+	old_link = 0;
+	for (i = 0; i < dwarf_syms_by_link_count; i++)
+		if (renum[dwarf_syms_by_link[i]] != SIZE_MAX)
+			dwarf_syms_by_link[old_link++] =
+			    renum[dwarf_syms_by_link[i]];
+
+	dwarf_syms_by_off = xrealloc(dwarf_syms_by_off,
+	    dwarf_syms_size * sizeof(size_t));
+	dwarf_syms_by_off_count = old_off;
+	dwarf_syms_by_link = xrealloc(dwarf_syms_by_link,
+	    dwarf_syms_size * sizeof(size_t));
+	dwarf_syms_by_link_count = old_link;
+
+	for (i = 0; i < added_count; i++) {
+		if (!dwarf_syms[added[i]].offset_err)
+			dwarf_syms_by_off[dwarf_syms_by_off_count++] =
+			    added[i];
+		if (dwarf_syms[added[i]].linkage)
+			dwarf_syms_by_link[dwarf_syms_by_link_count++] =
+			    added[i];
+	}
+
+	dm_dwarf_merge_sorted(dwarf_syms_by_off, old_off,
+	    dwarf_syms_by_off_count, sizeof(size_t), dm_dwarf_sym_off_cmp);
+	dm_dwarf_merge_sorted(dwarf_syms_by_link, old_link,
+	    dwarf_syms_by_link_count, sizeof(size_t), dm_dwarf_sym_link_cmp);
+
+	free(renum);
+	free(added);
+}
+
+/*
+ * visit every DIE below (and including) in_die. we keep our own stack
+ * rather than recursing, as DIE trees can be deep.
+ */
+int
+dm_dwarf_recurse_die(Dwarf_Debug dbg, Dwarf_Die in_die,
+    struct dm_dwarf_batch *b)
+{
+	int			 res, ret = DM_OK;
+	Dwarf_Die		 cur_die, child, sib_die;
+	Dwarf_Die		*stack = NULL;
+	size_t			 depth = 0, size = 0;
+	Dwarf_Error		 error;
+
+	dm_dwarf_inspect_die(dbg, in_die, b);
+
+	res = dwarf_child(in_die, &child, &error);
+	if (res == DW_DLV_ERROR) {
+		DPRINTF(DM_D_DEBUG, "dwarf_child");
+		return (DM_FAIL);
+	}
+	if (res == DW_DLV_NO_ENTRY)
+		return (DM_OK);
+
+	size = 64;
+	stack = xmalloc(size * sizeof(Dwarf_Die));
+	stack[depth++] = child;
+
+	while (depth > 0) {
+		cur_die = stack[--depth];
+		dm_dwarf_inspect_die(dbg, cur_die, b);
+
+		/* need room for a sibling and a child */
+		if (depth + 2 > size) {
+			size *= 2;
+			stack = xrealloc(stack, size * sizeof(Dwarf_Die));
+		}
 
 		res = dwarf_siblingof(dbg, cur_die, &sib_die, &error);
-		if (res == DW_DLV_ERROR) {
+		if (res == DW_DLV_OK)
+			stack[depth++] = sib_die;
+		else if (res == DW_DLV_ERROR) {
 			DPRINTF(DM_D_DEBUG, "siblingof");
-			return (DM_FAIL);
+			ret = DM_FAIL;
 		}
 
-		if (res == DW_DLV_NO_ENTRY)
-			break;	/* Done at this level. */
-
-		if (cur_die != in_die)
-			dwarf_dealloc(dbg, cur_die, DW_DLA_DIE);
+		res = dwarf_child(cur_die, &child, &error);
+		if (res == DW_DLV_OK)
+			stack[depth++] = child;
+		else if (res == DW_DLV_ERROR) {
+			DPRINTF(DM_D_DEBUG, "dwarf_child");
+			ret = DM_FAIL;
+		}
 
-		cur_die = sib_die;
-		dm_dwarf_inspect_die(dbg, cur_die);
+		dwarf_dealloc(dbg, cur_die, DW_DLA_DIE);
 	}
 
-	return (DM_OK);
+	free(stack);
+	return (ret);
 }
 
 int
-dm_dwarf_inspect_die(Dwarf_Debug dbg, Dwarf_Die print_me)
+dm_dwarf_inspect_die(Dwarf_Debug dbg, Dwarf_Die print_me,
+    struct dm_dwarf_batch *b)
 {
 	char				*name = 0;
 	Dwarf_Error			 error = 0;
 	Dwarf_Half			 tag = 0;
-	const char			*tagname = 0;
 	int				 res;
 	Dwarf_Addr			 lo;
-	ADDR64				 offset;
-	int				 offset_err = 0, ret = DM_FAIL;
+	ADDR64				 offset = 0, start = 0;
+	int				 offset_err = 0;
+	size_t				 i, nranges = 0;
 	struct dm_dwarf_sym_cache_entry	*sym_rec;
-
-	res = dwarf_diename(print_me, &name, &error);
-	if (res == DW_DLV_ERROR) {
-		DPRINTF(DM_D_DEBUG, "diename");
-		goto clean;
-	}
-
-	if (res == DW_DLV_NO_ENTRY)
-		goto clean;
+	struct dm_dwarf_extent		*ext;
+	struct dm_dwarf_vrange		*ranges = NULL;
 
 	res = dwarf_tag(print_me, &tag, &error);
 	if (res != DW_DLV_OK) {
@@ -236,91 +854,1330 @@ dm_dwarf_inspect_die(Dwarf_Debug dbg, Dwarf_Die print_me)
 		goto clean;
 	}
 
-	if (tag != DW_TAG_subprogram) {
-		ret = DM_OK;
-		goto clean; /* we only extract funcs for now */
+	/* range lists are relative to the CU base address */
+	if (tag == DW_TAG_compile_unit) {
+		if (dwarf_lowpc(print_me, &lo, &error) != DW_DLV_OK)
+			lo = 0;
+		b->cu_base = lo;
+		dm_dwarf_batch_cu_files(dbg, print_me, b);
+		goto clean;
 	}
 
-	/* get virtual addr */
-	res = dwarf_lowpc(print_me, &lo, &error);
-	if (res != DW_DLV_OK) {
-		DPRINTF(DM_D_DEBUG, "lopc");
-		if (res == DW_DLV_NO_ENTRY)
-			DPRINTF(DM_D_DEBUG, "no_entry");
+	if ((tag == DW_TAG_inlined_subroutine) ||
+	    (tag == DW_TAG_lexical_block)) {
+		dm_dwarf_inspect_scope(dbg, print_me, tag, b);
 		goto clean;
 	}
 
-	/* get the function name */
-	res = dwarf_get_TAG_name(tag, &tagname);
-	if (res != DW_DLV_OK) {
-		DPRINTF(DM_D_DEBUG, "TAG_name");
+	if (tag != DW_TAG_subprogram)
+		goto clean; /* we only extract funcs and scopes for now */
+
+	res = dwarf_diename(print_me, &name, &error);
+	if (res == DW_DLV_ERROR) {
+		DPRINTF(DM_D_DEBUG, "diename");
 		goto clean;
 	}
 
+	if (res == DW_DLV_NO_ENTRY)
+		goto clean;
+
+	/* no code, eg. a declaration */
+	if (dm_dwarf_die_ranges(dbg, print_me, b->cu_base,
+	    &ranges, &nranges) != DM_OK)
+		goto clean;
+
+	/* get virtual addr */
+	if (dwarf_lowpc(print_me, &lo, &error) != DW_DLV_OK)
+		lo = ranges[0].lo;
+
 	offset_err = 0;
 	if ((dm_offset_from_vaddr(lo, &offset)) != DM_OK)
 		offset_err = 1;
 
-	sym_rec = calloc(1, sizeof(struct dm_dwarf_sym_cache_entry));
-	sym_rec->name = strdup(name);
+	sym_rec = dm_dwarf_batch_add(b);
+	sym_rec->name = dm_intern(&b->names, name);
 	sym_rec->vaddr = lo;
 	sym_rec->offset = offset;
+	sym_rec->offset_end = 0;
+	sym_rec->linkage = dm_dwarf_linkage_name(dbg, print_me, b);
 	sym_rec->sym_type = DW_TAG_subprogram;
 	sym_rec->offset_err = offset_err;
-	RB_INSERT(dm_dwarf_sym_cache_, &dm_dwarf_sym_cache, sym_rec);
+
+	for (i = 0; i < nranges; i++) {
+		if (dm_offset_from_vaddr(ranges[i].lo, &start) != DM_OK)
+			continue;
+
+		dm_dwarf_add_scope(b, start,
+		    start + (ranges[i].hi - ranges[i].lo), sym_rec->name,
+		    DW_TAG_subprogram, NULL, 0);
+
+		/* without an entry offset there is nothing to be relative to */
+		if (offset_err)
+			continue;
+
+		ext = dm_dwarf_batch_add_extent(b);
+		ext->start = start;
+		ext->end = start + (ranges[i].hi - ranges[i].lo);
+		ext->entry = sym_rec->offset;
+		ext->name = sym_rec->name;
+
+		/* the range holding the entry point is the function's size */
+		if ((lo >= ranges[i].lo) && (lo < ranges[i].hi))
+			sym_rec->offset_end = sym_rec->offset +
+			    (ranges[i].hi - lo);
+	}
 
 clean:
+	free(ranges);
 	if (name)
 		dwarf_dealloc(dbg,name,DW_DLA_STRING);
 
 	return (DM_OK);
 }
 
+/*
+ * get the address ranges covered by a DIE, either from low_pc/high_pc or
+ * from a DW_AT_ranges list. the ranges are virtual addresses and must be
+ * freed by the caller.
+ */
+int
+dm_dwarf_die_ranges(Dwarf_Debug dbg, Dwarf_Die die, ADDR64 cu_base,
+    struct dm_dwarf_vrange **out, size_t *count)
+{
+	Dwarf_Addr			 lo, hi;
+	Dwarf_Half			 form;
+	enum Dwarf_Form_Class		 class;
+	Dwarf_Attribute			 attr;
+	Dwarf_Off			 roff;
+	Dwarf_Unsigned			 udata, bytes;
+	Dwarf_Ranges			*ranges;
+	Dwarf_Signed			 nranges, i;
+	Dwarf_Error			 error;
+	ADDR64				 base = cu_base;
+	size_t				 n = 0;
+	int				 res;
+
+	*out = NULL;
+	*count = 0;
+
+	if ((dwarf_lowpc(die, &lo, &error) == DW_DLV_OK) &&
+	    (dwarf_highpc_b(die, &hi, &form, &class, &error) == DW_DLV_OK)) {
+		/* since DWARF 4, high_pc may be a length */
+		if (class == DW_FORM_CLASS_CONSTANT)
+			hi += lo;
+
+		if (hi <= lo)
+			return (DM_FAIL);
+
+		*out = xmalloc(sizeof(struct dm_dwarf_vrange));
+		(*out)->lo = lo;
+		(*out)->hi = hi;
+		*count = 1;
+		return (DM_OK);
+	}
+
+	if (dwarf_attr(die, DW_AT_ranges, &attr, &error) != DW_DLV_OK)
+		return (DM_FAIL);
+
+	res = dwarf_global_formref(attr, &roff, &error);
+	if (res != DW_DLV_OK) {
+		res = dwarf_formudata(attr, &udata, &error);
+		roff = udata;
+	}
+	dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+
+	if ((res != DW_DLV_OK) || (dwarf_get_ranges(dbg, roff, &ranges,
+	    &nranges, &bytes, &error) != DW_DLV_OK))
+		return (DM_FAIL);
+
+	*out = xcalloc(nranges ? nranges : 1, sizeof(struct dm_dwarf_vrange));
+	for (i = 0; i < nranges; i++) {
+		switch (ranges[i].dwr_type) {
+		case DW_RANGES_ENTRY:
+			if (ranges[i].dwr_addr2 <= ranges[i].dwr_addr1)
+				break;
+			(*out)[n].lo = base + ranges[i].dwr_addr1;
+			(*out)[n].hi = base + ranges[i].dwr_addr2;
+			n++;
+			break;
+		case DW_RANGES_ADDRESS_SELECTION:
+			base = ranges[i].dwr_addr2;
+			break;
+		case DW_RANGES_END:
+		default:
+			i = nranges;
+			break;
+		}
+	}
+	dwarf_ranges_dealloc(dbg, ranges, nranges);
+
+	if (n == 0) {
+		free(*out);
+		*out = NULL;
+		return (DM_FAIL);
+	}
+
+	*count = n;
+	return (DM_OK);
+}
+
 int
 dm_clean_dwarf()
 {
-	struct dm_dwarf_sym_cache_entry		*var, *nxt;
+	struct dm_dwarf_cu			*cu, *cu_nxt;
+	Dwarf_Error				 error;
+	size_t					 i;
+
+	if (lazy_dbg) {
+		dwarf_finish(lazy_dbg, &error);
+		lazy_dbg = 0;
+	}
 
-	for (var = RB_MIN(dm_dwarf_sym_cache_,
-		    &dm_dwarf_sym_cache); var != NULL; var = nxt) {
-		nxt = RB_NEXT(dm_dwarf_sym_cache_, &dm_dwarf_sym_cache, var);
-		RB_REMOVE(dm_dwarf_sym_cache_, &dm_dwarf_sym_cache, var);
-		free(var->name);
-		free(var);
+	for (cu = RB_MIN(dm_dwarf_cu_tree_, &dm_dwarf_cu_tree);
+	    cu != NULL; cu = cu_nxt) {
+		cu_nxt = RB_NEXT(dm_dwarf_cu_tree_, &dm_dwarf_cu_tree, cu);
+		RB_REMOVE(dm_dwarf_cu_tree_, &dm_dwarf_cu_tree, cu);
+		free(cu);
 	}
 
+	for (i = 0; i < cu_names_count; i++)
+		free(cu_names[i].name);
+	free(cu_names);
+	free(cu_ranges);
+	cu_names = NULL;
+	cu_ranges = NULL;
+	cu_names_count = cu_ranges_count = 0;
+
+	free(dwarf_extents);
+	free(dwarf_extents_max_end);
+	dwarf_extents = NULL;
+	dwarf_extents_max_end = NULL;
+	dwarf_extents_count = 0;
+
+	free(dwarf_scopes);
+	dwarf_scopes = NULL;
+	dwarf_scopes_count = 0;
+	dwarf_scope_shown = NULL;
+
+	free(dwarf_lines);
+	dwarf_lines = NULL;
+	dwarf_lines_count = 0;
+	dwarf_lines_loaded = 0;
+	dwarf_line_shown = NULL;
+
+	for (i = 0; i < dwarf_srcs_count; i++) {
+		free(dwarf_srcs[i].text);
+		free(dwarf_srcs[i].lines);
+	}
+	free(dwarf_srcs);
+	dwarf_srcs = NULL;
+	dwarf_srcs_count = 0;
+
+	free(dwarf_syms);
+	free(dwarf_syms_by_off);
+	free(dwarf_syms_by_link);
+	dwarf_syms = NULL;
+	dwarf_syms_by_off = NULL;
+	dwarf_syms_by_link = NULL;
+	dwarf_syms_by_link_count = 0;
+	dwarf_syms_count = dwarf_syms_size = dwarf_syms_by_off_count = 0;
+	dm_arena_free(&dwarf_names);
+
 	return (DM_OK);
 }
 
+int
+dm_dwarf_find_sym_sorted(char *name, struct dm_dwarf_sym_cache_entry **s)
+{
+	size_t				lo = 0, hi = dwarf_syms_count, mid;
+	int				cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(dwarf_syms[mid].name, name);
+		if (cmp == 0) {
+			*s = &dwarf_syms[mid];
+			return (DM_OK);
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (DM_FAIL);
+}
+
 int
 dm_dwarf_find_sym(char *name, struct dm_dwarf_sym_cache_entry **s)
 {
-	struct dm_dwarf_sym_cache_entry		sym, *res;
+	struct dm_dwarf_sym_cache_entry		*e;
+	size_t					 i;
+
+	if (dm_dwarf_find_sym_sorted(name, s) == DM_OK)
+		return (DM_OK);
 
-	sym.name = name;
-	res = RB_FIND(dm_dwarf_sym_cache_, &dm_dwarf_sym_cache, &sym);
+	/* maybe it is in a CU we haven't loaded yet */
+	if ((lazy_dbg) && (dm_dwarf_expand_name(name) == DM_OK) &&
+	    (dm_dwarf_find_sym_sorted(name, s) == DM_OK))
+		return (DM_OK);
+
+	/* maybe it is a linkage (mangled) name */
+	if (dm_dwarf_link_prefix_range(name, &i) > 0) {
+		for (; i < dwarf_syms_by_link_count; i++) {
+			e = &dwarf_syms[dwarf_syms_by_link[i]];
+			if (strcmp(e->linkage, name) != 0)
+				break;
+			*s = e;
+			return (DM_OK);
+		}
+	}
 
-	if (!res)
+	return (DM_FAIL);
+}
+
+int
+dm_dwarf_find_sym_at_offset(ADDR64 off, struct dm_dwarf_sym_cache_entry **ent)
+{
+	size_t				lo = 0, hi, mid;
+	ADDR64				mid_off;
+
+	if (lazy_dbg)
+		dm_dwarf_expand_offset(off);
+
+	hi = dwarf_syms_by_off_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		mid_off = dwarf_syms[dwarf_syms_by_off[mid]].offset;
+		if (mid_off == off) {
+			*ent = &dwarf_syms[dwarf_syms_by_off[mid]];
+			return (DM_OK);
+		}
+		if (mid_off < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (DM_FAIL);
+}
+
+int
+dm_dwarf_cu_rb_cmp(struct dm_dwarf_cu *c1, struct dm_dwarf_cu *c2)
+{
+	if (c1->cu_die_off < c2->cu_die_off)
+		return (-1);
+
+	return (c1->cu_die_off > c2->cu_die_off);
+}
+
+/*
+ * remember that a CU has been loaded. returns 0 if it already was
+ */
+int
+dm_dwarf_mark_cu(Dwarf_Off cu_die_off)
+{
+	struct dm_dwarf_cu			 find, *cu;
+
+	find.cu_die_off = cu_die_off;
+	if (RB_FIND(dm_dwarf_cu_tree_, &dm_dwarf_cu_tree, &find) != NULL)
+		return (0);
+
+	cu = xmalloc(sizeof(struct dm_dwarf_cu));
+	cu->cu_die_off = cu_die_off;
+	RB_INSERT(dm_dwarf_cu_tree_, &dm_dwarf_cu_tree, cu);
+
+	return (1);
+}
+
+/*
+ * build the address and name indices for lazy mode. without an address
+ * index there's no point, but we can live without the name index
+ */
+int
+dm_dwarf_lazy_init(Dwarf_Debug dbg)
+{
+	if (dm_dwarf_index_aranges(dbg) != DM_OK)
 		return (DM_FAIL);
 
-	/* found */
-	*s = res;
+	if (dm_dwarf_index_names(dbg) != DM_OK)
+		DPRINTF(DM_D_INFO, "No .debug_pubnames, name lookups will "
+		    "load all CUs");
+
+	DPRINTF(DM_D_INFO, "Lazy DWARF: %lu ranges, %lu names",
+	    (unsigned long) cu_ranges_count, (unsigned long) cu_names_count);
+
 	return (DM_OK);
 }
 
 int
-dm_dwarf_find_sym_at_offset(ADDR64 off, struct dm_dwarf_sym_cache_entry **ent)
+dm_dwarf_index_aranges(Dwarf_Debug dbg)
 {
-	struct dm_dwarf_sym_cache_entry		*e;
+	Dwarf_Arange			*aranges;
+	Dwarf_Signed			 count, i;
+	Dwarf_Addr			 start;
+	Dwarf_Unsigned			 length;
+	Dwarf_Off			 cu_die_off;
+	Dwarf_Error			 error;
+	ADDR64				 offset;
+	struct dm_dwarf_cu_range	*r;
+
+	if (dwarf_get_aranges(dbg, &aranges, &count, &error) != DW_DLV_OK)
+		return (DM_FAIL);
+
+	cu_ranges = xcalloc(count, sizeof(struct dm_dwarf_cu_range));
+	for (i = 0; i < count; i++) {
+		if ((dwarf_get_arange_info(aranges[i], &start, &length,
+		    &cu_die_off, &error) == DW_DLV_OK) && (length) &&
+		    (dm_offset_from_vaddr(start, &offset) == DM_OK)) {
+			r = &cu_ranges[cu_ranges_count++];
+			r->start = offset;
+			r->end = offset + length;
+			r->cu_die_off = cu_die_off;
+		}
+		dwarf_dealloc(dbg, aranges[i], DW_DLA_ARANGE);
+	}
+	dwarf_dealloc(dbg, aranges, DW_DLA_LIST);
+
+	qsort(cu_ranges, cu_ranges_count, sizeof(struct dm_dwarf_cu_range),
+	    dm_dwarf_cu_range_cmp);
+
+	return (cu_ranges_count ? DM_OK : DM_FAIL);
+}
+
+int
+dm_dwarf_index_names(Dwarf_Debug dbg)
+{
+	Dwarf_Global			*globals;
+	Dwarf_Signed			 count, i;
+	Dwarf_Off			 die_off, cu_off, cu_die_off;
+	Dwarf_Error			 error;
+	char				*name;
+	struct dm_dwarf_cu_name		*n;
+
+	if (dwarf_get_globals(dbg, &globals, &count, &error) != DW_DLV_OK)
+		return (DM_FAIL);
+
+	cu_names = xcalloc(count, sizeof(struct dm_dwarf_cu_name));
+	for (i = 0; i < count; i++) {
+		if (dwarf_global_name_offsets(globals[i], &name, &die_off,
+		    &cu_off, &error) != DW_DLV_OK)
+			continue;
+
+		if (dwarf_get_cu_die_offset_given_cu_header_offset(dbg,
+		    cu_off, &cu_die_off, &error) == DW_DLV_OK) {
+			n = &cu_names[cu_names_count++];
+			n->name = xstrdup(name);
+			n->cu_die_off = cu_die_off;
+		}
+		dwarf_dealloc(dbg, name, DW_DLA_STRING);
+	}
+	dwarf_globals_dealloc(dbg, globals, count);
+
+	qsort(cu_names, cu_names_count, sizeof(struct dm_dwarf_cu_name),
+	    dm_dwarf_cu_name_cmp);
+
+	return (DM_OK);
+}
+
+int
+dm_dwarf_cu_range_cmp(const void *r1, const void *r2)
+{
+	const struct dm_dwarf_cu_range	*e1 = r1, *e2 = r2;
+
+	if (e1->start < e2->start)
+		return (-1);
+
+	return (e1->start > e2->start);
+}
+
+int
+dm_dwarf_cu_name_cmp(const void *n1, const void *n2)
+{
+	const struct dm_dwarf_cu_name	*e1 = n1, *e2 = n2;
+
+	return (strcmp(e1->name, e2->name));
+}
+
+/*
+ * load the DIEs of a single CU, if we haven't already
+ */
+int
+dm_dwarf_expand_cu(Dwarf_Off cu_die_off)
+{
+	Dwarf_Die			cu_die = 0;
+	Dwarf_Error			error;
+	struct dm_dwarf_batch		batch;
+	size_t				old_count, old_extents, old_scopes;
+	size_t				old_lines;
+
+	if ((lazy_dbg == 0) || (!dm_dwarf_mark_cu(cu_die_off)))
+		return (DM_OK);
+
+	if (dwarf_offdie(lazy_dbg, cu_die_off, &cu_die, &error) != DW_DLV_OK) {
+		DPRINTF(DM_D_WARN, "Can't find CU DIE at 0x%llx",
+		    (unsigned long long) cu_die_off);
+		return (DM_FAIL);
+	}
+
+	DPRINTF(DM_D_DEBUG, "Loading CU at 0x%llx",
+	    (unsigned long long) cu_die_off);
+	old_count = dwarf_syms_count;
+	old_extents = dwarf_extents_count;
+	old_scopes = dwarf_scopes_count;
+	old_lines = dwarf_lines_count;
+	dm_dwarf_batch_init(&batch);
+	dm_dwarf_load_cu(lazy_dbg, cu_die, &batch);
+	dwarf_dealloc(lazy_dbg, cu_die, DW_DLA_DIE);
+	dm_dwarf_merge_batch(&batch);
+	dm_dwarf_sort_syms(old_count);
+	dm_dwarf_sort_extents(old_extents);
+	dm_dwarf_sort_scopes(old_scopes);
+	dm_dwarf_sort_lines(old_lines);
+
+	return (DM_OK);
+}
+
+/*
+ * everything we want from a CU in lazy mode: its DIEs and its lines
+ */
+int
+dm_dwarf_load_cu(Dwarf_Debug dbg, Dwarf_Die cu_die, struct dm_dwarf_batch *b)
+{
+	dm_dwarf_decode_lines(dbg, cu_die, b);
+
+	return (dm_dwarf_recurse_die(dbg, cu_die, b));
+}
+
+int
+dm_dwarf_expand_all()
+{
+	int				ret;
+
+	if ((lazy_dbg == 0) || (lazy_all_expanded))
+		return (DM_OK);
+
+	ret = dm_dwarf_recurse_cu(lazy_dbg);
+	lazy_all_expanded = 1;
+
+	return (ret);
+}
+
+/*
+ * load the CU covering a file offset
+ */
+int
+dm_dwarf_expand_offset(ADDR64 off)
+{
+	size_t				lo = 0, hi = cu_ranges_count, mid;
+
+	if (lazy_all_expanded)
+		return (DM_OK);
+
+	/* find the last range starting at or before off */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cu_ranges[mid].start <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo == 0) || (off >= cu_ranges[lo - 1].end))
+		return (DM_FAIL);
+
+	return (dm_dwarf_expand_cu(cu_ranges[lo - 1].cu_die_off));
+}
+
+/*
+ * load the CUs defining a name
+ */
+int
+dm_dwarf_expand_name(char *name)
+{
+	size_t				lo = 0, hi = cu_names_count, mid;
+	int				ret = DM_FAIL;
+
+	if (lazy_all_expanded)
+		return (DM_FAIL);
+
+	/* no name index, we have to load the lot */
+	if (cu_names_count == 0)
+		return (dm_dwarf_expand_all());
+
+	/* find the first entry for name */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(cu_names[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; (lo < cu_names_count) &&
+	    (strcmp(cu_names[lo].name, name) == 0); lo++) {
+		if (dm_dwarf_expand_cu(cu_names[lo].cu_die_off) == DM_OK)
+			ret = DM_OK;
+	}
+
+	return (ret);
+}
+
+/*
+ * decode the line program of one CU into the batch
+ */
+int
+dm_dwarf_decode_lines(Dwarf_Debug dbg, Dwarf_Die cu_die,
+    struct dm_dwarf_batch *b)
+{
+	Dwarf_Line			*linebuf;
+	Dwarf_Signed			 count, i;
+	Dwarf_Addr			 addr;
+	Dwarf_Unsigned			 lineno, col;
+	Dwarf_Bool			 end_seq;
+	Dwarf_Error			 error;
+	ADDR64				 offset;
+	char				*src;
+	struct dm_dwarf_line		*l;
+
+	if (dwarf_srclines(cu_die, &linebuf, &count, &error) != DW_DLV_OK)
+		return (DM_FAIL);
+
+	for (i = 0; i < count; i++) {
+		if ((dwarf_lineaddr(linebuf[i], &addr, &error) != DW_DLV_OK) ||
+		    (dm_offset_from_vaddr(addr, &offset) != DM_OK))
+			continue;
+
+		if (dwarf_lineendsequence(linebuf[i], &end_seq, &error) !=
+		    DW_DLV_OK)
+			end_seq = 0;
+
+		if (end_seq) {
+			l = dm_dwarf_batch_add_line(b);
+			l->offset = offset;
+			l->file = NULL;
+			l->line = 0;
+			l->col = 0;
+			continue;
+		}
+
+		if ((dwarf_lineno(linebuf[i], &lineno, &error) != DW_DLV_OK) ||
+		    (dwarf_linesrc(linebuf[i], &src, &error) != DW_DLV_OK))
+			continue;
+
+		if (dwarf_lineoff_b(linebuf[i], &col, &error) != DW_DLV_OK)
+			col = 0;
+
+		l = dm_dwarf_batch_add_line(b);
+		l->offset = offset;
+		l->file = dm_intern(&b->names, src);
+		l->line = lineno;
+		l->col = col;
+		dwarf_dealloc(dbg, src, DW_DLA_STRING);
+	}
+
+	dwarf_srclines_dealloc(dbg, linebuf, count);
+
+	return (DM_OK);
+}
+
+int
+dm_dwarf_line_cmp(const void *l1, const void *l2)
+{
+	const struct dm_dwarf_line	*e1 = l1, *e2 = l2;
+
+	if (e1->offset != e2->offset)
+		return (e1->offset < e2->offset ? -1 : 1);
+
+	/* end of sequence markers go before rows at the same address */
+	return ((e1->line != 0) - (e2->line != 0));
+}
+
+/*
+ * merge newly decoded rows (from old_count on) into the sorted table
+ */
+void
+dm_dwarf_sort_lines(size_t old_count)
+{
+	dm_dwarf_merge_sorted(dwarf_lines, old_count, dwarf_lines_count,
+	    sizeof(struct dm_dwarf_line), dm_dwarf_line_cmp);
+	dwarf_line_shown = NULL;
+}
+
+/*
+ * decode all of the line programs, once
+ */
+int
+dm_dwarf_load_lines()
+{
+	Dwarf_Debug			dbg = lazy_dbg;
+	Dwarf_Error			error;
+	struct dm_dwarf_job		job;
+
+	/* lazily, lines are decoded along with the CU they belong to */
+	if (lazy_dbg)
+		return (DM_OK);
+
+	if (dwarf_lines_loaded)
+		return (dwarf_lines_count ? DM_OK : DM_FAIL);
+
+	dwarf_lines_loaded = 1;
+
+	if (!file_info.dwarf)
+		return (DM_FAIL);
+
+	/* in eager mode, the handle was closed after loading symbols */
+	if ((!dbg) && (dwarf_init(fileno(file_info.fptr), DW_DLC_READ,
+	    0, 0, &dbg, &error) != DW_DLV_OK))
+		return (DM_FAIL);
+
+	memset(&job, 0, sizeof(job));
+	job.cu_fn = dm_dwarf_decode_lines;
+
+	if (dm_dwarf_list_cus(dbg, &job, 0) == DM_OK)
+		dm_dwarf_run_job(dbg, &job);
+	free(job.cus);
+
+	if (dbg != lazy_dbg)
+		dwarf_finish(dbg, &error);
+
+	dm_dwarf_sort_lines(0);
+
+	DPRINTF(DM_D_INFO, "%lu line table entries",
+	    (unsigned long) dwarf_lines_count);
+
+	return (dwarf_lines_count ? DM_OK : DM_FAIL);
+}
+
+/*
+ * find the source line covering a file offset
+ */
+int
+dm_dwarf_find_line(ADDR64 off, struct dm_dwarf_line **line)
+{
+	size_t				lo = 0, hi, mid;
+
+	if (lazy_dbg)
+		dm_dwarf_expand_offset(off);
+
+	if (dm_dwarf_load_lines() != DM_OK)
+		return (DM_FAIL);
 
-	/* rbtree is keyed by symname, so we must iterate */
-	RB_FOREACH(e, dm_dwarf_sym_cache_, &dm_dwarf_sym_cache) {
-		if (e->offset == off) {
-			*ent = e;
+	/* find the last row at or before off */
+	hi = dwarf_lines_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dwarf_lines[mid].offset <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo == 0) || (dwarf_lines[lo - 1].line == 0))
+		return (DM_FAIL);
+
+	*line = &dwarf_lines[lo - 1];
+	return (DM_OK);
+}
+
+/*
+ * get line 'line' of a source file, reading the file in if need be
+ */
+char *
+dm_dwarf_source_text(char *file, uint32_t line)
+{
+	struct dm_dwarf_src		*src = NULL;
+	FILE				*fp;
+	struct stat			 st;
+	size_t				 i, size = 0;
+	char				*p;
+
+	for (i = 0; i < dwarf_srcs_count; i++) {
+		/* names are only interned per batch, compare the text */
+		if (strcmp(dwarf_srcs[i].name, file) == 0) {
+			src = &dwarf_srcs[i];
+			break;
+		}
+	}
+
+	if (src == NULL) {
+		dwarf_srcs = xrealloc(dwarf_srcs,
+		    (dwarf_srcs_count + 1) * sizeof(struct dm_dwarf_src));
+		src = &dwarf_srcs[dwarf_srcs_count++];
+		memset(src, 0, sizeof(*src));
+		src->name = file;
+
+		if (((fp = fopen(file, "r")) == NULL) ||
+		    (fstat(fileno(fp), &st) != 0)) {
+			if (fp)
+				fclose(fp);
+			return (NULL);
+		}
+
+		src->text = xmalloc(st.st_size + 1);
+		src->text[fread(src->text, 1, st.st_size, fp)] = 0;
+		fclose(fp);
+
+		/* chop into lines */
+		for (p = src->text; *p; ) {
+			if (src->nlines == size) {
+				size = size ? size * 2 : 256;
+				src->lines = xrealloc(src->lines,
+				    size * sizeof(char *));
+			}
+			src->lines[src->nlines++] = p;
+			if ((p = strchr(p, '\n')) == NULL)
+				break;
+			*p++ = 0;
+		}
+	}
+
+	if ((line == 0) || (line > src->nlines))
+		return (NULL);
+
+	return (src->lines[line - 1]);
+}
+
+/*
+ * forget which line was last shown, so the next one is shown regardless
+ */
+void
+dm_dwarf_source_reset()
+{
+	dwarf_line_shown = NULL;
+	dwarf_scope_shown = NULL;
+}
+
+/*
+ * if the dis.source setting is on and we moved onto a new source line,
+ * print it
+ */
+int
+dm_dwarf_show_source(ADDR64 off)
+{
+	struct dm_setting		*s = NULL;
+	struct dm_dwarf_line		*line;
+	char				*text, *base;
+
+	if ((dm_find_setting("dis.source", &s) != DM_OK) ||
+	    (s->val.ival == 0))
+		return (DM_OK);
+
+	if (dm_dwarf_find_line(off, &line) != DM_OK)
+		return (DM_FAIL);
+
+	if ((dwarf_line_shown) && (dwarf_line_shown->line == line->line) &&
+	    (strcmp(dwarf_line_shown->file, line->file) == 0))
+		return (DM_OK);
+	dwarf_line_shown = line;
+
+	if ((base = strrchr(line->file, '/')) != NULL)
+		base++;
+	else
+		base = line->file;
+
+	text = dm_dwarf_source_text(line->file, line->line);
+	printf("  %s%s:%u%s  %s\n", ANSII_CYAN, base, line->line,
+	    ANSII_WHITE, text ? text : "");
+
+	return (DM_OK);
+}
+
+int
+dm_dwarf_extent_cmp(const void *e1, const void *e2)
+{
+	const struct dm_dwarf_extent	*x1 = e1, *x2 = e2;
+
+	if (x1->start != x2->start)
+		return (x1->start < x2->start ? -1 : 1);
+
+	/* outermost first */
+	if (x1->end != x2->end)
+		return (x1->end > x2->end ? -1 : 1);
+
+	return (0);
+}
+
+void
+dm_dwarf_sort_extents(size_t old_count)
+{
+	size_t				i;
+
+	dm_dwarf_merge_sorted(dwarf_extents, old_count, dwarf_extents_count,
+	    sizeof(struct dm_dwarf_extent), dm_dwarf_extent_cmp);
+
+	free(dwarf_extents_max_end);
+	dwarf_extents_max_end = xcalloc(dwarf_extents_count ?
+	    dwarf_extents_count : 1, sizeof(ADDR64));
+
+	for (i = 0; i < dwarf_extents_count; i++) {
+		dwarf_extents_max_end[i] = dwarf_extents[i].end;
+		if ((i > 0) &&
+		    (dwarf_extents_max_end[i - 1] > dwarf_extents[i].end))
+			dwarf_extents_max_end[i] = dwarf_extents_max_end[i - 1];
+	}
+}
+
+/*
+ * find the innermost function extent containing a file offset
+ */
+int
+dm_dwarf_find_extent(ADDR64 off, struct dm_dwarf_extent **ext)
+{
+	size_t				lo = 0, hi, mid;
+
+	if (lazy_dbg)
+		dm_dwarf_expand_offset(off);
+
+	/* find the last extent starting at or before off */
+	hi = dwarf_extents_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dwarf_extents[mid].start <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* walk back until nothing can reach off */
+	while ((lo > 0) && (dwarf_extents_max_end[lo - 1] > off)) {
+		lo--;
+		if (dwarf_extents[lo].end > off) {
+			*ext = &dwarf_extents[lo];
+			return (DM_OK);
+		}
+	}
+
+	return (DM_FAIL);
+}
+
+/*
+ * name the code at a file offset, as "sym" or "sym+0x10". a cold range
+ * may sit below its function's entry, that comes out as "sym-0x10".
+ * returns NULL if we don't know what function it is in.
+ */
+char *
+dm_dwarf_describe_offset(ADDR64 off, char *buf, size_t len)
+{
+	struct dm_dwarf_sym_cache_entry	*sym;
+	struct dm_dwarf_extent		*ext;
+
+	if (dm_dwarf_find_sym_at_offset(off, &sym) == DM_OK)
+		snprintf(buf, len, "%s", sym->name);
+	else if (dm_dwarf_find_extent(off, &ext) == DM_OK) {
+		if (off >= ext->entry)
+			snprintf(buf, len, "%s+0x%llx", ext->name,
+			    (unsigned long long) (off - ext->entry));
+		else
+			snprintf(buf, len, "%s-0x%llx", ext->name,
+			    (unsigned long long) (ext->entry - off));
+	} else
+		return (NULL);
+
+	return (buf);
+}
+
+/*
+ * get a DIE's name, following abstract_origin and specification links
+ * as inlined and out of line instances usually have no name of their own
+ */
+char *
+dm_dwarf_die_name(Dwarf_Debug dbg, Dwarf_Die die, struct dm_dwarf_batch *b,
+    int depth)
+{
+	char				*name, *ret = NULL;
+	Dwarf_Attribute			 attr;
+	Dwarf_Off			 ref;
+	Dwarf_Die			 origin;
+	Dwarf_Error			 error;
+	Dwarf_Half			 links[] = {
+	    DW_AT_abstract_origin, DW_AT_specification };
+	size_t				 i;
+
+	if (dwarf_diename(die, &name, &error) == DW_DLV_OK) {
+		ret = dm_intern(&b->names, name);
+		dwarf_dealloc(dbg, name, DW_DLA_STRING);
+		return (ret);
+	}
+
+	/* origins can chain, but not far */
+	if (depth > 4)
+		return (NULL);
+
+	for (i = 0; (ret == NULL) && (i < sizeof(links) / sizeof(links[0]));
+	    i++) {
+		if (dwarf_attr(die, links[i], &attr, &error) != DW_DLV_OK)
+			continue;
+
+		if ((dwarf_global_formref(attr, &ref, &error) == DW_DLV_OK) &&
+		    (dwarf_offdie(dbg, ref, &origin, &error) == DW_DLV_OK)) {
+			ret = dm_dwarf_die_name(dbg, origin, b, depth + 1);
+			dwarf_dealloc(dbg, origin, DW_DLA_DIE);
+		}
+		dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+	}
+
+	return (ret);
+}
+
+int
+dm_dwarf_die_udata(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half at,
+    Dwarf_Unsigned *val)
+{
+	Dwarf_Attribute			attr;
+	Dwarf_Error			error;
+	int				ret = DM_FAIL;
+
+	if (dwarf_attr(die, at, &attr, &error) != DW_DLV_OK)
+		return (DM_FAIL);
+
+	if (dwarf_formudata(attr, val, &error) == DW_DLV_OK)
+		ret = DM_OK;
+	dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+
+	return (ret);
+}
+
+/*
+ * record an inlined call or lexical block
+ */
+int
+dm_dwarf_inspect_scope(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half tag,
+    struct dm_dwarf_batch *b)
+{
+	struct dm_dwarf_vrange		*ranges = NULL;
+	size_t				 nranges = 0, i;
+	Dwarf_Unsigned			 file = 0, line = 0;
+	ADDR64				 offset;
+	char				*name = NULL, *call_file = NULL;
+
+	if (dm_dwarf_die_ranges(dbg, die, b->cu_base,
+	    &ranges, &nranges) != DM_OK)
+		return (DM_FAIL);
+
+	if (tag == DW_TAG_inlined_subroutine) {
+		name = dm_dwarf_die_name(dbg, die, b, 0);
+		dm_dwarf_die_udata(dbg, die, DW_AT_call_line, &line);
+
+		/* file numbers count from 1 (before DWARF 5) */
+		if ((dm_dwarf_die_udata(dbg, die, DW_AT_call_file,
+		    &file) == DM_OK) && (file > 0) && (file <= b->cu_nfiles))
+			call_file = b->cu_files[file - 1];
+	}
+
+	for (i = 0; i < nranges; i++) {
+		if (dm_offset_from_vaddr(ranges[i].lo, &offset) != DM_OK)
+			continue;
+
+		dm_dwarf_add_scope(b, offset,
+		    offset + (ranges[i].hi - ranges[i].lo), name, tag,
+		    call_file, line);
+	}
+
+	free(ranges);
+	return (DM_OK);
+}
+
+int
+dm_dwarf_scope_cmp(const void *s1, const void *s2)
+{
+	const struct dm_dwarf_scope	*x1 = s1, *x2 = s2;
+
+	if (x1->start != x2->start)
+		return (x1->start < x2->start ? -1 : 1);
+
+	/* outermost first */
+	if (x1->end != x2->end)
+		return (x1->end > x2->end ? -1 : 1);
+
+	/* a function encloses an inlined call of the same extent */
+	return ((x1->tag != DW_TAG_subprogram) -
+	    (x2->tag != DW_TAG_subprogram));
+}
+
+/*
+ * sort the scopes and link each to the scope enclosing it. as the scopes
+ * are sorted outermost first, the enclosing scopes of scope i are on a
+ * stack once everything ending before i starts has been popped.
+ */
+void
+dm_dwarf_sort_scopes(size_t old_count)
+{
+	long				*stack;
+	size_t				 i, depth = 0;
+
+	dm_dwarf_merge_sorted(dwarf_scopes, old_count, dwarf_scopes_count,
+	    sizeof(struct dm_dwarf_scope), dm_dwarf_scope_cmp);
+
+	stack = xcalloc(dwarf_scopes_count ? dwarf_scopes_count : 1,
+	    sizeof(long));
+
+	for (i = 0; i < dwarf_scopes_count; i++) {
+		while ((depth > 0) && (dwarf_scopes[stack[depth - 1]].end <=
+		    dwarf_scopes[i].start))
+			depth--;
+
+		dwarf_scopes[i].parent = depth ? stack[depth - 1] : -1;
+		stack[depth++] = i;
+	}
+
+	free(stack);
+	dwarf_scope_shown = NULL;
+}
+
+/*
+ * find the innermost scope containing a file offset. its enclosing scopes
+ * can then be had by following the parent links.
+ */
+int
+dm_dwarf_find_scope(ADDR64 off, struct dm_dwarf_scope **scope)
+{
+	size_t				lo = 0, hi, mid;
+	long				i;
+
+	if (lazy_dbg)
+		dm_dwarf_expand_offset(off);
+
+	/* find the last scope starting at or before off */
+	hi = dwarf_scopes_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dwarf_scopes[mid].start <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* any scope containing off must enclose that one */
+	for (i = (long) lo - 1; i >= 0; i = dwarf_scopes[i].parent) {
+		if (dwarf_scopes[i].end > off) {
+			*scope = &dwarf_scopes[i];
 			return (DM_OK);
 		}
 	}
 
 	return (DM_FAIL);
+}
+
+void
+dm_dwarf_print_scope(struct dm_dwarf_scope *sc)
+{
+	char				*base = NULL;
+
+	if (sc->call_file) {
+		if ((base = strrchr(sc->call_file, '/')) != NULL)
+			base++;
+		else
+			base = sc->call_file;
+	}
+
+	switch (sc->tag) {
+	case DW_TAG_subprogram:
+		printf("%s", sc->name);
+		break;
+	case DW_TAG_inlined_subroutine:
+		printf("%s [inlined", sc->name ? sc->name : "???");
+		if (base)
+			printf(" at %s:%u", base, sc->call_line);
+		printf("]");
+		break;
+	default:
+		printf("{block}");
+		break;
+	}
+}
+
+/*
+ * show the scopes covering an address, innermost first
+ */
+int
+dm_cmd_scope(char **args)
+{
+	struct dm_dwarf_scope		*sc;
+	NADDR				 addr = cur_addr;
+	int				 depth = 0;
+
+	if (args[0] != NULL)
+		addr = strtoll(args[0], NULL, 0);
+
+	printf("\n");
+	if (dm_dwarf_find_scope(addr, &sc) != DM_OK) {
+		printf("  No scope known for " NADDR_FMT "\n\n", addr);
+		return (DM_FAIL);
+	}
+
+	for (; sc != NULL; sc = sc->parent >= 0 ?
+	    &dwarf_scopes[sc->parent] : NULL) {
+		printf("  #%-2d " ADDR_FMT_64 "-" ADDR_FMT_64 "  ", depth++,
+		    sc->start, sc->end);
+		dm_dwarf_print_scope(sc);
+		printf("\n");
+	}
+	printf("\n");
+
+	return (DM_OK);
+}
+
+int
+dm_cmd_scope_noargs(char **args)
+{
+	char				*arg = NULL;
+
+	(void) args;
+
+	return (dm_cmd_scope(&arg));
+}
+
+/*
+ * if the dis.inline setting is on and we moved into a different scope,
+ * print the inlined calls we are inside
+ */
+int
+dm_dwarf_show_inline(ADDR64 off)
+{
+	struct dm_setting		*s = NULL;
+	struct dm_dwarf_scope		*sc, *in;
+
+	if ((dm_find_setting("dis.inline", &s) != DM_OK) ||
+	    (s->val.ival == 0))
+		return (DM_OK);
+
+	if (dm_dwarf_find_scope(off, &sc) != DM_OK)
+		return (DM_FAIL);
+
+	if (sc == dwarf_scope_shown)
+		return (DM_OK);
+	dwarf_scope_shown = sc;
+
+	/* only inlined calls are interesting here */
+	if (sc->tag == DW_TAG_subprogram)
+		return (DM_OK);
+
+	printf("  %s", ANSII_MAGENTA);
+	for (in = sc; in != NULL; in = in->parent >= 0 ?
+	    &dwarf_scopes[in->parent] : NULL) {
+		if (in->tag == DW_TAG_lexical_block)
+			continue;
+		dm_dwarf_print_scope(in);
+		if (in->tag == DW_TAG_subprogram)
+			break;
+		printf(" <- ");
+	}
+	printf("%s\n", ANSII_WHITE);
+
+	return (DM_OK);
+}
+
+/*
+ * get a DIE's linkage name, if it has one. for C++ this is the mangled
+ * name, DW_AT_name being the plain one.
+ */
+char *
+dm_dwarf_linkage_name(Dwarf_Debug dbg, Dwarf_Die die, struct dm_dwarf_batch *b)
+{
+	Dwarf_Attribute			 attr;
+	Dwarf_Error			 error;
+	char				*str, *ret = NULL;
+
+	if ((dwarf_attr(die, DW_AT_linkage_name, &attr, &error) != DW_DLV_OK) &&
+	    (dwarf_attr(die, DW_AT_MIPS_linkage_name, &attr, &error) !=
+	    DW_DLV_OK))
+		return (NULL);
+
+	if (dwarf_formstring(attr, &str, &error) == DW_DLV_OK)
+		ret = dm_intern(&b->names, str);
+	dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+
+	return (ret);
+}
+
+/*
+ * find the run of symbols whose names start with prefix. the sorted name
+ * vector is our trie: the run is found with two binary searches.
+ */
+size_t
+dm_dwarf_prefix_range(char *prefix, size_t *first)
+{
+	size_t				lo = 0, hi = dwarf_syms_count, mid, start;
+	size_t				len = strlen(prefix);
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(dwarf_syms[mid].name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	hi = dwarf_syms_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strncmp(dwarf_syms[mid].name, prefix, len) == 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = start;
+	return (lo - start);
+}
+
+/*
+ * as above, but for linkage names. first indexes dwarf_syms_by_link.
+ */
+size_t
+dm_dwarf_link_prefix_range(char *prefix, size_t *first)
+{
+	size_t				lo = 0, hi, mid, start;
+	size_t				len = strlen(prefix);
+
+	hi = dwarf_syms_by_link_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(dwarf_syms[dwarf_syms_by_link[mid]].linkage,
+		    prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	hi = dwarf_syms_by_link_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strncmp(dwarf_syms[dwarf_syms_by_link[mid]].linkage,
+		    prefix, len) == 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = start;
+	return (lo - start);
+}
+
+/*
+ * readline generator for symbol names. state is 0 on the first call for
+ * a given text, after which we hand back one match per call.
+ */
+char *
+dm_dwarf_complete(const char *text, int state)
+{
+	size_t				first;
+
+	if (state == 0) {
+		/* lazy mode needs everything to complete against */
+		if (lazy_dbg)
+			dm_dwarf_expand_all();
+
+		dwarf_complete_end = dm_dwarf_prefix_range((char *) text,
+		    &first) + first;
+		dwarf_complete_next = first;
+	}
+
+	if (dwarf_complete_next >= dwarf_complete_end)
+		return (NULL);
 
+	return (xstrdup(dwarf_syms[dwarf_complete_next++].name));
 }
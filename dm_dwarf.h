@@ -14,31 +14,219 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifndef __DM_DWARF_H
+#define __DM_DWARF_H
+
+#include <pthread.h>
+
 #include <libdwarf.h>
 #include <dwarf.h>
 
 #include "dm_elf.h"
+#include "dm_util.h"
+#include "dm_arena.h"
 #include "tree.h"
 
 /* a debug symbol */
 struct dm_dwarf_sym_cache_entry {
-	RB_ENTRY(dm_dwarf_sym_cache_entry)	 entry;
-	char				*name;
+	char				*name;	/* interned */
+	char				*linkage; /* interned, may be NULL */
 	ADDR64				 vaddr;
 	ADDR64				 offset;
+	ADDR64				 offset_end; /* 0 if unknown */
 	int				 sym_type;
 	uint8_t				 offset_err; /* could not find offset */
 };
 
-int		dm_cmd_dwarf_funcs();
+/* a range of code belonging to a CU, from .debug_aranges */
+struct dm_dwarf_cu_range {
+	ADDR64				 start;	/* file offsets */
+	ADDR64				 end;
+	Dwarf_Off			 cu_die_off;
+};
+
+/* a global name and the CU defining it, from .debug_pubnames */
+struct dm_dwarf_cu_name {
+	char				*name;
+	Dwarf_Off			 cu_die_off;
+};
+
+/* a CU whose DIEs have been loaded (lazy mode) */
+struct dm_dwarf_cu {
+	RB_ENTRY(dm_dwarf_cu)		 entry;
+	Dwarf_Off			 cu_die_off;
+};
+
+/* a range of code belonging to a function */
+struct dm_dwarf_extent {
+	ADDR64				 start;	/* file offsets */
+	ADDR64				 end;
+	ADDR64				 entry;	/* of the function */
+	char				*name;	/* interned */
+};
+
+/* a function, inlined call or lexical block */
+struct dm_dwarf_scope {
+	ADDR64				 start;	/* file offsets */
+	ADDR64				 end;
+	char				*name;	/* interned, may be NULL */
+	char				*call_file; /* inlined calls only */
+	uint32_t			 call_line;
+	int				 tag;
+	long				 parent; /* index or -1 */
+};
+
+/* a range of virtual addresses, as found in a DIE */
+struct dm_dwarf_vrange {
+	ADDR64				 lo;
+	ADDR64				 hi;
+};
+
+/* a row of the line table */
+struct dm_dwarf_line {
+	ADDR64				 offset;
+	char				*file;	/* interned */
+	uint32_t			 line;	/* 0 = end of sequence */
+	uint32_t			 col;
+};
+
+/* a source file read in for interleaving */
+struct dm_dwarf_src {
+	char				*name;	/* interned */
+	char				*text;
+	char				**lines;
+	size_t				 nlines;
+};
+
+/* symbols found by one thread, waiting to go in the symbol cache */
+struct dm_dwarf_batch {
+	struct dm_dwarf_sym_cache_entry	*syms;
+	size_t				 count;
+	size_t				 size;
+	struct dm_dwarf_extent		*extents;
+	size_t				 extents_count;
+	size_t				 extents_size;
+	struct dm_dwarf_scope		*scopes;
+	size_t				 scopes_count;
+	size_t				 scopes_size;
+	struct dm_dwarf_line		*lines;
+	size_t				 lines_count;
+	size_t				 lines_size;
+	struct dm_arena			 arena;	/* names */
+	struct dm_intern		 names;
+	ADDR64				 cu_base; /* of the current CU */
+	char				**cu_files; /* and its file table */
+	size_t				 cu_nfiles;
+};
+
+/* CUs to be loaded, shared between worker threads */
+struct dm_dwarf_job {
+	int				(*cu_fn)(Dwarf_Debug, Dwarf_Die,
+					    struct dm_dwarf_batch *);
+	Dwarf_Off			*cus;	/* CU DIE offsets */
+	size_t				 count;
+	size_t				 next;	/* next CU to claim */
+};
+
+struct dm_dwarf_worker {
+	pthread_t			 tid;
+	int				 started;
+	struct dm_dwarf_job		*job;
+	struct dm_dwarf_batch		 batch;
+};
+
+extern int	dm_dwarf_lazy;
+
+void		dm_dwarf_print_sym(struct dm_dwarf_sym_cache_entry *sym,
+		    size_t n);
+int		dm_cmd_dwarf_funcs(char **args);
+int		dm_cmd_dwarf_funcs_pattern(char **args);
 int		dm_dwarf_recurse_cu(Dwarf_Debug dbg);
-int		dm_dwarf_recurse_die(Dwarf_Debug dbg, Dwarf_Die in_die);
+int		dm_dwarf_run_job(Dwarf_Debug dbg, struct dm_dwarf_job *job);
+int		dm_dwarf_list_cus(Dwarf_Debug dbg, struct dm_dwarf_job *job,
+		    int skip_loaded);
+void		*dm_dwarf_worker(void *arg);
+void		dm_dwarf_batch_init(struct dm_dwarf_batch *b);
+struct dm_dwarf_sym_cache_entry
+		*dm_dwarf_batch_add(struct dm_dwarf_batch *b);
+struct dm_dwarf_extent
+		*dm_dwarf_batch_add_extent(struct dm_dwarf_batch *b);
+struct dm_dwarf_scope
+		*dm_dwarf_batch_add_scope(struct dm_dwarf_batch *b);
+void		dm_dwarf_add_scope(struct dm_dwarf_batch *b, ADDR64 start,
+		    ADDR64 end, char *name, int tag, char *call_file,
+		    uint32_t call_line);
+void		dm_dwarf_batch_cu_files(Dwarf_Debug dbg, Dwarf_Die cu_die,
+		    struct dm_dwarf_batch *b);
+struct dm_dwarf_line
+		*dm_dwarf_batch_add_line(struct dm_dwarf_batch *b);
+void		dm_dwarf_merge_batch(struct dm_dwarf_batch *b);
+void		dm_dwarf_merge_sorted(void *base, size_t old_count,
+		    size_t count, size_t size,
+		    int (*cmp)(const void *, const void *));
+void		dm_dwarf_sort_syms(size_t old_count);
+int		dm_dwarf_recurse_die(Dwarf_Debug dbg, Dwarf_Die in_die,
+		    struct dm_dwarf_batch *b);
 int		get_die_and_siblings(Dwarf_Debug dbg, Dwarf_Die in_die);
-int		dm_dwarf_sym_rb_cmp(struct dm_dwarf_sym_cache_entry *s1,
-		    struct dm_dwarf_sym_cache_entry *s2);
-int		dm_dwarf_inspect_die(Dwarf_Debug dbg, Dwarf_Die print_me);
+int		dm_dwarf_sym_name_cmp(const void *s1, const void *s2);
+int		dm_dwarf_sym_link_cmp(const void *i1, const void *i2);
+int		dm_dwarf_sym_off_cmp(const void *i1, const void *i2);
+int		dm_dwarf_inspect_die(Dwarf_Debug dbg, Dwarf_Die print_me,
+		    struct dm_dwarf_batch *b);
+int		dm_dwarf_die_ranges(Dwarf_Debug dbg, Dwarf_Die die,
+		    ADDR64 cu_base, struct dm_dwarf_vrange **out,
+		    size_t *count);
 int		dm_parse_dwarf();
 int		dm_clean_dwarf();
+int		dm_dwarf_find_sym_sorted(char *name,
+		    struct dm_dwarf_sym_cache_entry **s);
 int		dm_dwarf_find_sym(char *name, struct dm_dwarf_sym_cache_entry **s);
 int		dm_dwarf_find_sym_at_offset(ADDR64 off,
 		    struct dm_dwarf_sym_cache_entry **ent);
+int		dm_dwarf_cu_rb_cmp(struct dm_dwarf_cu *c1,
+		    struct dm_dwarf_cu *c2);
+int		dm_dwarf_mark_cu(Dwarf_Off cu_die_off);
+int		dm_dwarf_lazy_init(Dwarf_Debug dbg);
+int		dm_dwarf_index_aranges(Dwarf_Debug dbg);
+int		dm_dwarf_index_names(Dwarf_Debug dbg);
+int		dm_dwarf_cu_range_cmp(const void *r1, const void *r2);
+int		dm_dwarf_cu_name_cmp(const void *n1, const void *n2);
+int		dm_dwarf_expand_cu(Dwarf_Off cu_die_off);
+int		dm_dwarf_load_cu(Dwarf_Debug dbg, Dwarf_Die cu_die,
+		    struct dm_dwarf_batch *b);
+int		dm_dwarf_expand_all();
+int		dm_dwarf_expand_offset(ADDR64 off);
+int		dm_dwarf_expand_name(char *name);
+int		dm_dwarf_decode_lines(Dwarf_Debug dbg, Dwarf_Die cu_die,
+		    struct dm_dwarf_batch *b);
+int		dm_dwarf_line_cmp(const void *l1, const void *l2);
+void		dm_dwarf_sort_lines(size_t old_count);
+int		dm_dwarf_load_lines();
+int		dm_dwarf_find_line(ADDR64 off, struct dm_dwarf_line **line);
+char		*dm_dwarf_source_text(char *file, uint32_t line);
+void		dm_dwarf_source_reset();
+int		dm_dwarf_show_source(ADDR64 off);
+int		dm_dwarf_extent_cmp(const void *e1, const void *e2);
+void		dm_dwarf_sort_extents(size_t old_count);
+int		dm_dwarf_find_extent(ADDR64 off, struct dm_dwarf_extent **ext);
+char		*dm_dwarf_describe_offset(ADDR64 off, char *buf, size_t len);
+char		*dm_dwarf_die_name(Dwarf_Debug dbg, Dwarf_Die die,
+		    struct dm_dwarf_batch *b, int depth);
+int		dm_dwarf_die_udata(Dwarf_Debug dbg, Dwarf_Die die,
+		    Dwarf_Half at, Dwarf_Unsigned *val);
+int		dm_dwarf_inspect_scope(Dwarf_Debug dbg, Dwarf_Die die,
+		    Dwarf_Half tag, struct dm_dwarf_batch *b);
+int		dm_dwarf_scope_cmp(const void *s1, const void *s2);
+void		dm_dwarf_sort_scopes(size_t old_count);
+int		dm_dwarf_find_scope(ADDR64 off, struct dm_dwarf_scope **scope);
+void		dm_dwarf_print_scope(struct dm_dwarf_scope *sc);
+int		dm_cmd_scope(char **args);
+int		dm_cmd_scope_noargs(char **args);
+int		dm_dwarf_show_inline(ADDR64 off);
+char		*dm_dwarf_linkage_name(Dwarf_Debug dbg, Dwarf_Die die,
+		    struct dm_dwarf_batch *b);
+size_t		dm_dwarf_prefix_range(char *prefix, size_t *first);
+size_t		dm_dwarf_link_prefix_range(char *prefix, size_t *first);
+char		*dm_dwarf_complete(const char *text, int state);
+
+#endif
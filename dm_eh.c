@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2011, Edd Barrett <vext01@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Function boundaries from the unwind tables.
+ *
+ * Every function compiled with unwind info (the default on amd64, even for
+ * stripped binaries) has an FDE in .eh_frame giving its exact start and
+ * length. If the linker also made a .eh_frame_hdr, that has a table of
+ * FDEs already sorted by start address, so we don't even have to sort.
+ */
+
+#include "dm_eh.h"
+#include "dm_dis.h"
+#include "dm_dwarf.h"
+#include "dm_util.h"
+
+struct dm_eh_func	*eh_funcs = NULL;
+size_t			 eh_funcs_count = 0;
+size_t			 eh_funcs_size = 0;
+
+/* most FDEs share a CIE, so remember the last one we parsed */
+ADDR64			 eh_last_cie = (ADDR64) -1;
+uint8_t			 eh_last_cie_enc = DW_EH_PE_absptr;
+
+int
+dm_parse_eh_frame()
+{
+	struct dm_shdr_cache_entry	*eh_shdr, *hdr_shdr;
+	struct dm_eh_cursor		 eh, hdr;
+	size_t				 i;
+	int				 ret = DM_FAIL;
+
+	if (!file_info.elf)
+		goto clean;
+
+	/* the sections are read in place from the mapped file */
+	if ((dm_find_section(".eh_frame", &eh_shdr) != DM_OK) ||
+	    (eh_shdr->data == NULL)) {
+		DPRINTF(DM_D_INFO, "No .eh_frame section");
+		goto clean;
+	}
+
+	eh.buf = eh.p = eh_shdr->data;
+	eh.end = eh_shdr->data + eh_shdr->size;
+	eh.vaddr = eh_shdr->addr;
+	eh.err = 0;
+
+	/* prefer the pre-sorted search table if there is one */
+	if ((dm_find_section(".eh_frame_hdr", &hdr_shdr) == DM_OK) &&
+	    (hdr_shdr->data != NULL)) {
+		hdr.buf = hdr.p = hdr_shdr->data;
+		hdr.end = hdr_shdr->data + hdr_shdr->size;
+		hdr.vaddr = hdr_shdr->addr;
+		hdr.err = 0;
+
+		if (dm_eh_parse_hdr(&hdr, &eh) == DM_OK)
+			goto sort;
+
+		DPRINTF(DM_D_INFO, "Bad .eh_frame_hdr, walking .eh_frame");
+		eh_funcs_count = 0;
+	}
+
+	if (dm_eh_parse_linear(&eh) != DM_OK)
+		goto clean;
+
+sort:
+	/* the table is sorted by vaddr, we look up by offset */
+	for (i = 1; i < eh_funcs_count; i++) {
+		if (eh_funcs[i].offset < eh_funcs[i - 1].offset) {
+			qsort(eh_funcs, eh_funcs_count,
+			    sizeof(struct dm_eh_func), dm_eh_func_cmp);
+			break;
+		}
+	}
+
+	DPRINTF(DM_D_INFO, "Found %lu functions in .eh_frame",
+	    (unsigned long) eh_funcs_count);
+	ret = DM_OK;
+clean:
+	return (ret);
+}
+
+int
+dm_clean_eh_frame()
+{
+	free(eh_funcs);
+	eh_funcs = NULL;
+	eh_funcs_count = eh_funcs_size = 0;
+	eh_last_cie = (ADDR64) -1;
+
+	return (DM_OK);
+}
+
+/*
+ * walk the binary search table in .eh_frame_hdr
+ */
+int
+dm_eh_parse_hdr(struct dm_eh_cursor *hdr, struct dm_eh_cursor *eh)
+{
+	uint8_t			version, ptr_enc, cnt_enc, tab_enc;
+	ADDR64			eh_ptr, count, i, loc, fde, start, len;
+
+	version = dm_eh_read_udata(hdr, 1);
+	ptr_enc = dm_eh_read_udata(hdr, 1);
+	cnt_enc = dm_eh_read_udata(hdr, 1);
+	tab_enc = dm_eh_read_udata(hdr, 1);
+
+	if ((hdr->err) || (version != 1)) {
+		DPRINTF(DM_D_WARN, "Unknown .eh_frame_hdr version");
+		return (DM_FAIL);
+	}
+
+	if (dm_eh_read_encoded(hdr, ptr_enc, hdr->vaddr, &eh_ptr) != DM_OK)
+		return (DM_FAIL);
+
+	if (eh_ptr != eh->vaddr)
+		DPRINTF(DM_D_WARN, ".eh_frame_hdr does not point at .eh_frame");
+
+	if ((cnt_enc == DW_EH_PE_omit) || (tab_enc == DW_EH_PE_omit))
+		return (DM_FAIL);
+
+	if (dm_eh_read_encoded(hdr, cnt_enc, hdr->vaddr, &count) != DM_OK)
+		return (DM_FAIL);
+
+	/* each entry is at least two bytes, don't trust a bogus count */
+	if (count > (ADDR64) (hdr->end - hdr->p) / 2)
+		return (DM_FAIL);
+
+	for (i = 0; i < count; i++) {
+		if (dm_eh_read_encoded(hdr, tab_enc, hdr->vaddr, &loc) != DM_OK)
+			return (DM_FAIL);
+		if (dm_eh_read_encoded(hdr, tab_enc, hdr->vaddr, &fde) != DM_OK)
+			return (DM_FAIL);
+
+		if (fde < eh->vaddr)
+			continue;
+
+		/* the table gives the start, the FDE gives the length */
+		if (dm_eh_parse_fde(eh, fde - eh->vaddr, &start, &len) != DM_OK)
+			continue;
+
+		dm_eh_add_func(loc, len);
+	}
+
+	return (DM_OK);
+}
+
+/*
+ * no .eh_frame_hdr, so walk every CIE/FDE record in .eh_frame
+ */
+int
+dm_eh_parse_linear(struct dm_eh_cursor *eh)
+{
+	ADDR64			at = 0, length, id, start, len;
+	int			hdr_len, id_len;
+	size_t			size = eh->end - eh->buf;
+
+	while (at + 4 <= size) {
+		eh->p = eh->buf + at;
+		eh->err = 0;
+
+		hdr_len = id_len = 4;
+		length = dm_eh_read_udata(eh, 4);
+		if (length == 0xffffffff) {
+			length = dm_eh_read_udata(eh, 8);
+			hdr_len = 12;
+			id_len = 8;
+		}
+
+		if (length == 0)
+			break; /* terminator */
+
+		id = dm_eh_read_udata(eh, id_len);
+		if (eh->err)
+			break;
+
+		/* a huge length could wrap 'at' round to where it was */
+		if (length > size - at - hdr_len)
+			break;
+
+		/* CIEs have an id of zero, everything else is an FDE */
+		if ((id != 0) && (dm_eh_parse_fde(eh, at, &start, &len) == DM_OK))
+			dm_eh_add_func(start, len);
+
+		at += hdr_len + length;
+	}
+
+	qsort(eh_funcs, eh_funcs_count, sizeof(struct dm_eh_func),
+	    dm_eh_func_cmp);
+
+	return (DM_OK);
+}
+
+/*
+ * get the start and length of the function an FDE describes.
+ * 'at' is the offset of the FDE into .eh_frame
+ */
+int
+dm_eh_parse_fde(struct dm_eh_cursor *eh, ADDR64 at, ADDR64 *start,
+    ADDR64 *len)
+{
+	struct dm_eh_cursor	c = *eh;
+	ADDR64			length, cie_ptr, cie_field;
+	uint8_t			fde_enc;
+	int			id_len = 4;
+
+	if (at >= (ADDR64) (c.end - c.buf))
+		return (DM_FAIL);
+
+	c.p = c.buf + at;
+	c.err = 0;
+
+	length = dm_eh_read_udata(&c, 4);
+	if (length == 0xffffffff) {
+		length = dm_eh_read_udata(&c, 8);
+		id_len = 8;
+	}
+
+	if (length == 0)
+		return (DM_FAIL);
+
+	/* the CIE pointer is relative to itself */
+	cie_field = c.p - c.buf;
+	cie_ptr = dm_eh_read_udata(&c, id_len);
+	if ((c.err) || (cie_ptr == 0) || (cie_ptr > cie_field))
+		return (DM_FAIL);
+
+	if (dm_eh_parse_cie(eh, cie_field - cie_ptr, &fde_enc) != DM_OK)
+		return (DM_FAIL);
+
+	if (dm_eh_read_encoded(&c, fde_enc, 0, start) != DM_OK)
+		return (DM_FAIL);
+
+	/* the range is never relative, only its size is encoded */
+	if (dm_eh_read_encoded(&c, fde_enc & 0x0f, 0, len) != DM_OK)
+		return (DM_FAIL);
+
+	return (DM_OK);
+}
+
+/*
+ * find the pointer encoding a CIE dictates for its FDEs
+ */
+int
+dm_eh_parse_cie(struct dm_eh_cursor *eh, ADDR64 at, uint8_t *fde_enc)
+{
+	struct dm_eh_cursor	 c = *eh;
+	ADDR64			 length, id, skip;
+	uint8_t			 version, p_enc;
+	char			*aug, *a;
+	int			 id_len = 4;
+
+	if (at == eh_last_cie) {
+		*fde_enc = eh_last_cie_enc;
+		return (DM_OK);
+	}
+
+	c.p = c.buf + at;
+	c.err = 0;
+
+	length = dm_eh_read_udata(&c, 4);
+	if (length == 0xffffffff) {
+		length = dm_eh_read_udata(&c, 8);
+		id_len = 8;
+	}
+
+	id = dm_eh_read_udata(&c, id_len);
+	version = dm_eh_read_udata(&c, 1);
+	if ((c.err) || (length == 0) || (id != 0))
+		return (DM_FAIL);
+
+	/* augmentation string */
+	aug = (char *) c.p;
+	while ((c.p < c.end) && (*c.p != '\0'))
+		c.p++;
+	if (c.p++ >= c.end)
+		return (DM_FAIL);
+
+	/* ancient gcc put an eh_ptr here */
+	if (strstr(aug, "eh") != NULL)
+		dm_eh_read_udata(&c, file_info.bits / 8);
+
+	dm_eh_read_uleb(&c);		/* code alignment */
+	dm_eh_read_sleb(&c);		/* data alignment */
+	if (version == 1)
+		dm_eh_read_udata(&c, 1);/* return address register */
+	else
+		dm_eh_read_uleb(&c);
+
+	*fde_enc = DW_EH_PE_absptr;
+	if (aug[0] == 'z') {
+		dm_eh_read_uleb(&c);	/* augmentation data length */
+
+		for (a = aug + 1; *a != '\0'; a++) {
+			switch (*a) {
+			case 'L':
+				dm_eh_read_udata(&c, 1);
+				break;
+			case 'P':
+				/* we only need to skip the personality */
+				p_enc = dm_eh_read_udata(&c, 1);
+				dm_eh_read_encoded(&c,
+				    p_enc & ~DW_EH_PE_indirect, 0, &skip);
+				break;
+			case 'R':
+				*fde_enc = dm_eh_read_udata(&c, 1);
+				break;
+			case 'S':
+			case 'B':
+				break;
+			default:
+				DPRINTF(DM_D_DEBUG,
+				    "Unknown CIE augmentation '%c'", *a);
+				goto done;
+			}
+		}
+	}
+done:
+	if (c.err)
+		return (DM_FAIL);
+
+	eh_last_cie = at;
+	eh_last_cie_enc = *fde_enc;
+
+	return (DM_OK);
+}
+
+/*
+ * read a pointer in one of the DW_EH_PE_* encodings. 'datarel' is the base
+ * for DW_EH_PE_datarel, which only .eh_frame_hdr uses
+ */
+int
+dm_eh_read_encoded(struct dm_eh_cursor *c, uint8_t enc, ADDR64 datarel,
+    ADDR64 *out)
+{
+	ADDR64			pc = c->vaddr + (c->p - c->buf);
+	ADDR64			val = 0;
+
+	if (enc == DW_EH_PE_omit)
+		return (DM_FAIL);
+
+	switch (enc & 0x0f) {
+	case DW_EH_PE_absptr:
+		val = dm_eh_read_udata(c, file_info.bits / 8);
+		break;
+	case DW_EH_PE_uleb128:
+		val = dm_eh_read_uleb(c);
+		break;
+	case DW_EH_PE_udata2:
+		val = dm_eh_read_udata(c, 2);
+		break;
+	case DW_EH_PE_udata4:
+		val = dm_eh_read_udata(c, 4);
+		break;
+	case DW_EH_PE_udata8:
+		val = dm_eh_read_udata(c, 8);
+		break;
+	case DW_EH_PE_sleb128:
+		val = dm_eh_read_sleb(c);
+		break;
+	case DW_EH_PE_sdata2:
+		val = (int16_t) dm_eh_read_udata(c, 2);
+		break;
+	case DW_EH_PE_sdata4:
+		val = (int32_t) dm_eh_read_udata(c, 4);
+		break;
+	case DW_EH_PE_sdata8:
+		val = (int64_t) dm_eh_read_udata(c, 8);
+		break;
+	default:
+		DPRINTF(DM_D_DEBUG, "Unknown pointer encoding 0x%02x", enc);
+		return (DM_FAIL);
+	}
+
+	switch (enc & 0x70) {
+	case DW_EH_PE_absptr:
+		break;
+	case DW_EH_PE_pcrel:
+		val += pc;
+		break;
+	case DW_EH_PE_datarel:
+		val += datarel;
+		break;
+	default:
+		DPRINTF(DM_D_DEBUG, "Unsupported pointer base 0x%02x", enc);
+		return (DM_FAIL);
+	}
+
+	/* would have to read the loaded image */
+	if (enc & DW_EH_PE_indirect)
+		return (DM_FAIL);
+
+	if (file_info.bits == 32)
+		val &= 0xffffffff;
+
+	*out = val;
+	return (c->err ? DM_FAIL : DM_OK);
+}
+
+uint64_t
+dm_eh_read_uleb(struct dm_eh_cursor *c)
+{
+	uint64_t		val = 0;
+	int			shift = 0;
+	uint8_t			byte;
+
+	do {
+		if (c->p >= c->end) {
+			c->err = 1;
+			return (0);
+		}
+		byte = *c->p++;
+		if (shift < 64)
+			val |= (uint64_t) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return (val);
+}
+
+int64_t
+dm_eh_read_sleb(struct dm_eh_cursor *c)
+{
+	int64_t			val = 0;
+	int			shift = 0;
+	uint8_t			byte;
+
+	do {
+		if (c->p >= c->end) {
+			c->err = 1;
+			return (0);
+		}
+		byte = *c->p++;
+		if (shift < 64)
+			val |= (int64_t) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if ((shift < 64) && (byte & 0x40))
+		val |= -((int64_t) 1 << shift);
+
+	return (val);
+}
+
+/*
+ * read a little endian unsigned value of 'sz' bytes
+ */
+uint64_t
+dm_eh_read_udata(struct dm_eh_cursor *c, int sz)
+{
+	uint64_t		val = 0;
+	int			i;
+
+	if (c->p + sz > c->end) {
+		c->err = 1;
+		c->p = c->end;
+		return (0);
+	}
+
+	for (i = 0; i < sz; i++)
+		val |= (uint64_t) c->p[i] << (i * 8);
+	c->p += sz;
+
+	return (val);
+}
+
+void
+dm_eh_add_func(ADDR64 start, ADDR64 len)
+{
+	struct dm_eh_func	*f;
+	ADDR64			 off;
+
+	if (len == 0)
+		return;
+
+	/* no use to us if we can't find it in the file */
+	if (dm_offset_from_vaddr(start, &off) != DM_OK) {
+		DPRINTF(DM_D_DEBUG, "No offset for FDE at " ADDR_FMT_64, start);
+		return;
+	}
+
+	if (eh_funcs_count == eh_funcs_size) {
+		eh_funcs_size = eh_funcs_size ? eh_funcs_size * 2 : 64;
+		eh_funcs = xrealloc(eh_funcs,
+		    eh_funcs_size * sizeof(struct dm_eh_func));
+	}
+
+	f = &eh_funcs[eh_funcs_count++];
+	f->vaddr = start;
+	f->vaddr_end = start + len;
+	f->offset = off;
+	f->offset_end = off + len;
+}
+
+int
+dm_eh_func_cmp(const void *f1, const void *f2)
+{
+	const struct dm_eh_func	*e1 = f1, *e2 = f2;
+
+	if (e1->offset < e2->offset)
+		return (-1);
+
+	return (e1->offset > e2->offset);
+}
+
+/*
+ * find the function containing the file offset 'off'
+ */
+int
+dm_eh_find_func(ADDR64 off, struct dm_eh_func **f)
+{
+	size_t			lo = 0, hi = eh_funcs_count, mid;
+
+	/* find the last function starting at or before off */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (eh_funcs[mid].offset <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo == 0) || (off >= eh_funcs[lo - 1].offset_end))
+		return (DM_FAIL);
+
+	*f = &eh_funcs[lo - 1];
+	return (DM_OK);
+}
+
+/*
+ * the whole index, sorted by offset, so that jobs over the whole binary
+ * can split it up without having to discover functions first
+ */
+struct dm_eh_func *
+dm_eh_funcs(size_t *count)
+{
+	*count = eh_funcs_count;
+	return (eh_funcs);
+}
+
+int
+dm_cmd_eh_funcs(char **args)
+{
+	struct dm_dwarf_sym_cache_entry	*sym;
+	size_t				 i;
+
+	(void) args;
+
+	printf("\n");
+	for (i = 0; i < eh_funcs_count; i++) {
+
+		/* reprint headers every 20 lines */
+		if (i % 20 == 0) {
+			printf("%s\n", DM_RULE);
+			printf("%-10s | %-10s | %-8s | %-20s\n",
+			    "Start", "End", "Size", "Symbol");
+			printf("%s\n", DM_RULE);
+		}
+
+		printf(ADDR_FMT_64 " | " ADDR_FMT_64 " | %8lu | %s\n",
+		    eh_funcs[i].offset, eh_funcs[i].offset_end,
+		    (unsigned long) (eh_funcs[i].offset_end -
+		    eh_funcs[i].offset),
+		    (dm_dwarf_find_sym_at_offset(eh_funcs[i].offset, &sym) ==
+		    DM_OK) ? sym->name : "");
+	}
+
+	printf("%s\n\n", DM_RULE);
+	return (DM_OK);
+}
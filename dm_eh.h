@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011, Edd Barrett <vext01@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_EH_H
+#define __DM_EH_H
+
+#include "common.h"
+#include "dm_elf.h"
+
+/* pointer encodings used in .eh_frame and .eh_frame_hdr */
+#define DW_EH_PE_absptr		0x00
+#define DW_EH_PE_uleb128	0x01
+#define DW_EH_PE_udata2		0x02
+#define DW_EH_PE_udata4		0x03
+#define DW_EH_PE_udata8		0x04
+#define DW_EH_PE_sleb128	0x09
+#define DW_EH_PE_sdata2		0x0a
+#define DW_EH_PE_sdata4		0x0b
+#define DW_EH_PE_sdata8		0x0c
+#define DW_EH_PE_pcrel		0x10
+#define DW_EH_PE_datarel	0x30
+#define DW_EH_PE_indirect	0x80
+#define DW_EH_PE_omit		0xff
+
+/* a function extent, as described by an FDE */
+struct dm_eh_func {
+	ADDR64			 vaddr;
+	ADDR64			 vaddr_end;
+	ADDR64			 offset;
+	ADDR64			 offset_end;
+};
+
+/* a cursor over a section buffer */
+struct dm_eh_cursor {
+	uint8_t			*buf;	/* start of section */
+	uint8_t			*p;	/* current position */
+	uint8_t			*end;	/* end of section */
+	ADDR64			 vaddr;	/* vaddr of buf[0] */
+	int			 err;	/* set if we ran off the end */
+};
+
+int			 dm_parse_eh_frame();
+int			 dm_clean_eh_frame();
+int			 dm_eh_parse_hdr(struct dm_eh_cursor *hdr,
+			    struct dm_eh_cursor *eh);
+int			 dm_eh_parse_linear(struct dm_eh_cursor *eh);
+int			 dm_eh_parse_fde(struct dm_eh_cursor *eh, ADDR64 at,
+			    ADDR64 *start, ADDR64 *len);
+int			 dm_eh_parse_cie(struct dm_eh_cursor *eh, ADDR64 at,
+			    uint8_t *fde_enc);
+int			 dm_eh_read_encoded(struct dm_eh_cursor *c,
+			    uint8_t enc, ADDR64 datarel, ADDR64 *out);
+uint64_t		 dm_eh_read_uleb(struct dm_eh_cursor *c);
+int64_t			 dm_eh_read_sleb(struct dm_eh_cursor *c);
+uint64_t		 dm_eh_read_udata(struct dm_eh_cursor *c, int sz);
+void			 dm_eh_add_func(ADDR64 start, ADDR64 len);
+int			 dm_eh_func_cmp(const void *f1, const void *f2);
+int			 dm_eh_find_func(ADDR64 off, struct dm_eh_func **f);
+struct dm_eh_func	*dm_eh_funcs(size_t *count);
+int			 dm_cmd_eh_funcs(char **args);
+
+#endif
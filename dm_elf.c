@@ -14,14 +14,17 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/mman.h>
+
 #include <err.h>
 #include <sysexits.h>
 
-#include <libelf/gelf.h>
-
 #include "dm_elf.h"
+#include "dm_util.h"
 
-Elf						*elf = NULL;
+struct dm_elf_image				 elf_img;
+struct dm_shdr_cache_entry			*sht_cache = NULL;
+size_t						 sht_cache_count = 0;
 SIMPLEQ_HEAD(tailhead, dm_pht_cache_entry)	 pht_cache;
 
 struct dm_pht_type pht_types[] = {
@@ -70,98 +73,185 @@ dm_get_pht_info(int find)
 }
 
 /*
- * get the offset of a section name
+ * find a section header by name
  */
 int
-dm_find_section(char *find_sec, GElf_Shdr *shdr)
+dm_find_section(char *find_sec, struct dm_shdr_cache_entry **shdr)
 {
-	Elf_Scn			*sec;
-	size_t			 shdrs_idx;
-	char			*sec_name;
-	NADDR			 ret = DM_FAIL;
-
-	if (elf == NULL)
-		goto clean;
-
-	if (elf_getshdrstrndx(elf, &shdrs_idx) != 0) {
-		fprintf(stderr, "elf_getshdrsrtndx: %s", elf_errmsg(-1));
-		goto clean;
-	}
-
-
-	sec = NULL ;
-	while ((sec = elf_nextscn(elf, sec)) != NULL) {
-		if (gelf_getshdr(sec, shdr) != shdr) {
-			fprintf(stderr, "gelf_getshdr: %s", elf_errmsg(-1));
-			goto clean;
-		}
+	size_t			 i;
 
-		if ((sec_name =
-		    elf_strptr(elf, shdrs_idx, shdr->sh_name)) == NULL) {
-			fprintf(stderr, "elf_strptr: %s", elf_errmsg(-1));
-			goto clean;
-		}
-
-		if (strcmp(sec_name, find_sec) == 0) {
-			ret = DM_OK;
-			break;
+	for (i = 0; i < sht_cache_count; i++) {
+		if (strcmp(sht_cache[i].name, find_sec) == 0) {
+			*shdr = &sht_cache[i];
+			return (DM_OK);
 		}
 	}
 
-clean:
-	return (ret);
+	return (DM_FAIL);
 }
 
 int
 dm_init_elf()
 {
-	Elf_Kind		 ek;
-	GElf_Ehdr		 ehdr;
-	int			 nbits;
+	uint8_t			*ehdr;
+	ADDR64			 shoff, phoff, shstrndx;
+	size_t			 ehdr_size;
 
 	SIMPLEQ_INIT(&pht_cache);
+	memset(&elf_img, 0, sizeof(elf_img));
 
-	if(elf_version(EV_CURRENT) == EV_NONE) {
-		fprintf(stderr, "elf_version: %s\n", elf_errmsg(-1));
+	if (file_info.stat.st_size < EI_NIDENT) {
+		DPRINTF(DM_D_INFO, "No ELF header present");
 		goto err;
 	}
 
-	if ((elf = elf_begin(fileno(file_info.fptr), ELF_C_READ, NULL)) == NULL) {
-		fprintf(stderr, "elf_begin: %s\n", elf_errmsg(-1));
+	elf_img.size = file_info.stat.st_size;
+	elf_img.base = mmap(NULL, elf_img.size, PROT_READ, MAP_PRIVATE,
+	    fileno(file_info.fptr), 0);
+	if (elf_img.base == MAP_FAILED) {
+		perror("mmap");
+		elf_img.base = NULL;
 		goto err;
 	}
+	ehdr = elf_img.base;
 
-	ek = elf_kind(elf);
-
-	if (ek != ELF_K_ELF) {
+	if (memcmp(ehdr, ELFMAG, SELFMAG) != 0) {
 		DPRINTF(DM_D_INFO, "No ELF header present");
 		goto err;
 	}
 
+	elf_img.class = ehdr[EI_CLASS];
+	if (elf_img.class == ELFCLASS64)
+		ehdr_size = sizeof(Elf64_Ehdr);
+	else if (elf_img.class == ELFCLASS32)
+		ehdr_size = sizeof(Elf32_Ehdr);
+	else {
+		fprintf(stderr, "Unknown ELF class %d\n", elf_img.class);
+		goto err;
+	}
+
+	if (ehdr[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "Only little endian ELF files are supported\n");
+		goto err;
+	}
+
+	if (elf_img.size < ehdr_size) {
+		fprintf(stderr, "Truncated ELF header\n");
+		goto err;
+	}
+
 	file_info.elf = 1;
+	file_info.bits = (elf_img.class == ELFCLASS32) ? 32 : 64;
+	file_info.ident = (char *) &ehdr[EI_MAG0];
 
 	/* Let's take a look at the execution header */
-	if ( gelf_getehdr(elf, &ehdr) == NULL) {
-		fprintf(stderr, "%s\n", elf_errmsg(-1));
-	} else {
-		if ((nbits = gelf_getclass(elf)) == ELFCLASSNONE)
-			fprintf(stderr, "%s\n", elf_errmsg(-1));
-
-		if (nbits == ELFCLASS32)
-			file_info.bits = 32;
-		else
-			file_info.bits = 64;
-	}
+	shoff = DM_ELF_FIELD(ehdr, Ehdr, e_shoff);
+	elf_img.shnum = DM_ELF_FIELD(ehdr, Ehdr, e_shnum);
+	elf_img.shentsize = DM_ELF_FIELD(ehdr, Ehdr, e_shentsize);
+	shstrndx = DM_ELF_FIELD(ehdr, Ehdr, e_shstrndx);
+
+	phoff = DM_ELF_FIELD(ehdr, Ehdr, e_phoff);
+	elf_img.phnum = DM_ELF_FIELD(ehdr, Ehdr, e_phnum);
+	elf_img.phentsize = DM_ELF_FIELD(ehdr, Ehdr, e_phentsize);
+
+	if ((shoff) && (elf_img.shentsize >= ((elf_img.class == ELFCLASS64) ?
+	    sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr))) &&
+	    DM_ELF_IN_BOUNDS(shoff, elf_img.shentsize)) {
+		elf_img.shdrs = elf_img.base + shoff;
+
+		/* lots of sections, the real counts are in section 0 */
+		if (elf_img.shnum == 0)
+			elf_img.shnum =
+			    DM_ELF_FIELD(elf_img.shdrs, Shdr, sh_size);
+		if (shstrndx == SHN_XINDEX)
+			shstrndx = DM_ELF_FIELD(elf_img.shdrs, Shdr, sh_link);
+
+		/* divide rather than multiply, a 64-bit count can wrap */
+		if (elf_img.shnum >
+		    (elf_img.size - shoff) / elf_img.shentsize) {
+			fprintf(stderr, "Section header table out of bounds\n");
+			elf_img.shdrs = NULL;
+			elf_img.shnum = 0;
+		}
+	} else
+		elf_img.shnum = 0;
 
-	if ((file_info.ident = elf_getident(elf, NULL)) == NULL)
-		fprintf(stderr, "%s\n", elf_errmsg(-1));
+	if ((phoff) && (elf_img.phentsize >= ((elf_img.class == ELFCLASS64) ?
+	    sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr))) &&
+	    DM_ELF_IN_BOUNDS(phoff, elf_img.phnum * elf_img.phentsize))
+		elf_img.phdrs = elf_img.base + phoff;
+	else
+		elf_img.phnum = 0;
+
+	if (dm_parse_sht(shstrndx) != DM_OK)
+		goto err;
 
 	return (DM_OK);
 err:
-	elf = NULL;
+	if (elf_img.base != NULL)
+		munmap(elf_img.base, elf_img.size);
+	memset(&elf_img, 0, sizeof(elf_img));
+	file_info.elf = 0;
 	return (DM_FAIL);
 }
 
+/*
+ * build the section header cache. names and contents are left in the
+ * mapped file, we just point at them
+ */
+int
+dm_parse_sht(ADDR64 shstrndx)
+{
+	struct dm_shdr_cache_entry	*rec;
+	uint8_t				*shdr;
+	ADDR64				 name;
+	size_t				 i;
+
+	sht_cache_count = 0;
+	if (elf_img.shnum == 0)
+		return (DM_OK);
+
+	if (shstrndx < elf_img.shnum) {
+		shdr = elf_img.shdrs + shstrndx * elf_img.shentsize;
+		if (DM_ELF_IN_BOUNDS(DM_ELF_FIELD(shdr, Shdr, sh_offset),
+		    DM_ELF_FIELD(shdr, Shdr, sh_size))) {
+			elf_img.shstrtab = (char *) elf_img.base +
+			    DM_ELF_FIELD(shdr, Shdr, sh_offset);
+			elf_img.shstrtab_size =
+			    DM_ELF_FIELD(shdr, Shdr, sh_size);
+		}
+	}
+
+	/* names must be terminated inside the string table */
+	if ((elf_img.shstrtab == NULL) || (elf_img.shstrtab_size == 0) ||
+	    (elf_img.shstrtab[elf_img.shstrtab_size - 1] != '\0')) {
+		fprintf(stderr, "Bad section header string table\n");
+		return (DM_FAIL);
+	}
+
+	sht_cache = xcalloc(elf_img.shnum, sizeof(struct dm_shdr_cache_entry));
+
+	for (i = 0; i < elf_img.shnum; i++) {
+		shdr = elf_img.shdrs + i * elf_img.shentsize;
+		rec = &sht_cache[sht_cache_count++];
+
+		name = DM_ELF_FIELD(shdr, Shdr, sh_name);
+		rec->name = elf_img.shstrtab +
+		    ((name < elf_img.shstrtab_size) ? name : 0);
+		rec->type = DM_ELF_FIELD(shdr, Shdr, sh_type);
+		rec->flags = DM_ELF_FIELD(shdr, Shdr, sh_flags);
+		rec->addr = DM_ELF_FIELD(shdr, Shdr, sh_addr);
+		rec->offset = DM_ELF_FIELD(shdr, Shdr, sh_offset);
+		rec->size = DM_ELF_FIELD(shdr, Shdr, sh_size);
+
+		if ((rec->type != SHT_NOBITS) &&
+		    DM_ELF_IN_BOUNDS(rec->offset, rec->size))
+			rec->data = elf_img.base + rec->offset;
+	}
+
+	return (DM_OK);
+}
+
 /*
  * make a RWX string for program header flags
  * ret is a preallocated string of atleast 4 in length
@@ -198,7 +288,7 @@ dm_cmd_pht(char **args)
 
 	(void) args;
 
-	if (elf == NULL)
+	if (!file_info.elf)
 		goto clean;
 
 	/* Get program header table */
@@ -229,41 +319,25 @@ clean:
 int
 dm_cmd_sht(char **args)
 {
-	Elf_Scn			*sec;
-	size_t			 shdrs_idx;
-	GElf_Shdr		 shdr;
-	char			*sec_name;
-	int			 ret = DM_FAIL;
+	struct dm_shdr_cache_entry	*shdr;
+	size_t				 i;
+	int				 ret = DM_FAIL;
 
 	(void) args;
 
-	if (elf == NULL)
+	if (!file_info.elf)
 		goto clean;
 
-	/* Get section header table */
-	if (elf_getshdrstrndx(elf, &shdrs_idx) != 0) {
-		fprintf(stderr, "elf_getshdrsrtndx: %s", elf_errmsg(-1));
-		goto clean;
-	}
-
-	printf("\nFound %lu section header records:\n", shdrs_idx);
+	printf("\nFound %lu section header records:\n",
+	    (unsigned long) sht_cache_count);
 	printf("%s\n", DM_RULE);
 	printf("%-20s | %-10s | %-10s\n", "Name", "Offset", "Virtual");
 	printf("%s\n", DM_RULE);
 
-	sec = NULL ;
-	while ((sec = elf_nextscn(elf, sec)) != NULL) {
-		if (gelf_getshdr(sec, &shdr) != &shdr) {
-			fprintf(stderr, "gelf_getshdr: %s", elf_errmsg(-1));
-			goto clean;
-		}
-
-		if (!(sec_name = elf_strptr(elf, shdrs_idx, shdr.sh_name))) {
-			fprintf(stderr, "elf_strptr: %s", elf_errmsg(-1));
-			goto clean;
-		}
+	for (i = 0; i < sht_cache_count; i++) {
+		shdr = &sht_cache[i];
 		printf("%-20s | " ADDR_FMT_64 " | " NADDR_FMT "\n",
-		    sec_name, shdr.sh_offset, (NADDR) shdr.sh_addr);
+		    shdr->name, shdr->offset, (NADDR) shdr->addr);
 	}
 	printf("%s\n", DM_RULE);
 
@@ -279,27 +353,18 @@ int
 dm_parse_pht()
 {
 	int				ret = DM_FAIL;
-	GElf_Phdr			phdr;
-	size_t				num_phdrs, i;
+	uint8_t				*phdr;
+	size_t				i;
 	struct dm_pht_type		*pht_t;
 	struct dm_pht_cache_entry	*rec;
 
-	if (elf == NULL)
-		goto clean;
-
-	if (elf_getphdrnum(elf, &num_phdrs) != 0) {
-		fprintf(stderr, "elf_getphdrnum: %s", elf_errmsg ( -1));
+	if (!file_info.elf)
 		goto clean;
-	}
 
-	for (i = 0; i < num_phdrs; i++) {
+	for (i = 0; i < elf_img.phnum; i++) {
+		phdr = elf_img.phdrs + i * elf_img.phentsize;
 
-		if (gelf_getphdr(elf, i, &phdr) != &phdr) {
-			fprintf(stderr, "elf_getphdr: %s", elf_errmsg(-1));
-			goto clean;
-		}
-
-		pht_t = dm_get_pht_info(phdr.p_type);
+		pht_t = dm_get_pht_info(DM_ELF_FIELD(phdr, Phdr, p_type));
 		if (!pht_t)
 			pht_t = &unknown_pht_type;
 
@@ -309,11 +374,11 @@ dm_parse_pht()
 			fprintf(stderr, "malloc\n");
 
 		rec->type = pht_t;
-		rec->flags = phdr.p_flags;
-		rec->start_offset = phdr.p_offset;
-		rec->start_vaddr = phdr.p_vaddr;
-		rec->memsz = phdr.p_memsz;
-		rec->filesz = phdr.p_filesz;
+		rec->flags = DM_ELF_FIELD(phdr, Phdr, p_flags);
+		rec->start_offset = DM_ELF_FIELD(phdr, Phdr, p_offset);
+		rec->start_vaddr = DM_ELF_FIELD(phdr, Phdr, p_vaddr);
+		rec->memsz = DM_ELF_FIELD(phdr, Phdr, p_memsz);
+		rec->filesz = DM_ELF_FIELD(phdr, Phdr, p_filesz);
 
 		SIMPLEQ_INSERT_TAIL(&pht_cache, rec, entries);
 	}
@@ -334,7 +399,13 @@ dm_clean_elf()
 		free(n);
 	}
 
-	elf_end(elf);
+	free(sht_cache);
+	sht_cache = NULL;
+	sht_cache_count = 0;
+
+	if (elf_img.base != NULL)
+		munmap(elf_img.base, elf_img.size);
+	memset(&elf_img, 0, sizeof(elf_img));
 
 	return (DM_OK);
 }
@@ -364,6 +435,31 @@ dm_offset_from_vaddr(ADDR64 vaddr, ADDR64 *offset)
 	return (DM_OK);
 }
 
+/*
+ * The inverse of dm_offset_from_vaddr(), for file offsets that are
+ * loaded by some segment
+ */
+int
+dm_vaddr_from_offset(ADDR64 offset, ADDR64 *vaddr)
+{
+	struct dm_pht_cache_entry		*cent;
+
+	SIMPLEQ_FOREACH(cent, &pht_cache, entries) {
+
+		/* Only loadable segments, PT_GNU_STACK & co. map nothing */
+		if ((cent->type == NULL) || (cent->type->type_int != PT_LOAD))
+			continue;
+		if ((offset < cent->start_offset) ||
+		    (offset >= cent->start_offset + cent->filesz))
+			continue;
+
+		*vaddr = cent->start_vaddr + (offset - cent->start_offset);
+		return (DM_OK);
+	}
+
+	return (DM_FAIL);
+}
+
 int
 dm_cmd_offset(char **args)
 {
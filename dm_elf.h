@@ -17,8 +17,7 @@
 #ifndef __DM_ELF_H
 #define __DM_ELF_H
 
-#include <libelf/gelf.h>
-#include <libelf/libelf.h>
+#include <elf.h>
 
 #include "queue.h"
 #include "common.h"
@@ -38,6 +37,60 @@
 #define ADDR64			Elf64_Addr
 #define ADDR32			Elf32_Addr
 
+/*
+ * We don't use libelf. The ELF headers are used in place in the mapped
+ * file. x86 binaries are always little endian, so on a little endian host
+ * the fields are used as is and on a big endian host they are swapped as
+ * they are read. Which is decided at compile time.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#define DM_ELF_LE(x)						\
+	    ((sizeof(x) == 8) ? __builtin_bswap64(x) :			\
+	    (sizeof(x) == 4) ? __builtin_bswap32(x) :			\
+	    (sizeof(x) == 2) ? __builtin_bswap16(x) : (x))
+#else
+	#define DM_ELF_LE(x)		(x)
+#endif
+
+/* read a field of an ELF32 or ELF64 structure, whichever the file uses */
+#define DM_ELF_FIELD(p, type, field)					\
+	((elf_img.class == ELFCLASS64) ?				\
+	    (ADDR64) DM_ELF_LE(((Elf64_##type *) (p))->field) :	\
+	    (ADDR64) DM_ELF_LE(((Elf32_##type *) (p))->field))
+
+/* is [off, off + len) inside the mapped file? */
+#define DM_ELF_IN_BOUNDS(off, len)					\
+	(((ADDR64) (off) <= elf_img.size) &&				\
+	    ((ADDR64) (len) <= elf_img.size - (ADDR64) (off)))
+
+/* the mapped file */
+struct dm_elf_image {
+	uint8_t			*base;
+	size_t			 size;
+	int			 class;		/* ELFCLASS32 or ELFCLASS64 */
+	uint8_t			*shdrs;		/* section header table */
+	size_t			 shnum;
+	size_t			 shentsize;
+	uint8_t			*phdrs;		/* program header table */
+	size_t			 phnum;
+	size_t			 phentsize;
+	char			*shstrtab;
+	size_t			 shstrtab_size;
+};
+
+extern struct dm_elf_image	elf_img;
+
+/* a section header, built once when the file is loaded */
+struct dm_shdr_cache_entry {
+	char			*name;	/* points into the mapped file */
+	uint8_t			*data;	/* ditto, NULL if not in the file */
+	uint32_t		 type;
+	ADDR64			 flags;
+	ADDR64			 addr;
+	ADDR64			 offset;
+	ADDR64			 size;
+};
+
 struct dm_pht_type {
 	int		 type_int;
 	char		*type_str;
@@ -56,7 +109,9 @@ struct dm_pht_cache_entry {
 };
 
 struct dm_pht_type	*dm_get_pht_info(int find);
-int			dm_find_section(char *find_sec, GElf_Shdr *shdr);
+int			dm_find_section(char *find_sec,
+			    struct dm_shdr_cache_entry **shdr);
+int			dm_parse_sht(ADDR64 shstrndx);
 NADDR			dm_find_size(char *find_sec);
 int			dm_init_elf();
 int			dm_make_pht_flag_str(int flags, char *ret);
@@ -65,6 +120,7 @@ int			dm_cmd_sht(char **args);
 int			dm_parse_pht();
 int			dm_clean_elf();
 int			dm_offset_from_vaddr(ADDR64 vaddr, ADDR64 *offset);
+int			dm_vaddr_from_offset(ADDR64 offset, ADDR64 *vaddr);
 int			dm_cmd_offset(char **args);
 
 #endif
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "dm_flow.h"
+#include "dm_util.h"
+#include "dm_bitset.h"
+
+extern int p_length;
+
+/*
+ * Solve a dataflow problem to its fixpoint. Blocks are worked on lowest
+ * reverse post-order first (highest for backwards problems), so most
+ * blocks see their inputs before they are evaluated. Big graphs may be
+ * split into strongly connected components, which are solved in
+ * topological order and, where independent, in parallel.
+ */
+void
+dm_flow_solve(struct dm_flow *f)
+{
+	struct dm_graph		 g;
+
+	dm_cfg_graph(&g);
+	dm_flow_solve_graph(f, &g);
+	dm_graph_free(&g);
+}
+
+/*
+ * Solve over any graph with its entry at vertex 0, not just the current
+ * CFG. Nothing global is touched, so threads may each solve their own.
+ */
+void
+dm_flow_solve_graph(struct dm_flow *f, struct dm_graph *g)
+{
+	int			 v = 0, nthreads = 1;
+
+	f->n = g->n;
+	f->evals = 0;
+	if (f->in == NULL)
+		f->in = xcalloc(f->n, f->size);
+	if (f->out == NULL)
+		f->out = xcalloc(f->n, f->size);
+	if (f->init != NULL)
+		for (v = 0; v < f->n; v++)
+			f->init(f, v, DM_FLOW_IN(f, v), DM_FLOW_OUT(f, v));
+
+	if (f->n >= DM_FLOW_PAR_MIN)
+		nthreads = f->threads ? f->threads : dm_nthreads();
+
+	if (nthreads > 1)
+		dm_flow_parallel(f, g, nthreads);
+	else
+		dm_flow_serial(f, g);
+}
+
+void
+dm_flow_free(struct dm_flow *f)
+{
+	free(f->in);
+	free(f->out);
+	f->in = f->out = NULL;
+}
+
+/*
+ * One worklist holding the whole graph
+ */
+void
+dm_flow_serial(struct dm_flow *f, struct dm_graph *g)
+{
+	struct dm_flow_heap	 h;
+	char			*queued = NULL;
+	int			*idx, *next, v = 0, e = 0;
+
+	/* Who to revisit when v changes */
+	idx = (f->dir == DM_FLOW_FORWARD) ? g->succ_idx : g->pred_idx;
+	next = (f->dir == DM_FLOW_FORWARD) ? g->succ : g->pred;
+
+	h.v = xmalloc(f->n * sizeof(int));
+	h.count = 0;
+	queued = xmalloc(f->n);
+	memset(queued, 1, f->n);
+	for (v = 0; v < f->n; v++)
+		dm_flow_push(f, &h, v);
+
+	while (h.count) {
+		v = dm_flow_pop(f, &h);
+		queued[v] = 0;
+		f->evals++;
+		if (!dm_flow_eval(f, g, v))
+			continue;
+		for (e = idx[v]; e < idx[v + 1]; e++) {
+			if (!queued[next[e]]) {
+				queued[next[e]] = 1;
+				dm_flow_push(f, &h, next[e]);
+			}
+		}
+	}
+
+	free(h.v);
+	free(queued);
+}
+
+/*
+ * Condense the graph into SCCs and give each SCC a level: one more than
+ * the deepest SCC feeding it. SCCs of one level don't feed each other,
+ * so a level's SCCs are shared out among threads.
+ */
+void
+dm_flow_parallel(struct dm_flow *f, struct dm_graph *g, int nthreads)
+{
+	struct dm_flow_job	 job;
+	struct dm_flow_worker	*workers = NULL;
+	struct dm_flow_heap	 h;
+	int			*comp, *members, *first, *level, *by_level;
+	int			*level_first, *idx, *next;
+	int			 ncomp, nlevels = 0, c, i, v, e, w, step;
+
+	comp = xmalloc(f->n * sizeof(int));
+	ncomp = dm_graph_scc(g, comp);
+
+	/* Group vertices by SCC, in reverse post-order within each */
+	first = xcalloc(ncomp + 1, sizeof(int));
+	members = xmalloc(f->n * sizeof(int));
+	for (v = 0; v < f->n; v++)
+		first[comp[v] + 1]++;
+	for (c = 0; c < ncomp; c++)
+		first[c + 1] += first[c];
+	for (v = 0; v < f->n; v++)
+		members[first[comp[v]]++] = v;
+	for (c = ncomp; c > 0; c--)
+		first[c] = first[c - 1];
+	first[0] = 0;
+
+	/*
+	 * Edges between SCCs go from higher to lower numbers, so that is
+	 * topological order forwards and the reverse backwards
+	 */
+	idx = (f->dir == DM_FLOW_FORWARD) ? g->succ_idx : g->pred_idx;
+	next = (f->dir == DM_FLOW_FORWARD) ? g->succ : g->pred;
+	step = (f->dir == DM_FLOW_FORWARD) ? -1 : 1;
+	level = xcalloc(ncomp, sizeof(int));
+	for (c = (step == -1) ? ncomp - 1 : 0; (c >= 0) && (c < ncomp);
+	    c += step) {
+		for (i = first[c]; i < first[c + 1]; i++) {
+			v = members[i];
+			for (e = idx[v]; e < idx[v + 1]; e++) {
+				w = comp[next[e]];
+				if ((w != c) && (level[w] < level[c] + 1))
+					level[w] = level[c] + 1;
+			}
+		}
+		if (level[c] + 1 > nlevels)
+			nlevels = level[c] + 1;
+	}
+
+	/* Sort SCCs by level */
+	level_first = xcalloc(nlevels + 1, sizeof(int));
+	by_level = xmalloc(ncomp * sizeof(int));
+	for (c = 0; c < ncomp; c++)
+		level_first[level[c] + 1]++;
+	for (i = 0; i < nlevels; i++)
+		level_first[i + 1] += level_first[i];
+	for (c = 0; c < ncomp; c++)
+		by_level[level_first[level[c]]++] = c;
+	for (i = nlevels; i > 0; i--)
+		level_first[i] = level_first[i - 1];
+	level_first[0] = 0;
+
+	DPRINTF(DM_D_INFO, "Dataflow over %d blocks: %d SCCs in %d levels",
+	    f->n, ncomp, nlevels);
+
+	memset(&job, 0, sizeof(job));
+	job.f = f;
+	job.g = g;
+	job.comp = comp;
+	job.members = members;
+	job.first = first;
+	job.queued = xcalloc(f->n, 1);
+	h.v = xmalloc(f->n * sizeof(int));
+	workers = xcalloc(nthreads, sizeof(struct dm_flow_worker));
+
+	for (i = 0; i < nlevels; i++) {
+		job.comps = by_level + level_first[i];
+		job.count = level_first[i + 1] - level_first[i];
+		job.next = 0;
+
+		/* Threads only pay off for wide levels */
+		for (c = 0, w = 0; c < job.count; c++)
+			w += first[job.comps[c] + 1] - first[job.comps[c]];
+		if ((job.count > 1) && (w >= DM_FLOW_PAR_LEVEL)) {
+			for (c = 0; c < nthreads; c++) {
+				workers[c].job = &job;
+				workers[c].started = 0;
+				if (pthread_create(&workers[c].tid, NULL,
+				    dm_flow_worker, &workers[c]) != 0) {
+					DPRINTF(DM_D_WARN,
+					    "Can't start thread");
+					break;
+				}
+				workers[c].started = 1;
+			}
+			for (c = 0; c < nthreads; c++)
+				if (workers[c].started)
+					pthread_join(workers[c].tid, NULL);
+		}
+
+		/* Whatever the workers didn't get to (if any), we do here */
+		dm_flow_job_run(&job, &h);
+	}
+
+	free(workers);
+	free(h.v);
+	free(job.queued);
+	free(comp);
+	free(members);
+	free(first);
+	free(level);
+	free(level_first);
+	free(by_level);
+}
+
+void *
+dm_flow_worker(void *arg)
+{
+	struct dm_flow_worker	*w = arg;
+	struct dm_flow_heap	 h;
+
+	h.v = xmalloc(w->job->f->n * sizeof(int));
+	dm_flow_job_run(w->job, &h);
+	free(h.v);
+
+	return (NULL);
+}
+
+/*
+ * Claim and solve SCCs of a level until there are none left
+ */
+void
+dm_flow_job_run(struct dm_flow_job *job, struct dm_flow_heap *h)
+{
+	int			 i, c;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+	    job->count) {
+		c = job->comps[i];
+		dm_flow_scc(job->f, job->g, job->comp, c,
+		    job->members + job->first[c],
+		    job->first[c + 1] - job->first[c], job->queued, h);
+	}
+}
+
+/*
+ * Solve one SCC, whose inputs from other SCCs are already final
+ */
+void
+dm_flow_scc(struct dm_flow *f, struct dm_graph *g, int *comp, int c,
+    int *members, int count, char *queued, struct dm_flow_heap *h)
+{
+	int			*idx, *next, i, v, e, evals = 0;
+
+	idx = (f->dir == DM_FLOW_FORWARD) ? g->succ_idx : g->pred_idx;
+	next = (f->dir == DM_FLOW_FORWARD) ? g->succ : g->pred;
+
+	h->count = 0;
+	for (i = 0; i < count; i++) {
+		queued[members[i]] = 1;
+		dm_flow_push(f, h, members[i]);
+	}
+
+	while (h->count) {
+		v = dm_flow_pop(f, h);
+		queued[v] = 0;
+		evals++;
+		if (!dm_flow_eval(f, g, v))
+			continue;
+		for (e = idx[v]; e < idx[v + 1]; e++) {
+			if ((comp[next[e]] == c) && (!queued[next[e]])) {
+				queued[next[e]] = 1;
+				dm_flow_push(f, h, next[e]);
+			}
+		}
+	}
+
+	__atomic_fetch_add(&f->evals, evals, __ATOMIC_RELAXED);
+}
+
+/*
+ * Meet the values flowing into v and run v's transfer function
+ */
+int
+dm_flow_eval(struct dm_flow *f, struct dm_graph *g, int v)
+{
+	int			*idx, *prev, e;
+	void			*in = DM_FLOW_IN(f, v);
+
+	idx = (f->dir == DM_FLOW_FORWARD) ? g->pred_idx : g->succ_idx;
+	prev = (f->dir == DM_FLOW_FORWARD) ? g->pred : g->succ;
+
+	/* Blocks with nothing flowing in keep their starting value */
+	if (idx[v] != idx[v + 1]) {
+		f->top(f, in);
+		for (e = idx[v]; e < idx[v + 1]; e++)
+			f->meet(f, in, DM_FLOW_OUT(f, prev[e]));
+	}
+
+	return (f->transfer(f, v, in, DM_FLOW_OUT(f, v)));
+}
+
+/*
+ * Binary heap on reverse post-order number, or post-order number for
+ * backwards problems
+ */
+void
+dm_flow_push(struct dm_flow *f, struct dm_flow_heap *h, int v)
+{
+	int			 i = h->count++, parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (DM_FLOW_KEY(f, h->v[parent]) <= DM_FLOW_KEY(f, v))
+			break;
+		h->v[i] = h->v[parent];
+		i = parent;
+	}
+	h->v[i] = v;
+}
+
+int
+dm_flow_pop(struct dm_flow *f, struct dm_flow_heap *h)
+{
+	int			 top = h->v[0], last, i = 0, c;
+
+	last = h->v[--h->count];
+	while ((c = 2 * i + 1) < h->count) {
+		if ((c + 1 < h->count) &&
+		    (DM_FLOW_KEY(f, h->v[c + 1]) < DM_FLOW_KEY(f, h->v[c])))
+			c++;
+		if (DM_FLOW_KEY(f, last) <= DM_FLOW_KEY(f, h->v[c]))
+			break;
+		h->v[i] = h->v[c];
+		i = c;
+	}
+	h->v[i] = last;
+
+	return (top);
+}
+
+/*
+ * Make f a bitset problem of nbits bits, meeting by union (may) or
+ * intersection (must). The caller still provides transfer and init.
+ */
+void
+dm_flow_bitset(struct dm_flow *f, int nbits, int meet_union)
+{
+	f->words = DM_BITSET_WORDS(nbits);
+	f->size = f->words * sizeof(uint64_t);
+	f->top = meet_union ? dm_flow_bits_empty : dm_flow_bits_full;
+	f->meet = meet_union ? dm_flow_bits_union : dm_flow_bits_isect;
+}
+
+void
+dm_flow_bits_empty(struct dm_flow *f, void *val)
+{
+	memset(val, 0, f->size);
+}
+
+void
+dm_flow_bits_full(struct dm_flow *f, void *val)
+{
+	memset(val, 0xff, f->size);
+}
+
+void
+dm_flow_bits_union(struct dm_flow *f, void *dst, void *src)
+{
+	uint64_t		*d = dst, *s = src;
+	int			 k;
+
+	for (k = 0; k < f->words; k++)
+		d[k] |= s[k];
+}
+
+void
+dm_flow_bits_isect(struct dm_flow *f, void *dst, void *src)
+{
+	uint64_t		*d = dst, *s = src;
+	int			 k;
+
+	for (k = 0; k < f->words; k++)
+		d[k] &= s[k];
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_FLOW_H
+#define __DM_FLOW_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "dm_cfg.h"
+
+#define DM_FLOW_FORWARD		0
+#define DM_FLOW_BACKWARD	1
+
+/* Below this many blocks it isn't worth starting threads */
+#define DM_FLOW_PAR_MIN		4096
+/* Nor for a level of SCCs with fewer blocks than this */
+#define DM_FLOW_PAR_LEVEL	512
+
+/*
+ * A dataflow problem over the current CFG. Blocks are numbered by reverse
+ * post-order. Each block has a lattice value of 'size' bytes flowing into
+ * it and one flowing out of it, in the direction of the problem: for a
+ * backwards problem 'in' is at the end of the block and 'out' at the
+ * start.
+ *
+ * The lattice is whatever the callbacks make it. Bitsets are ready made
+ * (dm_flow_bitset()); a map or anything else just needs its own top, meet
+ * and transfer. Callbacks may be run from several threads at once, but
+ * never for the same block or for blocks that feed each other.
+ */
+struct dm_flow {
+	int			 dir;	  /* DM_FLOW_FORWARD or _BACKWARD */
+	size_t			 size;	  /* Bytes per lattice value */
+	int			 words;	  /* For bitset lattices */
+	int			 threads; /* 1 for serial, 0 for one per core */
+	void			*ctx;	  /* The analysis' own data */
+
+	/* Starting values, including at the entry (or exits). May be NULL */
+	void			(*init)(struct dm_flow *f, int v, void *in,
+				    void *out);
+	/* The identity of meet */
+	void			(*top)(struct dm_flow *f, void *val);
+	/* dst = dst meet src */
+	void			(*meet)(struct dm_flow *f, void *dst, void *src);
+	/* Compute out from in, return non-zero if out changed */
+	int			(*transfer)(struct dm_flow *f, int v, void *in,
+				    void *out);
+
+	/* Results. Allocated by dm_flow_solve() unless already set */
+	int			 n;
+	char			*in;
+	char			*out;
+	int			 evals;	  /* Transfer function calls */
+};
+
+#define DM_FLOW_IN(f, v)	((void *)((f)->in + (size_t)(v) * (f)->size))
+#define DM_FLOW_OUT(f, v)	((void *)((f)->out + (size_t)(v) * (f)->size))
+/* Worklist order */
+#define DM_FLOW_KEY(f, v)	(((f)->dir == DM_FLOW_FORWARD) ? (v) : -(v))
+
+/* A priority worklist, lowest key first */
+struct dm_flow_heap {
+	int			*v;
+	int			 count;
+};
+
+/* A level of independent SCCs to be solved in parallel */
+struct dm_flow_job {
+	struct dm_flow		*f;
+	struct dm_graph		*g;
+	int			*comp;	  /* Vertex -> SCC */
+	int			*members; /* Vertices grouped by SCC */
+	int			*first;	  /* SCC -> first entry in members */
+	int			*comps;	  /* SCCs of this level */
+	int			 count;
+	int			 next;	  /* Next SCC to claim */
+	char			*queued;
+};
+
+struct dm_flow_worker {
+	pthread_t		 tid;
+	int			 started;
+	struct dm_flow_job	*job;
+};
+
+void			dm_flow_solve(struct dm_flow *f);
+void			dm_flow_solve_graph(struct dm_flow *f,
+			    struct dm_graph *g);
+void			dm_flow_free(struct dm_flow *f);
+void			dm_flow_serial(struct dm_flow *f, struct dm_graph *g);
+void			dm_flow_parallel(struct dm_flow *f, struct dm_graph *g,
+			    int nthreads);
+void			*dm_flow_worker(void *arg);
+void			dm_flow_job_run(struct dm_flow_job *job,
+			    struct dm_flow_heap *h);
+void			dm_flow_scc(struct dm_flow *f, struct dm_graph *g,
+			    int *comp, int c, int *members, int count,
+			    char *queued, struct dm_flow_heap *h);
+int			dm_flow_eval(struct dm_flow *f, struct dm_graph *g,
+			    int v);
+void			dm_flow_push(struct dm_flow *f, struct dm_flow_heap *h,
+			    int v);
+int			dm_flow_pop(struct dm_flow *f, struct dm_flow_heap *h);
+void			dm_flow_bitset(struct dm_flow *f, int nbits,
+			    int meet_union);
+void			dm_flow_bits_empty(struct dm_flow *f, void *val);
+void			dm_flow_bits_full(struct dm_flow *f, void *val);
+void			dm_flow_bits_union(struct dm_flow *f, void *dst,
+			    void *src);
+void			dm_flow_bits_isect(struct dm_flow *f, void *dst,
+			    void *src);
+
+#endif
@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dm_graph.h"
+#include "dm_util.h"
+
+/*
+ * Build a graph of n vertices from m edges from[i] -> to[i]
+ */
+void
+dm_graph_init(struct dm_graph *g, int n, int m, int *from, int *to)
+{
+	int		 i, *fill;
+
+	g->n = n;
+	g->m = m;
+	g->succ_idx = xcalloc(n + 1, sizeof(int));
+	g->pred_idx = xcalloc(n + 1, sizeof(int));
+	g->succ = xcalloc(m ? m : 1, sizeof(int));
+	g->pred = xcalloc(m ? m : 1, sizeof(int));
+
+	/* count, then prefix sum, then fill (a counting sort) */
+	for (i = 0; i < m; i++) {
+		g->succ_idx[from[i] + 1]++;
+		g->pred_idx[to[i] + 1]++;
+	}
+	for (i = 0; i < n; i++) {
+		g->succ_idx[i + 1] += g->succ_idx[i];
+		g->pred_idx[i + 1] += g->pred_idx[i];
+	}
+
+	fill = xcalloc(n ? n : 1, sizeof(int));
+	for (i = 0; i < m; i++)
+		g->succ[g->succ_idx[from[i]] + fill[from[i]]++] = to[i];
+
+	memset(fill, 0, (n ? n : 1) * sizeof(int));
+	for (i = 0; i < m; i++)
+		g->pred[g->pred_idx[to[i]] + fill[to[i]]++] = from[i];
+
+	free(fill);
+}
+
+/*
+ * Make dst the reverse of src, every edge turned around
+ */
+void
+dm_graph_reverse(struct dm_graph *dst, struct dm_graph *src)
+{
+	dst->n = src->n;
+	dst->m = src->m;
+	dst->succ_idx = xcalloc(src->n + 1, sizeof(int));
+	dst->pred_idx = xcalloc(src->n + 1, sizeof(int));
+	dst->succ = xcalloc(src->m ? src->m : 1, sizeof(int));
+	dst->pred = xcalloc(src->m ? src->m : 1, sizeof(int));
+
+	memcpy(dst->succ_idx, src->pred_idx, (src->n + 1) * sizeof(int));
+	memcpy(dst->pred_idx, src->succ_idx, (src->n + 1) * sizeof(int));
+	memcpy(dst->succ, src->pred, src->m * sizeof(int));
+	memcpy(dst->pred, src->succ, src->m * sizeof(int));
+}
+
+void
+dm_graph_free(struct dm_graph *g)
+{
+	free(g->succ_idx);
+	free(g->succ);
+	free(g->pred_idx);
+	free(g->pred);
+	memset(g, 0, sizeof(*g));
+}
+
+/*
+ * Depth first search from root, without recursion
+ */
+void
+dm_graph_dfs(struct dm_graph *g, int root, struct dm_graph_dfs *d)
+{
+	int		*stack, *edge, depth = 0, v, w, posts = 0;
+
+	d->count = 0;
+	d->dfn = xmalloc(g->n * sizeof(int));
+	d->post = xmalloc(g->n * sizeof(int));
+	d->vertex = xmalloc(g->n * sizeof(int));
+	d->parent = xmalloc(g->n * sizeof(int));
+	memset(d->dfn, -1, g->n * sizeof(int));
+	memset(d->post, -1, g->n * sizeof(int));
+
+	stack = xmalloc(g->n * sizeof(int));
+	edge = xmalloc(g->n * sizeof(int));
+
+	d->dfn[root] = d->count;
+	d->vertex[d->count] = root;
+	d->parent[d->count++] = -1;
+	stack[depth] = root;
+	edge[depth++] = g->succ_idx[root];
+
+	while (depth) {
+		v = stack[depth - 1];
+		if (edge[depth - 1] == g->succ_idx[v + 1]) {
+			d->post[v] = posts++;
+			depth--;
+			continue;
+		}
+
+		w = g->succ[edge[depth - 1]++];
+		if (d->dfn[w] != -1)
+			continue;
+
+		d->dfn[w] = d->count;
+		d->vertex[d->count] = w;
+		d->parent[d->count++] = d->dfn[v];
+		stack[depth] = w;
+		edge[depth++] = g->succ_idx[w];
+	}
+
+	free(stack);
+	free(edge);
+}
+
+void
+dm_graph_dfs_free(struct dm_graph_dfs *d)
+{
+	free(d->dfn);
+	free(d->post);
+	free(d->vertex);
+	free(d->parent);
+}
+
+/*
+ * Find the immediate dominator of every vertex reachable from root.
+ * idom[root] is root, unreachable vertices get -1.
+ */
+void
+dm_graph_idom(struct dm_graph *g, int root, int *idom, int engine)
+{
+	if (engine == DM_DOM_ENGINE_SNCA)
+		dm_graph_idom_snca(g, root, idom);
+	else
+		dm_graph_idom_chk(g, root, idom);
+}
+
+/*
+ * The iterative algorithm of Cooper, Harvey and Kennedy, "A Simple, Fast
+ * Dominance Algorithm". Iterates to a fixed point in reverse post-order.
+ */
+void
+dm_graph_idom_chk(struct dm_graph *g, int root, int *idom)
+{
+	struct dm_graph_dfs	 d;
+	int			*rpo, i, j, v, u, a, b, new_idom, changed = 1;
+
+	dm_graph_dfs(g, root, &d);
+
+	/* vertices in reverse post-order */
+	rpo = xmalloc((d.count ? d.count : 1) * sizeof(int));
+	for (i = 0; i < d.count; i++) {
+		v = d.vertex[i];
+		rpo[d.count - 1 - d.post[v]] = v;
+	}
+
+	for (i = 0; i < g->n; i++)
+		idom[i] = -1;
+	idom[root] = root;
+
+	while (changed) {
+		changed = 0;
+		for (i = 1; i < d.count; i++) {
+			v = rpo[i];
+			new_idom = -1;
+			for (j = g->pred_idx[v]; j < g->pred_idx[v + 1]; j++) {
+				u = g->pred[j];
+				if (idom[u] == -1)
+					continue;
+				if (new_idom == -1) {
+					new_idom = u;
+					continue;
+				}
+
+				/* intersect */
+				a = u;
+				b = new_idom;
+				while (a != b) {
+					while (d.post[a] < d.post[b])
+						a = idom[a];
+					while (d.post[b] < d.post[a])
+						b = idom[b];
+				}
+				new_idom = a;
+			}
+
+			if (idom[v] != new_idom) {
+				idom[v] = new_idom;
+				changed = 1;
+			}
+		}
+	}
+
+	free(rpo);
+	dm_graph_dfs_free(&d);
+}
+
+/*
+ * Semi-NCA, from Georgiadis' thesis "Linear-Time Algorithms for
+ * Dominators and Related Problems". Semi-dominators are computed as in
+ * Lengauer-Tarjan (with simple path compression), then each idom is
+ * found as the nearest common ancestor of the parent and the semi-
+ * dominator on the tree built so far. Everything here is in pre-order
+ * numbers until the end.
+ */
+void
+dm_graph_idom_snca(struct dm_graph *g, int root, int *idom)
+{
+	struct dm_graph_dfs	 d;
+	int			*semi, *label, *ancestor, *dom, *stack;
+	int			 i, j, u, s, n;
+
+	dm_graph_dfs(g, root, &d);
+	n = d.count ? d.count : 1;
+
+	semi = xmalloc(n * sizeof(int));
+	label = xmalloc(n * sizeof(int));
+	ancestor = xmalloc(n * sizeof(int));
+	dom = xmalloc(n * sizeof(int));
+	stack = xmalloc(n * sizeof(int));
+
+	for (i = 0; i < d.count; i++) {
+		semi[i] = label[i] = i;
+		ancestor[i] = -1;
+	}
+
+	/* semi-dominators, in reverse pre-order */
+	for (i = d.count - 1; i > 0; i--) {
+		for (j = g->pred_idx[d.vertex[i]];
+		    j < g->pred_idx[d.vertex[i] + 1]; j++) {
+			u = d.dfn[g->pred[j]];
+			if (u == -1)
+				continue;	/* unreachable */
+
+			s = semi[dm_graph_snca_eval(u, ancestor, label,
+			    semi, stack)];
+			if (s < semi[i])
+				semi[i] = s;
+		}
+
+		/* link i into the forest */
+		ancestor[i] = d.parent[i];
+	}
+
+	/* nearest common ancestors, in pre-order */
+	dom[0] = 0;
+	for (i = 1; i < d.count; i++) {
+		dom[i] = d.parent[i];
+		while (dom[i] > semi[i])
+			dom[i] = dom[dom[i]];
+	}
+
+	for (i = 0; i < g->n; i++)
+		idom[i] = -1;
+	for (i = 0; i < d.count; i++)
+		idom[d.vertex[i]] = d.vertex[dom[i]];
+
+	free(semi);
+	free(label);
+	free(ancestor);
+	free(dom);
+	free(stack);
+	dm_graph_dfs_free(&d);
+}
+
+/*
+ * Return the vertex of least semi-dominator on the forest path from v up
+ * to (but not including) its root, compressing the path as we go. The
+ * path is walked with the caller's stack rather than by recursion.
+ */
+int
+dm_graph_snca_eval(int v, int *ancestor, int *label, int *semi, int *stack)
+{
+	int			depth = 0, x, a;
+
+	if (ancestor[v] == -1)
+		return (v);
+
+	/* find the path, stopping below the root */
+	for (x = v; ancestor[ancestor[x]] != -1; x = ancestor[x])
+		stack[depth++] = x;
+
+	/* compress from the top down */
+	while (depth) {
+		x = stack[--depth];
+		a = ancestor[x];
+		if (semi[label[a]] < semi[label[x]])
+			label[x] = label[a];
+		ancestor[x] = ancestor[a];
+	}
+
+	return (label[v]);
+}
+
+/*
+ * Build the loop nesting forest of the vertices reachable from root, by
+ * Havlak's algorithm ("Nesting of Reducible and Irreducible Loops") with
+ * Ramalingam's fix for irreducible loops. header[v] is the header of the
+ * innermost loop holding v, or of the loop enclosing v if v is a header
+ * itself, or -1. type[v] says whether (and what kind of) a header v is.
+ */
+void
+dm_graph_loops(struct dm_graph *g, int root, int *header, int *type)
+{
+	struct dm_graph_dfs	 d;
+	int			*last, *uf, *hdr, *kind, *in_p, *members;
+	int			*back_idx, *back, **nb, *nb_count, *nb_size;
+	int			 w, k, x, y, e, i, np;
+
+	dm_graph_dfs(g, root, &d);
+
+	/* last[k] is the highest pre-order number in k's DFS subtree */
+	last = xmalloc(d.count * sizeof(int));
+	for (k = 0; k < d.count; k++)
+		last[k] = k;
+	for (k = d.count - 1; k > 0; k--)
+		if (last[k] > last[d.parent[k]])
+			last[d.parent[k]] = last[k];
+
+	/*
+	 * Split the predecessors of each vertex into back edges (from a DFS
+	 * descendant) and the rest. Everything from here is done in
+	 * pre-order numbers.
+	 */
+	back_idx = xcalloc(d.count + 1, sizeof(int));
+	back = xmalloc((g->m + 1) * sizeof(int));
+	nb = xcalloc(d.count, sizeof(int *));
+	nb_count = xcalloc(d.count, sizeof(int));
+	nb_size = xcalloc(d.count, sizeof(int));
+	for (w = 0; w < d.count; w++) {
+		back_idx[w + 1] = back_idx[w];
+		for (e = g->pred_idx[d.vertex[w]];
+		    e < g->pred_idx[d.vertex[w] + 1]; e++) {
+			k = d.dfn[g->pred[e]];
+			if (k == -1)
+				continue;
+			if ((w <= k) && (k <= last[w]))
+				back[back_idx[w + 1]++] = k;
+			else {
+				if (nb_count[w] == nb_size[w]) {
+					nb_size[w] = nb_size[w] ? nb_size[w] * 2 : 4;
+					nb[w] = xrealloc(nb[w],
+					    nb_size[w] * sizeof(int));
+				}
+				nb[w][nb_count[w]++] = k;
+			}
+		}
+	}
+
+	uf = xmalloc(d.count * sizeof(int));
+	hdr = xmalloc(d.count * sizeof(int));
+	kind = xcalloc(d.count, sizeof(int));
+	in_p = xmalloc(d.count * sizeof(int));
+	members = xmalloc(d.count * sizeof(int));
+	for (k = 0; k < d.count; k++) {
+		uf[k] = k;
+		hdr[k] = -1;
+		in_p[k] = -1;
+	}
+
+	/* Innermost loops first */
+	for (w = d.count - 1; w >= 0; w--) {
+		np = 0;
+		for (e = back_idx[w]; e < back_idx[w + 1]; e++) {
+			if (back[e] == w) {
+				kind[w] = DM_LOOP_SELF;
+				continue;
+			}
+			x = dm_graph_uf_find(uf, back[e]);
+			if (in_p[x] != w) {
+				in_p[x] = w;
+				members[np++] = x;
+			}
+		}
+		if (np)
+			kind[w] = DM_LOOP_REDUCIBLE;
+
+		/* Grow the body backwards from the back edge sources */
+		for (i = 0; i < np; i++) {
+			x = members[i];
+			for (e = 0; e < nb_count[x]; e++) {
+				y = dm_graph_uf_find(uf, nb[x][e]);
+				if ((y < w) || (y > last[w])) {
+					/* Entered from outside w's subtree */
+					kind[w] = DM_LOOP_IRREDUCIBLE;
+					if (nb_count[w] == nb_size[w]) {
+						nb_size[w] = nb_size[w] ?
+						    nb_size[w] * 2 : 4;
+						nb[w] = xrealloc(nb[w],
+						    nb_size[w] * sizeof(int));
+					}
+					nb[w][nb_count[w]++] = y;
+				} else if ((in_p[y] != w) && (y != w)) {
+					in_p[y] = w;
+					members[np++] = y;
+				}
+			}
+		}
+
+		/* Collapse the body into w */
+		for (i = 0; i < np; i++) {
+			hdr[members[i]] = w;
+			uf[members[i]] = w;
+		}
+	}
+
+	for (x = 0; x < g->n; x++) {
+		header[x] = -1;
+		type[x] = DM_LOOP_NONE;
+	}
+	for (k = 0; k < d.count; k++) {
+		header[d.vertex[k]] = (hdr[k] == -1) ? -1 : d.vertex[hdr[k]];
+		type[d.vertex[k]] = kind[k];
+	}
+
+	for (k = 0; k < d.count; k++)
+		free(nb[k]);
+	free(nb);
+	free(nb_count);
+	free(nb_size);
+	free(back_idx);
+	free(back);
+	free(last);
+	free(uf);
+	free(hdr);
+	free(kind);
+	free(in_p);
+	free(members);
+	dm_graph_dfs_free(&d);
+}
+
+/*
+ * Union-find lookup with path halving
+ */
+int
+dm_graph_uf_find(int *uf, int x)
+{
+	while (uf[x] != x) {
+		uf[x] = uf[uf[x]];
+		x = uf[x];
+	}
+
+	return (x);
+}
+
+/*
+ * Find the strongly connected components of g by Tarjan's algorithm,
+ * without recursion. comp[v] is v's component and the number of
+ * components is returned. Components are numbered in the order Tarjan
+ * finishes them, so every edge between components goes from a higher
+ * number to a lower one.
+ */
+int
+dm_graph_scc(struct dm_graph *g, int *comp)
+{
+	int			*index, *low, *stack, *call, *edge;
+	int			 sp = 0, csp = 0, count = 0, ncomp = 0;
+	int			 root, v, w, x;
+	char			*on;
+
+	index = xmalloc(g->n * sizeof(int));
+	low = xmalloc(g->n * sizeof(int));
+	stack = xmalloc(g->n * sizeof(int));
+	call = xmalloc(g->n * sizeof(int));
+	edge = xmalloc(g->n * sizeof(int));
+	on = xcalloc(g->n, 1);
+	memset(index, -1, g->n * sizeof(int));
+
+	for (root = 0; root < g->n; root++) {
+		if (index[root] != -1)
+			continue;
+
+		index[root] = low[root] = count++;
+		stack[sp++] = root;
+		on[root] = 1;
+		call[csp] = root;
+		edge[csp++] = g->succ_idx[root];
+
+		while (csp) {
+			v = call[csp - 1];
+			if (edge[csp - 1] < g->succ_idx[v + 1]) {
+				w = g->succ[edge[csp - 1]++];
+				if (index[w] == -1) {
+					index[w] = low[w] = count++;
+					stack[sp++] = w;
+					on[w] = 1;
+					call[csp] = w;
+					edge[csp++] = g->succ_idx[w];
+				} else if ((on[w]) && (index[w] < low[v]))
+					low[v] = index[w];
+				continue;
+			}
+
+			/* v is finished, is it the root of a component? */
+			if (low[v] == index[v]) {
+				do {
+					x = stack[--sp];
+					on[x] = 0;
+					comp[x] = ncomp;
+				} while (x != v);
+				ncomp++;
+			}
+			if (--csp && (low[v] < low[call[csp - 1]]))
+				low[call[csp - 1]] = low[v];
+		}
+	}
+
+	free(index);
+	free(low);
+	free(stack);
+	free(call);
+	free(edge);
+	free(on);
+
+	return (ncomp);
+}
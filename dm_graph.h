@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_GRAPH_H
+#define __DM_GRAPH_H
+
+/*
+ * A directed graph in compressed sparse row form. The successors of
+ * vertex v are succ[succ_idx[v]] .. succ[succ_idx[v + 1] - 1], likewise
+ * for predecessors. Vertices are plain ints so that the algorithms here
+ * work on any graph, CFG or reversed CFG or made up for benchmarking.
+ */
+struct dm_graph {
+	int		 n;
+	int		 m;
+	int		*succ_idx;
+	int		*succ;
+	int		*pred_idx;
+	int		*pred;
+};
+
+/* the DFS spanning tree of a graph, in pre-order numbering */
+struct dm_graph_dfs {
+	int		 count;		/* vertices reached */
+	int		*dfn;		/* vertex -> pre-order number or -1 */
+	int		*vertex;	/* pre-order number -> vertex */
+	int		*parent;	/* pre-order number -> parent's number */
+	int		*post;		/* vertex -> post-order number or -1 */
+};
+
+#define DM_DOM_ENGINE_CHK	0	/* Cooper, Harvey & Kennedy */
+#define DM_DOM_ENGINE_SNCA	1	/* Semi-NCA */
+
+/* loop header types, as found by dm_graph_loops() */
+#define DM_LOOP_NONE		0	/* not a loop header */
+#define DM_LOOP_SELF		1	/* a single vertex looping on itself */
+#define DM_LOOP_REDUCIBLE	2	/* header dominates the whole loop */
+#define DM_LOOP_IRREDUCIBLE	3	/* loop can be entered elsewhere */
+
+void	dm_graph_init(struct dm_graph *g, int n, int m, int *from, int *to);
+void	dm_graph_reverse(struct dm_graph *dst, struct dm_graph *src);
+void	dm_graph_free(struct dm_graph *g);
+void	dm_graph_dfs(struct dm_graph *g, int root, struct dm_graph_dfs *d);
+void	dm_graph_dfs_free(struct dm_graph_dfs *d);
+void	dm_graph_idom(struct dm_graph *g, int root, int *idom, int engine);
+void	dm_graph_idom_chk(struct dm_graph *g, int root, int *idom);
+void	dm_graph_idom_snca(struct dm_graph *g, int root, int *idom);
+int	dm_graph_snca_eval(int v, int *ancestor, int *label, int *semi,
+	    int *stack);
+void	dm_graph_loops(struct dm_graph *g, int root, int *header, int *type);
+int	dm_graph_uf_find(int *uf, int x);
+int	dm_graph_scc(struct dm_graph *g, int *comp);
+
+#endif
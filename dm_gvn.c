@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "dm_gvn.h"
+#include "dm_sccp.h"
+#include "dm_util.h"
+
+extern struct dm_instruction_se *instructions;
+extern struct ptrs		*p_head;
+extern struct ptrs		*p;
+extern struct dm_ssa_index	*indices;
+
+/*
+ * List the computations and loads in the current function that repeat
+ * one made in a dominating block
+ */
+int
+dm_cmd_gvn(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_cfg_node	*cfg = NULL;
+	struct dm_gvn		 g;
+	double			 t0, t1;
+
+	(void) args;
+
+	cfg = dm_ssa_open();
+	t0 = dm_dom_bench_ms();
+	dm_gvn(&g, cfg);
+	t1 = dm_dom_bench_ms();
+
+	printf("%d expressions, %d redundant (%d loads), %d redundant phis, "
+	    "%.3f ms\n", g.exprs, g.redundant, g.loads, g.phis, t1 - t0);
+
+	dm_gvn_free(&g);
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Number the values of the SSA form just built, walking the dominator tree
+ * so that an expression is only matched against ones that dominate it.
+ * The walk uses an explicit stack, like renaming does.
+ */
+void
+dm_gvn(struct dm_gvn *g, struct dm_cfg_node *cfg)
+{
+	struct dm_ssa_rename_frame	*frames = NULL, *f = NULL;
+	struct dm_cfg_node		*node = NULL;
+	int				 f_count = 0, f_cap = 16;
+	int				 insns = 0, v = 0;
+
+	dm_du_build(&g->du);
+
+	g->vn = xmalloc((g->du.n + 1) * sizeof(int));
+	for (v = 0; v < g->du.n; v++)
+		g->vn[v] = v;
+
+	/* At most one entry per instruction, keep the table half empty */
+	for (p = p_head; p != NULL; p = p->next)
+		insns += ((struct dm_cfg_node*)p->ptr)->i_count;
+	for (g->nslots = 16; g->nslots < (size_t)insns * 2; g->nslots *= 2)
+		;
+	g->table = xcalloc(g->nslots, sizeof(struct dm_gvn_entry));
+	g->log = xmalloc((insns + 1) * sizeof(size_t));
+	g->log_count = 0;
+	g->epoch = 0;
+	g->exprs = g->redundant = g->loads = g->phis = 0;
+
+	frames = xmalloc(f_cap * sizeof(*frames));
+	frames[f_count].node = cfg;
+	frames[f_count].child = 0;
+	frames[f_count++].log = g->log_count;
+	dm_gvn_block(g, cfg);
+
+	while (f_count) {
+		f = &frames[f_count - 1];
+		if (f->child < f->node->dc_count) {
+			node = f->node->dom_children[f->child++];
+			if (f_count == f_cap) {
+				f_cap *= 2;
+				frames = xrealloc(frames,
+				    f_cap * sizeof(*frames));
+			}
+			frames[f_count].node = node;
+			frames[f_count].child = 0;
+			frames[f_count++].log = g->log_count;
+			dm_gvn_block(g, node);
+			continue;
+		}
+		/*
+		 * Forget what this block added. Entries go in the reverse
+		 * of the order they came, so no later entry can have probed
+		 * past one being emptied.
+		 */
+		while (g->log_count > f->log)
+			g->table[g->log[--g->log_count]].used = 0;
+		f_count--;
+	}
+	free(frames);
+}
+
+void
+dm_gvn_free(struct dm_gvn *g)
+{
+	dm_du_free(&g->du);
+	free(g->vn);
+	free(g->table);
+	free(g->log);
+	g->vn = NULL;
+	g->table = NULL;
+	g->log = NULL;
+}
+
+void
+dm_gvn_block(struct dm_gvn *g, struct dm_cfg_node *n)
+{
+	int			 i = 0;
+
+	/* Loads are only matched within a block */
+	g->epoch++;
+
+	for (i = 0; i < n->pf_count; i++)
+		dm_gvn_phi(g, n, i);
+	for (i = 0; i < n->i_count; i++)
+		dm_gvn_insn(g, n, i);
+}
+
+/*
+ * A phi whose arguments all have the same value number (apart from the
+ * phi itself, round a loop) is that value
+ */
+void
+dm_gvn_phi(struct dm_gvn *g, struct dm_cfg_node *n, int i)
+{
+	struct phi_function	*phi = &n->phi_functions[i];
+	char			 name1[32], name2[32];
+	int			 def = 0, same = -1, vn = 0, ver = 0, j = 0;
+
+	def = DM_DU_VALUE(&g->du, phi->var, phi->index);
+	for (j = 0; (j < phi->arguments) && (j < n->p_count); j++) {
+		ver = phi->indexes[j];
+		if ((ver < 0) || (ver > indices[phi->var].count))
+			return;
+		vn = g->vn[DM_DU_VALUE(&g->du, phi->var, ver)];
+		if (vn == def)
+			continue;
+		if ((same != -1) && (same != vn))
+			return;
+		same = vn;
+	}
+	if (same == -1)
+		return;
+
+	g->vn[def] = same;
+	g->phis++;
+
+	dm_du_name(&g->du, def, name1, sizeof(name1));
+	dm_du_name(&g->du, same, name2, sizeof(name2));
+	printf("\tBlock %d: %s is always %s\n", n->post, name1, name2);
+}
+
+void
+dm_gvn_insn(struct dm_gvn *g, struct dm_cfg_node *n, int i)
+{
+	struct instruction	*insn = n->instructions[i];
+	struct ud		*u = &insn->ud;
+	struct dm_gvn_expr	 e;
+	struct dm_gvn_entry	*ent = NULL;
+	struct dm_du_site	 site;
+	int			 uses[DM_SSA_MAX_USES];
+	int			 def = 0, src = 0, k = 0;
+	size_t			 hash = 0;
+
+	if (dm_gvn_clobbers(u))
+		g->epoch++;
+
+	dm_du_insn(&g->du, insn, uses, &def);
+	if (def == -1)
+		return;
+
+	/* A copy is the value it copies */
+	if (dm_gvn_is_copy(u)) {
+		src = dm_gvn_reg(g, u->operand[1].base, insn->index[1][0]);
+		if (src != -1)
+			g->vn[def] = src;
+		return;
+	}
+
+	if ((!dm_gvn_hashable(u)) || (dm_gvn_expr(g, insn, &e) != DM_OK))
+		return;
+
+	site.node = n;
+	site.kind = DM_DU_INSN;
+	site.i = i;
+
+	g->exprs++;
+	hash = dm_gvn_hash(&e);
+	ent = dm_gvn_lookup(g, &e, hash);
+	if (ent->used) {
+		g->vn[def] = ent->vn;
+		g->redundant++;
+		for (k = 0; k < 3; k++)
+			if ((e.op[k].type == UD_OP_MEM) &&
+			    (u->mnemonic != UD_Ilea)) {
+				g->loads++;
+				break;
+			}
+		dm_gvn_show(&site, &ent->site);
+		return;
+	}
+
+	ent->used = 1;
+	ent->vn = g->vn[def];
+	ent->hash = hash;
+	memcpy(&ent->e, &e, sizeof(e));
+	ent->site = site;
+	g->log[g->log_count++] = ent - g->table;
+}
+
+/*
+ * Instructions whose result depends only on their operands. Anything
+ * else gets a value number of its own.
+ */
+int
+dm_gvn_hashable(struct ud *u)
+{
+	switch (u->mnemonic) {
+	case UD_Imov:
+	case UD_Imovzx:
+	case UD_Imovsx:
+	case UD_Imovsxd:
+	case UD_Ilea:
+	case UD_Iadd:
+	case UD_Isub:
+	case UD_Iand:
+	case UD_Ior:
+	case UD_Ixor:
+	case UD_Ishl:
+	case UD_Ishr:
+	case UD_Isar:
+	case UD_Inot:
+	case UD_Ineg:
+	case UD_Iinc:
+	case UD_Idec:
+		return (1);
+	case UD_Iimul:
+		/* The one operand form writes rdx too */
+		return (u->operand[1].type != UD_NONE);
+	default:
+		return (0);
+	}
+}
+
+int
+dm_gvn_commutes(struct ud *u)
+{
+	switch (u->mnemonic) {
+	case UD_Iadd:
+	case UD_Iand:
+	case UD_Ior:
+	case UD_Ixor:
+		return (1);
+	case UD_Iimul:
+		return (u->operand[2].type == UD_NONE);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Might this instruction write memory? Loads before it can't be reused
+ * after it.
+ */
+int
+dm_gvn_clobbers(struct ud *u)
+{
+	switch (u->mnemonic) {
+	case UD_Icall:
+	case UD_Ipush:
+	case UD_Ipusha:
+	case UD_Ipushad:
+	case UD_Ipushfw:
+	case UD_Ipushfd:
+	case UD_Ipushfq:
+	case UD_Ienter:
+	case UD_Istosb:
+	case UD_Istosw:
+	case UD_Istosd:
+	case UD_Istosq:
+	case UD_Imovsb:
+	case UD_Imovsw:
+	case UD_Imovsq:
+	case UD_Ixchg:
+	case UD_Icmpxchg:
+	case UD_Ixadd:
+	case UD_Isyscall:
+	case UD_Iint:
+		return (1);
+	case UD_Imovsd:
+		/* Either the string move or an SSE store */
+		return (u->operand[0].type != UD_OP_REG);
+	default:
+		return (instructions[u->mnemonic].write &&
+		    (u->operand[0].type == UD_OP_MEM));
+	}
+}
+
+/*
+ * A mov of a whole general purpose register to another
+ */
+int
+dm_gvn_is_copy(struct ud *u)
+{
+	return ((u->mnemonic == UD_Imov) &&
+	    (u->operand[0].type == UD_OP_REG) &&
+	    (u->operand[1].type == UD_OP_REG) &&
+	    (u->operand[0].size == u->dis_mode) &&
+	    (u->operand[1].size == u->dis_mode) &&
+	    (dm_ssa_reg(u->operand[0].base) < DM_REG_SEG) &&
+	    (dm_ssa_reg(u->operand[1].base) < DM_REG_SEG));
+}
+
+/*
+ * The value number of a version of a register, -1 if there isn't one
+ */
+int
+dm_gvn_reg(struct dm_gvn *g, enum ud_type r, int ver)
+{
+	int			 reg = dm_ssa_reg(r);
+
+	if ((reg == DM_REG_NONE) || (ver < 0) || (ver > indices[reg].count))
+		return (-1);
+	return (g->vn[DM_DU_VALUE(&g->du, reg, ver)]);
+}
+
+/*
+ * The expression an instruction computes, in terms of value numbers
+ */
+int
+dm_gvn_expr(struct dm_gvn *g, struct instruction *insn,
+    struct dm_gvn_expr *e)
+{
+	struct ud		*u = &insn->ud;
+	struct dm_gvn_opnd	 tmp;
+	int			 k = 0;
+
+	memset(e, 0, sizeof(*e));
+	e->mnemonic = u->mnemonic;
+	e->size = u->operand[0].size;
+	e->high = (u->operand[0].base >= UD_R_AH) &&
+	    (u->operand[0].base <= UD_R_BH);
+
+	/* xor eax, eax is mov eax, 0 */
+	if (dm_ssa_insn_zero(u)) {
+		if (e->size < 32)
+			return (DM_FAIL);
+		e->mnemonic = UD_Imov;
+		e->op[1].type = UD_OP_IMM;
+		e->op[1].size = e->size;
+		return (DM_OK);
+	}
+
+	/* The old value of the destination only matters if it is read */
+	if (dm_ssa_insn_rmw(u) &&
+	    (dm_gvn_operand(g, insn, 0, &e->op[0]) != DM_OK))
+		return (DM_FAIL);
+	for (k = 1; k < 3; k++)
+		if (dm_gvn_operand(g, insn, k, &e->op[k]) != DM_OK)
+			return (DM_FAIL);
+
+	if (dm_gvn_commutes(u) &&
+	    (memcmp(&e->op[0], &e->op[1], sizeof(tmp)) > 0)) {
+		memcpy(&tmp, &e->op[0], sizeof(tmp));
+		memcpy(&e->op[0], &e->op[1], sizeof(tmp));
+		memcpy(&e->op[1], &tmp, sizeof(tmp));
+	}
+
+	return (DM_OK);
+}
+
+int
+dm_gvn_operand(struct dm_gvn *g, struct instruction *insn, int k,
+    struct dm_gvn_opnd *op)
+{
+	struct ud_operand	*o = &insn->ud.operand[k];
+	int			 ver = insn->index[k][0];
+
+	op->type = o->type;
+	op->size = o->size;
+	switch (o->type) {
+	case UD_NONE:
+		return (DM_OK);
+	case UD_OP_REG:
+		if ((k == 0) && instructions[insn->ud.mnemonic].write)
+			ver = insn->index[0][1];
+		op->base = dm_gvn_reg(g, o->base, ver);
+		op->high = (o->base >= UD_R_AH) && (o->base <= UD_R_BH);
+		return ((op->base == -1) ? DM_FAIL : DM_OK);
+	case UD_OP_IMM:
+		op->lval = dm_sccp_sext(o, o->size);
+		return (DM_OK);
+	case UD_OP_CONST:
+		op->lval = o->lval.udword;
+		return (DM_OK);
+	case UD_OP_MEM:
+		op->base = op->index = -1;
+		if (o->base == UD_R_RIP) {
+			/* Absolute, so different instructions match */
+			op->base = -2;
+			op->lval = insn->ud.pc;
+		} else if ((o->base != UD_NONE) && ((op->base =
+		    dm_gvn_reg(g, o->base, insn->index[k][0])) == -1))
+			return (DM_FAIL);
+		if ((o->index != UD_NONE) && ((op->index =
+		    dm_gvn_reg(g, o->index, insn->index[k][1])) == -1))
+			return (DM_FAIL);
+		if (o->offset)
+			op->lval += dm_sccp_sext(o, o->offset);
+		op->scale = o->scale;
+		op->seg = insn->ud.pfx_seg;
+		if (insn->ud.mnemonic != UD_Ilea)
+			op->epoch = g->epoch;
+		return (DM_OK);
+	default:
+		return (DM_FAIL);
+	}
+}
+
+/* FNV-1a */
+size_t
+dm_gvn_hash(struct dm_gvn_expr *e)
+{
+	const unsigned char	*b = (const unsigned char *) e;
+	size_t			 h = 2166136261u, i = 0;
+
+	for (i = 0; i < sizeof(*e); i++)
+		h = (h ^ b[i]) * 16777619u;
+
+	return (h);
+}
+
+/*
+ * The entry for an expression, or the empty slot it would go in
+ */
+struct dm_gvn_entry *
+dm_gvn_lookup(struct dm_gvn *g, struct dm_gvn_expr *e, size_t hash)
+{
+	struct dm_gvn_entry	*ent = NULL;
+	size_t			 h = 0;
+
+	for (h = hash;; h++) {
+		ent = &g->table[h & (g->nslots - 1)];
+		if (!ent->used)
+			return (ent);
+		if ((ent->hash == hash) &&
+		    (memcmp(&ent->e, e, sizeof(*e)) == 0))
+			return (ent);
+	}
+}
+
+void
+dm_gvn_show(struct dm_du_site *site, struct dm_du_site *same)
+{
+	char			 text[256];
+
+	dm_du_site_text(site, text, sizeof(text));
+	printf("\t%s\n", text);
+	dm_du_site_text(same, text, sizeof(text));
+	printf("\t    same as %s\n", text);
+}
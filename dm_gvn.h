@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_GVN_H
+#define __DM_GVN_H
+
+#include "common.h"
+#include "dm_du.h"
+
+/*
+ * An operand of a hashed expression. Registers are given by value number
+ * (and how much of the register is read), memory by its address and the
+ * memory epoch it was read in. Unused fields must be zero, expressions
+ * are hashed and compared as bytes.
+ */
+struct dm_gvn_opnd {
+	int			 type;	/* UD_OP_* */
+	int			 size;
+	int			 high;	/* ah .. bh */
+	int			 base;	/* Value numbers, -1 if none */
+	int			 index;
+	int			 scale;
+	int			 seg;
+	int			 epoch;
+	uint64_t		 lval;	/* Immediate, or displacement */
+};
+
+struct dm_gvn_expr {
+	int			 mnemonic;
+	int			 size;	/* Of the destination */
+	int			 high;
+	struct dm_gvn_opnd	 op[3];
+};
+
+struct dm_gvn_entry {
+	int			 used;
+	int			 vn;
+	size_t			 hash;
+	struct dm_gvn_expr	 e;
+	struct dm_du_site	 site;
+};
+
+/*
+ * Dominator based value numbering. vn[value] is the value number of each
+ * SSA value, the value number of the first value found to be equal to it.
+ * Expressions seen in the blocks dominating the current one are in an
+ * open addressing table; entries are logged as they are added and taken
+ * out again, in reverse, as the walk leaves the block that added them.
+ */
+struct dm_gvn {
+	struct dm_du		 du;
+	int			*vn;
+	struct dm_gvn_entry	*table;
+	size_t			 nslots;  /* Power of 2 */
+	size_t			*log;	  /* Slots in the order filled */
+	int			 log_count;
+	int			 epoch;	  /* Bumped by anything writing memory */
+	int			 exprs;
+	int			 redundant;
+	int			 loads;
+	int			 phis;
+};
+
+int		dm_cmd_gvn(char **args);
+void		dm_gvn(struct dm_gvn *g, struct dm_cfg_node *cfg);
+void		dm_gvn_free(struct dm_gvn *g);
+void		dm_gvn_block(struct dm_gvn *g, struct dm_cfg_node *n);
+void		dm_gvn_phi(struct dm_gvn *g, struct dm_cfg_node *n, int i);
+void		dm_gvn_insn(struct dm_gvn *g, struct dm_cfg_node *n, int i);
+int		dm_gvn_hashable(struct ud *u);
+int		dm_gvn_commutes(struct ud *u);
+int		dm_gvn_clobbers(struct ud *u);
+int		dm_gvn_is_copy(struct ud *u);
+int		dm_gvn_reg(struct dm_gvn *g, enum ud_type r, int ver);
+int		dm_gvn_expr(struct dm_gvn *g, struct instruction *insn,
+		    struct dm_gvn_expr *e);
+int		dm_gvn_operand(struct dm_gvn *g, struct instruction *insn,
+		    int k, struct dm_gvn_opnd *op);
+size_t		dm_gvn_hash(struct dm_gvn_expr *e);
+struct dm_gvn_entry	*dm_gvn_lookup(struct dm_gvn *g,
+			    struct dm_gvn_expr *e, size_t hash);
+void		dm_gvn_show(struct dm_du_site *site, struct dm_du_site *same);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "dm_live.h"
+#include "dm_ssa.h"
+#include "dm_util.h"
+#include "dm_bitset.h"
+
+extern struct ptrs *p_head;
+extern struct ptrs *p;
+extern int p_length;
+extern void **rpost;
+
+/*
+ * Show what is live in to and out of each block of the current function
+ */
+int
+dm_cmd_live(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_cfg_node	*node = NULL;
+	struct dm_live		 l;
+	double			 t0, t1;
+	int			 v = 0;
+
+	(void) args;
+
+	dm_init_cfg();
+	dm_recover_cfg();
+
+	t0 = dm_dom_bench_ms();
+	dm_live(&l);
+	t1 = dm_dom_bench_ms();
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		printf("Block %d (start: " NADDR_FMT ", end: " NADDR_FMT
+		    ")\n", node->post, node->start, node->end);
+		dm_live_print_set("Live in", DM_LIVE_SET(&l, l.in, v), l.words);
+		dm_live_print_set("Live out", DM_LIVE_SET(&l, l.out, v),
+		    l.words);
+	}
+	printf("%d blocks, %d block evaluations, %.3f ms\n", p_length,
+	    l.evals, t1 - t0);
+
+	dm_live_free(&l);
+	dm_free_cfg();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Print a set of names with its size, which is the register pressure at
+ * that point
+ */
+int
+dm_live_print_set(char *what, uint64_t *set, int words)
+{
+	int			 i = 0, count = 0;
+
+	for (i = 0; i < words; i++)
+		count += __builtin_popcountll(set[i]);
+
+	printf("\t%s (%d):", what, count);
+	for (i = 0; i < DM_REG_COUNT; i++)
+		if (DM_BITSET_ISSET(set, i))
+			printf(" %s", dm_ssa_reg_name(i));
+	printf("\n");
+
+	return (count);
+}
+
+/*
+ * Full liveness of the current CFG
+ */
+void
+dm_live(struct dm_live *l)
+{
+	dm_live_init(l);
+	dm_live_local(l);
+	dm_live_solve(l);
+}
+
+void
+dm_live_init(struct dm_live *l)
+{
+	size_t			 sz;
+
+	l->n = p_length;
+	l->words = DM_BITSET_WORDS(DM_REG_COUNT);
+	l->evals = 0;
+	sz = (size_t)l->n * l->words;
+	l->use = xcalloc(sz, sizeof(uint64_t));
+	l->def = xcalloc(sz, sizeof(uint64_t));
+	l->in = xcalloc(sz, sizeof(uint64_t));
+	l->out = xcalloc(sz, sizeof(uint64_t));
+}
+
+/*
+ * Find what each block uses before defining, and what it defines
+ */
+void
+dm_live_local(struct dm_live *l)
+{
+	struct dm_cfg_node	*n = NULL;
+	uint64_t		*use = NULL, *def = NULL;
+	int			 uses[DM_SSA_MAX_USES], nuses = 0;
+	int			 reg = 0, i = 0, v = 0;
+
+	for (v = 0; v < l->n; v++) {
+		n = (struct dm_cfg_node*)rpost[v];
+		use = DM_LIVE_SET(l, l->use, v);
+		def = DM_LIVE_SET(l, l->def, v);
+		for (dm_seek(n->start); ud.pc - ud_insn_len(&ud) != n->end;) {
+			ud_disassemble(&ud);
+			nuses = dm_ssa_insn_vars(&ud, uses, &reg);
+			for (i = 0; i < nuses; i++)
+				if (!DM_BITSET_ISSET(def, uses[i]))
+					DM_BITSET_SET(use, uses[i]);
+			if (reg != -1)
+				DM_BITSET_SET(def, reg);
+		}
+	}
+}
+
+/*
+ * Liveness is a backwards union problem on dm_flow. Flowing backwards,
+ * a block's 'in' is what is live out of it and its 'out' is what is live
+ * into it, so the flow results land straight in l->out and l->in.
+ */
+void
+dm_live_solve(struct dm_live *l)
+{
+	struct dm_flow		 f;
+
+	memset(&f, 0, sizeof(f));
+	dm_flow_bitset(&f, DM_REG_COUNT, 1);
+	f.dir = DM_FLOW_BACKWARD;
+	f.threads = dm_threads;
+	f.ctx = l;
+	f.transfer = dm_live_transfer;
+	f.in = (char *)l->out;
+	f.out = (char *)l->in;
+
+	dm_flow_solve(&f);
+	l->evals = f.evals;
+}
+
+/*
+ * in(n) = use(n) + (out(n) - def(n))
+ */
+int
+dm_live_transfer(struct dm_flow *f, int v, void *live_out, void *live_in)
+{
+	struct dm_live		*l = f->ctx;
+	uint64_t		*out = live_out, *in = live_in, *use, *def;
+	uint64_t		 w, changed = 0;
+	int			 k;
+
+	use = DM_LIVE_SET(l, l->use, v);
+	def = DM_LIVE_SET(l, l->def, v);
+	for (k = 0; k < l->words; k++) {
+		w = use[k] | (out[k] & ~def[k]);
+		changed |= w ^ in[k];
+		in[k] = w;
+	}
+
+	return (changed != 0);
+}
+
+void
+dm_live_free(struct dm_live *l)
+{
+	free(l->use);
+	free(l->def);
+	free(l->in);
+	free(l->out);
+	l->use = l->def = l->in = l->out = NULL;
+}
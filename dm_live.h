@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_LIVE_H
+#define __DM_LIVE_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "dm_cfg.h"
+#include "dm_flow.h"
+
+/*
+ * Liveness of the dense registers (see dm_ssa.h) at block boundaries.
+ * Each set is a bitset of 'words' words, one set per block in reverse
+ * post-order, so block v's live in set is DM_LIVE_SET(l, l->in, v).
+ */
+struct dm_live {
+	int			 n;	 /* Blocks */
+	int			 words;	 /* Words per set */
+	uint64_t		*use;	 /* Used before any def in block */
+	uint64_t		*def;	 /* Defined in block */
+	uint64_t		*in;	 /* Live into block */
+	uint64_t		*out;	 /* Live out of block */
+	int			 evals;	 /* Transfer function calls */
+};
+
+#define DM_LIVE_SET(l, set, v)	((set) + (size_t)(v) * (l)->words)
+
+int			dm_cmd_live(char **args);
+void			dm_live(struct dm_live *l);
+void			dm_live_init(struct dm_live *l);
+void			dm_live_local(struct dm_live *l);
+void			dm_live_solve(struct dm_live *l);
+int			dm_live_transfer(struct dm_flow *f, int v,
+			    void *live_out, void *live_in);
+void			dm_live_free(struct dm_live *l);
+int			dm_live_print_set(char *what, uint64_t *set, int words);
+
+#endif
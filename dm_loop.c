@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "dm_loop.h"
+#include "dm_dis.h"
+#include "dm_util.h"
+
+extern struct ptrs *p_head;
+extern struct ptrs *p;
+extern int p_length;
+extern void **rpost;
+
+struct dm_loop	*loops = NULL;
+int		 loop_count = 0;
+
+/*
+ * Show the loop nesting forest of the current function
+ */
+int
+dm_cmd_loops(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_cfg_node	*cfg = NULL;
+	struct dm_loop		*l = NULL;
+	char			*types[] = {"-", "self", "reducible",
+				    "irreducible"};
+	char			 hdr[64];
+	int			 i = 0;
+
+	(void) args;
+
+	/* Initialise structures */
+	dm_init_cfg();
+
+	/* Get CFG */
+	cfg = dm_recover_cfg();
+
+	/* Find the loops */
+	dm_loops(cfg);
+
+	if (!loop_count)
+		printf("No loops\n");
+	else {
+		printf("\n%s\n", DM_RULE);
+		printf("%-4s | %-24s | %-5s | %-6s | %-6s | %-6s | %s\n",
+		    "Loop", "Header", "Depth", "Parent", "Blocks", "Bytes",
+		    "Type");
+		printf("%s\n", DM_RULE);
+		for (i = 0; i < loop_count; i++) {
+			l = &loops[i];
+			/* Indent nested loops under their parents */
+			snprintf(hdr, sizeof(hdr), "%*s" NADDR_FMT,
+			    2 * (l->depth - 1), "", l->header->start);
+			printf("%-4d | %-24s | %-5d | ", i, hdr, l->depth);
+			if (l->parent == -1)
+				printf("%-6s | ", "-");
+			else
+				printf("%-6d | ", l->parent);
+			printf("%-6d | %-6d | %s\n", l->blocks, l->bytes,
+			    types[l->type]);
+		}
+		printf("%s\n\n", DM_RULE);
+	}
+
+	dm_loops_free();
+
+	/* Free all CFG structures */
+	dm_free_cfg();
+
+	/* Rewind back */
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Find all loops of the CFG, set each node's innermost loop and total
+ * up blocks and bytes per loop, nested loops included
+ */
+void
+dm_loops(struct dm_cfg_node *cfg)
+{
+	struct dm_graph		 g;
+	struct dm_cfg_node	*node = NULL;
+	int			*header = NULL, *type = NULL, *loop_of = NULL;
+	int			 v = 0, l = 0, bytes = 0;
+
+	dm_cfg_graph(&g);
+	header = xmalloc(p_length * sizeof(int));
+	type = xmalloc(p_length * sizeof(int));
+	dm_graph_loops(&g, cfg->rpost, header, type);
+	dm_graph_free(&g);
+
+	/* One loop per header, outer loops come first in reverse post-order */
+	loop_of = xmalloc(p_length * sizeof(int));
+	loop_count = 0;
+	for (v = 0; v < p_length; v++) {
+		loop_of[v] = -1;
+		if (type[v] != DM_LOOP_NONE)
+			loop_of[v] = loop_count++;
+	}
+
+	loops = xcalloc(loop_count, sizeof(struct dm_loop));
+	for (v = 0; v < p_length; v++) {
+		if ((l = loop_of[v]) == -1)
+			continue;
+		loops[l].header = (struct dm_cfg_node*)rpost[v];
+		loops[l].type = type[v];
+		loops[l].parent = (header[v] == -1) ? -1 : loop_of[header[v]];
+	}
+	for (l = 0; l < loop_count; l++) {
+		loops[l].depth = 1;
+		for (v = loops[l].parent; v != -1; v = loops[v].parent)
+			loops[l].depth++;
+	}
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		node->loop = (loop_of[v] != -1) ? loop_of[v] :
+		    ((header[v] == -1) ? -1 : loop_of[header[v]]);
+		if (node->loop == -1)
+			continue;
+		bytes = dm_loop_block_bytes(node);
+		for (l = node->loop; l != -1; l = loops[l].parent) {
+			loops[l].blocks++;
+			loops[l].bytes += bytes;
+		}
+	}
+
+	free(header);
+	free(type);
+	free(loop_of);
+}
+
+void
+dm_loops_free()
+{
+	free(loops);
+	loops = NULL;
+	loop_count = 0;
+}
+
+/*
+ * Size of a block in bytes. Non-local blocks are just placeholders for
+ * jumps out of the function, so they have no size.
+ */
+int
+dm_loop_block_bytes(struct dm_cfg_node *node)
+{
+	if (node->nonlocal)
+		return (0);
+
+	dm_seek(node->end);
+	ud_disassemble(&ud);
+
+	return (node->end - node->start + ud_insn_len(&ud));
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_LOOP_H
+#define __DM_LOOP_H
+
+#include "common.h"
+#include "dm_cfg.h"
+
+struct dm_loop {
+	struct dm_cfg_node	*header;
+	int			 parent; /* Enclosing loop, -1 if outermost */
+	int			 depth;	 /* 1 if outermost */
+	int			 type;	 /* DM_LOOP_* */
+	int			 blocks; /* Blocks in loop and nested loops */
+	int			 bytes;	 /* Instruction bytes in those blocks */
+};
+
+extern struct dm_loop	*loops;
+extern int		 loop_count;
+
+int			dm_cmd_loops(char **args);
+void			dm_loops(struct dm_cfg_node *cfg);
+void			dm_loops_free();
+int			dm_loop_block_bytes(struct dm_cfg_node *node);
+
+#endif
@@ -0,0 +1,677 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "dm_sccp.h"
+#include "dm_dwarf.h"
+#include "dm_elf.h"
+#include "dm_util.h"
+
+extern struct dm_instruction_se *instructions;
+extern struct ptrs		*p_head;
+extern struct ptrs		*p;
+extern int			 p_length;
+extern void			**rpost;
+extern struct dm_ssa_index	*indices;
+
+/*
+ * Find the constant registers and dead branches of the current function.
+ * Register-indirect jumps to a constant are handed to CFG recovery and
+ * the function is looked at again, until no new targets turn up.
+ */
+int
+dm_cmd_sccp(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_sccp		 s;
+	int			 round = 0;
+	double			 t0, t1;
+
+	(void) args;
+
+	/* Targets found for another function are no use here */
+	dm_cfg_free_targets();
+	for (round = 0; ; round++) {
+		dm_ssa_open();
+		t0 = dm_dom_bench_ms();
+		dm_sccp(&s);
+		t1 = dm_dom_bench_ms();
+		if ((dm_sccp_resolve(&s, 0) == 0) ||
+		    (round == DM_SCCP_ROUNDS - 1))
+			break;
+		dm_sccp_free(&s);
+		dm_ssa_close();
+		dm_seek(addr);
+	}
+
+	dm_sccp_report(&s);
+	printf("%d values, %d evaluations, %d CFG rebuilds, %.3f ms\n",
+	    s.du.n, s.visits, round, t1 - t0);
+
+	dm_sccp_free(&s);
+	dm_ssa_close();
+	dm_cfg_free_targets();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Propagate constants through the SSA form just built. There is a
+ * worklist of values whose lattice state has dropped, whose uses are then
+ * looked at again, and one of blocks reached along a newly executable
+ * edge. Each value drops at most twice and each edge is added once, so the
+ * work is proportional to the def-use edges.
+ */
+void
+dm_sccp(struct dm_sccp *s)
+{
+	struct dm_cfg_node	*node = NULL;
+	struct dm_du_site	*site = NULL;
+	int			 v = 0, c = 0, i = 0, m = 0;
+
+	dm_du_build(&s->du);
+
+	s->state = xcalloc(s->du.n, sizeof(char));
+	s->val = xcalloc(s->du.n, sizeof(uint64_t));
+	s->v_queued = xcalloc(s->du.n, sizeof(char));
+	s->vwork = xmalloc((s->du.n + 1) * sizeof(int));
+	s->v_count = 0;
+	s->visits = 0;
+
+	/* Nothing is known of what the function is called with */
+	for (v = 0; v < s->du.n; v++)
+		if (s->du.def[v].kind == DM_DU_ENTRY)
+			s->state[v] = DM_SCCP_BOTTOM;
+
+	s->out_off = xcalloc(p_length + 1, sizeof(int));
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		for (c = 0; node->children[c] != NULL; c++)
+			m++;
+		s->out_off[v + 1] = m;
+	}
+	s->edge_exec = xcalloc(m + 1, sizeof(char));
+	s->ework = xmalloc((m + 1) * sizeof(int));
+	s->e_count = 0;
+	s->block_exec = xcalloc(p_length + 1, sizeof(char));
+
+	if (p_length) {
+		s->block_exec[0] = 1;
+		dm_sccp_visit_block(s, (struct dm_cfg_node*)rpost[0]);
+	}
+
+	while (s->e_count || s->v_count) {
+		if (s->e_count) {
+			v = s->ework[--s->e_count];
+			node = (struct dm_cfg_node*)rpost[v];
+			if (!s->block_exec[v]) {
+				s->block_exec[v] = 1;
+				dm_sccp_visit_block(s, node);
+			} else {
+				/* Only the phis can see the new edge */
+				for (i = 0; i < node->pf_count; i++)
+					dm_sccp_visit_phi(s, node, i);
+			}
+			continue;
+		}
+
+		v = s->vwork[--s->v_count];
+		s->v_queued[v] = 0;
+		for (i = s->du.use_idx[v]; i < s->du.use_idx[v + 1]; i++) {
+			site = &s->du.use[i];
+			node = site->node;
+			if (!s->block_exec[node->rpost])
+				continue;
+			if (site->kind == DM_DU_PHI) {
+				dm_sccp_visit_phi(s, node, site->i);
+				continue;
+			}
+			dm_sccp_visit_insn(s, node, site->i);
+			/* The branch and what sets its flags */
+			if (site->i >= node->i_count - 2)
+				dm_sccp_visit_branch(s, node);
+		}
+	}
+}
+
+void
+dm_sccp_free(struct dm_sccp *s)
+{
+	dm_du_free(&s->du);
+	free(s->state);
+	free(s->val);
+	free(s->v_queued);
+	free(s->vwork);
+	free(s->out_off);
+	free(s->edge_exec);
+	free(s->ework);
+	free(s->block_exec);
+	s->state = s->v_queued = s->edge_exec = s->block_exec = NULL;
+	s->val = NULL;
+	s->vwork = s->out_off = s->ework = NULL;
+}
+
+/*
+ * A block has become executable
+ */
+void
+dm_sccp_visit_block(struct dm_sccp *s, struct dm_cfg_node *n)
+{
+	int			 i = 0;
+
+	for (i = 0; i < n->pf_count; i++)
+		dm_sccp_visit_phi(s, n, i);
+	for (i = 0; i < n->i_count; i++)
+		dm_sccp_visit_insn(s, n, i);
+	dm_sccp_visit_branch(s, n);
+}
+
+/*
+ * A phi is the meet of its arguments along executable edges
+ */
+void
+dm_sccp_visit_phi(struct dm_sccp *s, struct dm_cfg_node *n, int i)
+{
+	struct phi_function	*phi = &n->phi_functions[i];
+	uint64_t		 res = 0;
+	int			 state = DM_SCCP_TOP, j = 0, ver = 0, v = 0;
+
+	s->visits++;
+	for (j = 0; (j < phi->arguments) && (j < n->p_count); j++) {
+		if (!dm_sccp_edge_exec(s, n->parents[j], n))
+			continue;
+		ver = phi->indexes[j];
+		if ((ver < 0) || (ver > indices[phi->var].count)) {
+			state = DM_SCCP_BOTTOM;
+			break;
+		}
+		v = DM_DU_VALUE(&s->du, phi->var, ver);
+		if (s->state[v] == DM_SCCP_TOP)
+			continue;
+		if ((s->state[v] == DM_SCCP_BOTTOM) ||
+		    ((state == DM_SCCP_CONST) && (s->val[v] != res))) {
+			state = DM_SCCP_BOTTOM;
+			break;
+		}
+		state = DM_SCCP_CONST;
+		res = s->val[v];
+	}
+	dm_sccp_lower(s, DM_DU_VALUE(&s->du, phi->var, phi->index), state,
+	    res);
+}
+
+/*
+ * Evaluate an instruction that defines a register. Only mov, lea and the
+ * common integer ops are understood, anything else defines a non-constant.
+ */
+void
+dm_sccp_visit_insn(struct dm_sccp *s, struct dm_cfg_node *n, int i)
+{
+	struct instruction	*insn = n->instructions[i];
+	struct ud		*u = &insn->ud;
+	uint64_t		 a = 0, b = 0, res = 0;
+	int			 uses[DM_SSA_MAX_USES];
+	int			 defs[DM_SSA_MAX_CLOBBERS];
+	int			 def = 0, state = 0, sa = 0, sb = 0, bits = 0;
+	int			 k = 0, n_defs = 0;
+
+	s->visits++;
+	/* Nothing is known of what is written implicitly */
+	n_defs = dm_du_insn_clobbers(&s->du, insn, defs);
+	for (k = 0; k < n_defs; k++)
+		dm_sccp_lower(s, defs[k], DM_SCCP_BOTTOM, 0);
+
+	dm_du_insn(&s->du, insn, uses, &def);
+	if (def == -1)
+		return;
+
+	bits = u->operand[0].size;
+	if (dm_ssa_insn_zero(u))
+		state = DM_SCCP_CONST;
+	else switch (u->mnemonic) {
+	case UD_Imov:
+		state = dm_sccp_operand(s, insn, 1, &res);
+		break;
+	case UD_Ilea:
+		state = dm_sccp_lea(s, insn, &res);
+		break;
+	case UD_Iadd:
+	case UD_Isub:
+	case UD_Iand:
+	case UD_Ior:
+	case UD_Ixor:
+	case UD_Ishl:
+		sa = dm_sccp_operand(s, insn, 0, &a);
+		sb = dm_sccp_operand(s, insn, 1, &b);
+		if ((sa == DM_SCCP_BOTTOM) || (sb == DM_SCCP_BOTTOM))
+			state = DM_SCCP_BOTTOM;
+		else if ((sa == DM_SCCP_TOP) || (sb == DM_SCCP_TOP))
+			state = DM_SCCP_TOP;
+		else
+			state = DM_SCCP_CONST;
+
+		if (u->mnemonic == UD_Iadd)
+			res = a + b;
+		else if (u->mnemonic == UD_Isub)
+			res = a - b;
+		else if (u->mnemonic == UD_Iand)
+			res = a & b;
+		else if (u->mnemonic == UD_Ior)
+			res = a | b;
+		else if (u->mnemonic == UD_Ixor)
+			res = a ^ b;
+		else
+			res = a << (b & ((bits == 64) ? 63 : 31));
+		break;
+	default:
+		state = DM_SCCP_BOTTOM;
+		break;
+	}
+
+	state = dm_sccp_write(s, insn, state, res, &res);
+	dm_sccp_lower(s, def, state, res);
+}
+
+/*
+ * Work out which successors of a block can be reached. A conditional
+ * jump straight after a cmp or test of constants goes only one way.
+ */
+void
+dm_sccp_visit_branch(struct dm_sccp *s, struct dm_cfg_node *n)
+{
+	struct instruction	*last = NULL;
+	int			 c = 0, taken = -1;
+
+	if (n->i_count >= 2) {
+		last = n->instructions[n->i_count - 1];
+		if ((instructions[last->ud.mnemonic].jump == 2) &&
+		    (last->ud.mnemonic != UD_Icall) &&
+		    (n->children[0] != NULL) && (n->children[1] != NULL))
+			taken = dm_sccp_cond(s, n->instructions[n->i_count - 2],
+			    last->ud.mnemonic);
+	}
+
+	/* The jump target is child 0, the fall through child 1 */
+	switch (taken) {
+	case -2:
+		break;
+	case 1:
+		dm_sccp_edge(s, n, 0);
+		break;
+	case 0:
+		dm_sccp_edge(s, n, 1);
+		break;
+	default:
+		for (c = 0; n->children[c] != NULL; c++)
+			dm_sccp_edge(s, n, c);
+		break;
+	}
+}
+
+/*
+ * Child c of n is reachable
+ */
+void
+dm_sccp_edge(struct dm_sccp *s, struct dm_cfg_node *n, int c)
+{
+	int			 e = s->out_off[n->rpost] + c;
+
+	if (s->edge_exec[e])
+		return;
+	s->edge_exec[e] = 1;
+	s->ework[s->e_count++] = n->children[c]->rpost;
+}
+
+int
+dm_sccp_edge_exec(struct dm_sccp *s, struct dm_cfg_node *from,
+    struct dm_cfg_node *to)
+{
+	int			 c = 0;
+
+	for (c = 0; from->children[c] != NULL; c++)
+		if ((from->children[c] == to) &&
+		    (s->edge_exec[s->out_off[from->rpost] + c]))
+			return (1);
+	return (0);
+}
+
+/*
+ * Move a value down the lattice, never up
+ */
+void
+dm_sccp_lower(struct dm_sccp *s, int v, int state, uint64_t val)
+{
+	if ((s->state[v] == DM_SCCP_BOTTOM) || (state == DM_SCCP_TOP))
+		return;
+	if ((s->state[v] == DM_SCCP_CONST) && (state == DM_SCCP_CONST) &&
+	    (s->val[v] == val))
+		return;
+	if (s->state[v] == DM_SCCP_CONST)
+		state = DM_SCCP_BOTTOM;
+
+	s->state[v] = state;
+	s->val[v] = val;
+	if (!s->v_queued[v]) {
+		s->v_queued[v] = 1;
+		s->vwork[s->v_count++] = v;
+	}
+}
+
+/*
+ * The state of a version of a register, and if constant the value of the
+ * part of it named by r (eax, ah..)
+ */
+int
+dm_sccp_reg(struct dm_sccp *s, enum ud_type r, int ver, uint64_t *val)
+{
+	int			 reg = dm_ssa_reg(r), v = 0;
+
+	if ((reg == DM_REG_NONE) || (ver < 0) || (ver > indices[reg].count))
+		return (DM_SCCP_BOTTOM);
+
+	v = DM_DU_VALUE(&s->du, reg, ver);
+	if (s->state[v] != DM_SCCP_CONST)
+		return (s->state[v]);
+
+	*val = s->val[v];
+	if ((r >= UD_R_AH) && (r <= UD_R_BH))
+		*val >>= 8;
+	*val &= dm_sccp_mask(dm_ssa_reg_width(r));
+	return (DM_SCCP_CONST);
+}
+
+/*
+ * The value of an operand as read by an instruction. Memory is not
+ * modelled.
+ */
+int
+dm_sccp_operand(struct dm_sccp *s, struct instruction *insn, int k,
+    uint64_t *val)
+{
+	struct ud_operand	*op = &insn->ud.operand[k];
+	int			 ver = insn->index[k][0];
+
+	switch (op->type) {
+	case UD_OP_REG:
+		/* The version before the write, if it is read */
+		if ((k == 0) && instructions[insn->ud.mnemonic].write)
+			ver = insn->index[0][1];
+		return (dm_sccp_reg(s, op->base, ver, val));
+	case UD_OP_IMM:
+		*val = dm_sccp_sext(op, op->size);
+		return (DM_SCCP_CONST);
+	case UD_OP_CONST:
+		*val = op->lval.udword;
+		return (DM_SCCP_CONST);
+	default:
+		return (DM_SCCP_BOTTOM);
+	}
+}
+
+/*
+ * The address computed by a lea. rip relative addresses are known; like
+ * the immediates they are mixed with they are virtual addresses, not the
+ * file offsets the disassembler counts in.
+ */
+int
+dm_sccp_lea(struct dm_sccp *s, struct instruction *insn, uint64_t *val)
+{
+	struct ud_operand	*op = &insn->ud.operand[1];
+	uint64_t		 base = 0, index = 0;
+	int			 sb = DM_SCCP_CONST, si = DM_SCCP_CONST;
+
+	if (op->type != UD_OP_MEM)
+		return (DM_SCCP_BOTTOM);
+
+	if (op->base == UD_R_RIP) {
+		if (dm_vaddr_from_offset(insn->ud.pc, &base) != DM_OK)
+			return (DM_SCCP_BOTTOM);
+	} else if (op->base != UD_NONE)
+		sb = dm_sccp_reg(s, op->base, insn->index[1][0], &base);
+	if (op->index != UD_NONE)
+		si = dm_sccp_reg(s, op->index, insn->index[1][1], &index);
+
+	if ((sb == DM_SCCP_BOTTOM) || (si == DM_SCCP_BOTTOM))
+		return (DM_SCCP_BOTTOM);
+	if ((sb == DM_SCCP_TOP) || (si == DM_SCCP_TOP))
+		return (DM_SCCP_TOP);
+
+	*val = base + index * (op->scale ? op->scale : 1);
+	if (op->offset)
+		*val += dm_sccp_sext(op, op->offset);
+	return (DM_SCCP_CONST);
+}
+
+/*
+ * The whole register after writing res to the destination. 32 bit
+ * writes zero extend; 8 and 16 bit writes keep the rest of the old value,
+ * so that has to be constant too.
+ */
+int
+dm_sccp_write(struct dm_sccp *s, struct instruction *insn, int state,
+    uint64_t res, uint64_t *val)
+{
+	enum ud_type		 r = insn->ud.operand[0].base;
+	uint64_t		 old = 0, mask = 0;
+	int			 bits = dm_ssa_reg_width(r), shift = 0;
+	int			 reg = dm_ssa_reg(r);
+
+	if (state != DM_SCCP_CONST)
+		return (state);
+
+	mask = dm_sccp_mask(bits);
+	if ((bits >= 32) || (reg >= DM_REG_SEG)) {
+		*val = res & mask;
+		return (DM_SCCP_CONST);
+	}
+
+	state = dm_sccp_reg(s, UD_R_RAX + reg - DM_REG_GPR,
+	    insn->index[0][1], &old);
+	if (state != DM_SCCP_CONST)
+		return (state);
+
+	if ((r >= UD_R_AH) && (r <= UD_R_BH))
+		shift = 8;
+	*val = (old & ~(mask << shift)) | ((res & mask) << shift);
+	return (DM_SCCP_CONST);
+}
+
+/*
+ * Does a conditional jump go to its target, given the instruction just
+ * before it? 1 if it does, 0 if it falls through, -1 if it could do
+ * either and -2 if we don't know yet.
+ */
+int
+dm_sccp_cond(struct dm_sccp *s, struct instruction *flags,
+    enum ud_mnemonic_code jcc)
+{
+	struct ud		*u = &flags->ud;
+	uint64_t		 a = 0, b = 0, r = 0, mask = 0;
+	int			 sa = 0, sb = 0, bits = u->operand[0].size;
+	int			 zf = 0, sf = 0, cf = 0, of = 0;
+
+	if (((u->mnemonic != UD_Icmp) && (u->mnemonic != UD_Itest)) ||
+	    (bits == 0))
+		return (-1);
+
+	sa = dm_sccp_operand(s, flags, 0, &a);
+	sb = dm_sccp_operand(s, flags, 1, &b);
+	if ((sa == DM_SCCP_BOTTOM) || (sb == DM_SCCP_BOTTOM))
+		return (-1);
+	if ((sa == DM_SCCP_TOP) || (sb == DM_SCCP_TOP))
+		return (-2);
+
+	mask = dm_sccp_mask(bits);
+	a &= mask;
+	b &= mask;
+	if (u->mnemonic == UD_Icmp) {
+		r = (a - b) & mask;
+		cf = (a < b);
+		of = (((a ^ b) & (a ^ r)) >> (bits - 1)) & 1;
+	} else
+		r = a & b;
+	zf = (r == 0);
+	sf = (r >> (bits - 1)) & 1;
+
+	switch (jcc) {
+	case UD_Ijz:
+		return (zf);
+	case UD_Ijnz:
+		return (!zf);
+	case UD_Ijg:
+		return (!zf && (sf == of));
+	case UD_Ijge:
+		return (sf == of);
+	case UD_Ijl:
+		return (sf != of);
+	case UD_Ijle:
+		return (zf || (sf != of));
+	case UD_Ija:
+		return (!cf && !zf);
+	case UD_Ijae:
+		return (!cf);
+	case UD_Ijb:
+		return (cf);
+	case UD_Ijbe:
+		return (cf || zf);
+	default:
+		return (-1);
+	}
+}
+
+/*
+ * The virtual address a jmp or call through a register goes to, if the
+ * register is constant there
+ */
+int
+dm_sccp_target(struct dm_sccp *s, struct instruction *insn, ADDR64 *vaddr)
+{
+	struct ud		*u = &insn->ud;
+	uint64_t		 val = 0;
+
+	if (((u->mnemonic != UD_Ijmp) && (u->mnemonic != UD_Icall)) ||
+	    (u->operand[0].type != UD_OP_REG))
+		return (DM_FAIL);
+	if (dm_sccp_reg(s, u->operand[0].base, insn->index[0][0], &val) !=
+	    DM_SCCP_CONST)
+		return (DM_FAIL);
+
+	*vaddr = val;
+	return (DM_OK);
+}
+
+/*
+ * Tell CFG recovery about indirect jumps and calls with a constant
+ * target, optionally listing them. Returns how many it didn't know.
+ */
+int
+dm_sccp_resolve(struct dm_sccp *s, int show)
+{
+	struct dm_cfg_node	*node = NULL;
+	struct instruction	*insn = NULL;
+	struct dm_du_site	 site;
+	ADDR64			 vaddr = 0, target = 0;
+	char			 text[256], desc[128];
+	int			 v = 0, i = 0, fresh = 0;
+
+	for (v = 0; v < p_length; v++) {
+		if (!s->block_exec[v])
+			continue;
+		node = (struct dm_cfg_node*)rpost[v];
+		for (i = 0; i < node->i_count; i++) {
+			insn = node->instructions[i];
+			if ((dm_sccp_target(s, insn, &vaddr) != DM_OK) ||
+			    (dm_offset_from_vaddr(vaddr, &target) != DM_OK))
+				continue;
+			if (dm_is_target_in_text(target) &&
+			    (dm_cfg_add_target(insn->ud.pc -
+			    ud_insn_len(&insn->ud), target) == DM_OK))
+				fresh++;
+			if (!show)
+				continue;
+
+			site.node = node;
+			site.kind = DM_DU_INSN;
+			site.i = i;
+			dm_du_site_text(&site, text, sizeof(text));
+			printf("\t%s -> " NADDR_FMT, text, (NADDR) target);
+			if (dm_dwarf_describe_offset(target, desc, sizeof(desc)))
+				printf(" (%s)", desc);
+			printf("\n");
+		}
+	}
+	return (fresh);
+}
+
+void
+dm_sccp_report(struct dm_sccp *s)
+{
+	struct dm_cfg_node	*node = NULL;
+	char			 name[32], text[256];
+	int			 v = 0, c = 0, dead = 0;
+
+	printf("Constant registers:\n");
+	for (v = 0; v < s->du.n; v++) {
+		if ((s->state[v] != DM_SCCP_CONST) ||
+		    (s->du.def[v].kind == DM_DU_ENTRY))
+			continue;
+		dm_du_name(&s->du, v, name, sizeof(name));
+		dm_du_site_text(&s->du.def[v], text, sizeof(text));
+		printf("\t%-8s = 0x%-16llx %s\n", name,
+		    (unsigned long long) s->val[v], text);
+	}
+
+	printf("Unreachable edges:\n");
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		if (!s->block_exec[v]) {
+			dead++;
+			continue;
+		}
+		for (c = 0; node->children[c] != NULL; c++)
+			if (!s->edge_exec[s->out_off[v] + c])
+				printf("\tBlock %d -> Block %d\n", node->post,
+				    node->children[c]->post);
+	}
+	printf("%d of %d blocks unreachable\n", dead, p_length);
+
+	printf("Indirect jump and call targets:\n");
+	dm_sccp_resolve(s, 1);
+}
+
+uint64_t
+dm_sccp_mask(int bits)
+{
+	return ((bits >= 64) ? ~0ULL : (1ULL << bits) - 1);
+}
+
+/*
+ * An immediate or displacement of the given size, sign extended
+ */
+uint64_t
+dm_sccp_sext(struct ud_operand *op, int bits)
+{
+	switch (bits) {
+	case 8:
+		return ((uint64_t)(int64_t)op->lval.sbyte);
+	case 16:
+		return ((uint64_t)(int64_t)op->lval.sword);
+	case 32:
+		return ((uint64_t)(int64_t)op->lval.sdword);
+	default:
+		return (op->lval.uqword);
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_SCCP_H
+#define __DM_SCCP_H
+
+#include "common.h"
+#include "dm_du.h"
+
+/* Lattice of an SSA value */
+#define DM_SCCP_TOP		0	/* Not yet seen to be defined */
+#define DM_SCCP_CONST		1
+#define DM_SCCP_BOTTOM		2	/* Not a constant */
+
+/* Times to rebuild the CFG with newly resolved indirect jumps */
+#define DM_SCCP_ROUNDS		8
+
+/*
+ * Sparse conditional constant propagation (Wegman and Zadeck) over the
+ * current SSA form. Values are numbered as in the def-use chains; blocks
+ * and edges by reverse post-order, an edge being out_off[block] plus the
+ * index of the child.
+ */
+struct dm_sccp {
+	struct dm_du		 du;
+	char			*state;	     /* DM_SCCP_* per value */
+	uint64_t		*val;	     /* The whole register if const */
+	char			*block_exec;
+	char			*edge_exec;
+	int			*out_off;
+	int			*vwork;	     /* Values whose state changed */
+	int			 v_count;
+	char			*v_queued;
+	int			*ework;	     /* Edges found executable */
+	int			 e_count;
+	int			 visits;     /* Phis and insns evaluated */
+};
+
+int		dm_cmd_sccp(char **args);
+void		dm_sccp(struct dm_sccp *s);
+void		dm_sccp_free(struct dm_sccp *s);
+void		dm_sccp_visit_block(struct dm_sccp *s, struct dm_cfg_node *n);
+void		dm_sccp_visit_phi(struct dm_sccp *s, struct dm_cfg_node *n,
+		    int i);
+void		dm_sccp_visit_insn(struct dm_sccp *s, struct dm_cfg_node *n,
+		    int i);
+void		dm_sccp_visit_branch(struct dm_sccp *s,
+		    struct dm_cfg_node *n);
+void		dm_sccp_edge(struct dm_sccp *s, struct dm_cfg_node *n, int c);
+int		dm_sccp_edge_exec(struct dm_sccp *s, struct dm_cfg_node *from,
+		    struct dm_cfg_node *to);
+void		dm_sccp_lower(struct dm_sccp *s, int v, int state,
+		    uint64_t val);
+int		dm_sccp_reg(struct dm_sccp *s, enum ud_type r, int ver,
+		    uint64_t *val);
+int		dm_sccp_operand(struct dm_sccp *s, struct instruction *insn,
+		    int k, uint64_t *val);
+int		dm_sccp_lea(struct dm_sccp *s, struct instruction *insn,
+		    uint64_t *val);
+int		dm_sccp_write(struct dm_sccp *s, struct instruction *insn,
+		    int state, uint64_t res, uint64_t *val);
+int		dm_sccp_cond(struct dm_sccp *s, struct instruction *flags,
+		    enum ud_mnemonic_code jcc);
+int		dm_sccp_target(struct dm_sccp *s, struct instruction *insn,
+		    ADDR64 *vaddr);
+int		dm_sccp_resolve(struct dm_sccp *s, int show);
+void		dm_sccp_report(struct dm_sccp *s);
+uint64_t	dm_sccp_mask(int bits);
+uint64_t	dm_sccp_sext(struct ud_operand *op, int bits);
+
+#endif
@@ -0,0 +1,698 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "dm_slot.h"
+#include "dm_sccp.h"
+#include "dm_sp.h"
+#include "dm_util.h"
+
+extern struct dm_instruction_se *instructions;
+extern int			 p_length;
+extern void			**rpost;
+
+struct dm_slots			 ssa_slots;
+
+/*
+ * Show the stack slots of the current function and how much spill and
+ * reload traffic each sees
+ */
+int
+dm_cmd_slots(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_slot		*slot = NULL;
+	char			*note = NULL;
+	int			 s = 0, promoted = 0, spills = 0, reloads = 0;
+
+	(void) args;
+
+	dm_ssa_open();
+
+	printf("\n%s\n", DM_RULE);
+	printf("%-16s | %-4s | %-8s | %-4s | %-6s | %-6s | %-6s | %-7s | %s\n",
+	    "Slot", "Size", "Versions", "Phis", "Stores", "Loads", "Spills",
+	    "Reloads", "Note");
+	printf("%s\n", DM_RULE);
+	for (s = 0; s < ssa_slots.count; s++) {
+		slot = &ssa_slots.slots[s];
+		if (slot->flags & DM_SLOT_ESCAPED)
+			note = "address taken";
+		else if (slot->flags & DM_SLOT_OVERLAP)
+			note = "overlaps";
+		else if (slot->flags & DM_SLOT_PUSHED)
+			note = "push/pop";
+		else {
+			note = "";
+			promoted++;
+		}
+		printf("%-16s | %-4d | %-8d | %-4d | %-6d | %-6d | %-6d | "
+		    "%-7d | %s\n", slot->name, slot->size, slot->count,
+		    slot->phis, slot->stores, slot->loads, slot->spills,
+		    slot->reloads, note);
+		spills += slot->spills;
+		reloads += slot->reloads;
+	}
+	printf("%s\n", DM_RULE);
+	printf("%d slots, %d in SSA form, %d spills, %d reloads\n\n",
+	    ssa_slots.count, promoted, spills, reloads);
+
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Find the stack slots of a function in SSA form and give them versions
+ * and phi functions of their own. Phis are placed as for minimal SSA.
+ */
+void
+dm_slots(struct dm_cfg_node *cfg)
+{
+	memset(&ssa_slots, 0, sizeof(ssa_slots));
+
+	/* Accesses are keyed on the stack pointer deltas, kept for spdelta */
+	dm_sp(&ssa_slots.sp, &ssa_slots.sp_fn);
+
+	ssa_slots.phis = xcalloc(p_length + 1, sizeof(struct dm_slot_phi *));
+	ssa_slots.pf_count = xcalloc(p_length + 1, sizeof(int));
+	ssa_slots.esc[DM_SLOT_FRAME] = ssa_slots.esc[DM_SLOT_RBP] = INT_MAX;
+	ssa_slots.rbp_fixed = dm_slot_rbp_fixed();
+
+	dm_slots_find();
+	dm_slot_overlaps();
+	dm_slot_place_phis();
+	dm_slot_rename(cfg);
+}
+
+void
+dm_slots_free()
+{
+	int			 s = 0, v = 0, i = 0;
+
+	for (s = 0; s < ssa_slots.count; s++) {
+		free(ssa_slots.slots[s].stack);
+		free(ssa_slots.slots[s].def_nodes);
+	}
+	free(ssa_slots.slots);
+	free(ssa_slots.hash);
+	if (ssa_slots.phis != NULL) {
+		for (v = 0; v < p_length; v++) {
+			for (i = 0; i < ssa_slots.pf_count[v]; i++)
+				free(ssa_slots.phis[v][i].indexes);
+			free(ssa_slots.phis[v]);
+		}
+	}
+	free(ssa_slots.phis);
+	free(ssa_slots.pf_count);
+	free(ssa_slots.log);
+	dm_flow_free(&ssa_slots.sp);
+	memset(&ssa_slots, 0, sizeof(ssa_slots));
+}
+
+/*
+ * Find every rsp or rbp relative access, in terms of the stack pointer on
+ * entry where dm_sp() could follow the stack and frame pointers
+ */
+void
+dm_slots_find()
+{
+	struct dm_cfg_node	*node = NULL;
+	struct instruction	*insn = NULL;
+	struct dm_slot		*slot = NULL;
+	struct ud		*u = NULL;
+	enum ud_type		 r = UD_NONE;
+	int			 v = 0, i = 0, k = 0, s = 0, w = 0;
+	int			 sp = 0, fp = 0, kind = 0, off = 0;
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+
+		for (i = 0; i < node->i_count; i++) {
+			insn = node->instructions[i];
+			u = &insn->ud;
+			sp = insn->sp_delta;
+			fp = insn->fp_delta;
+
+			for (k = 0; k < 3; k++) {
+				if (dm_slot_key(u, k, sp, fp, &kind, &off) !=
+				    DM_OK)
+					continue;
+				if (u->mnemonic == UD_Ilea) {
+					dm_slot_escape(kind, off);
+					continue;
+				}
+				s = dm_slot_get(kind, off,
+				    u->operand[k].size / 8, u, k);
+				insn->slot[k] = s;
+				slot = &ssa_slots.slots[s];
+				if ((k == 0) &&
+				    instructions[u->mnemonic].write) {
+					slot->stores++;
+					if (!instructions[u->mnemonic].kill)
+						slot->loads++;
+					if (dm_slot_is_move(u) &&
+					    (u->operand[1].type == UD_OP_REG))
+						slot->spills++;
+					if ((slot->dn_count == 0) ||
+					    (slot->def_nodes[slot->dn_count - 1]
+					    != node)) {
+						slot->def_nodes = xrealloc(
+						    slot->def_nodes,
+						    (slot->dn_count + 1) *
+						    sizeof(struct dm_cfg_node *));
+						slot->def_nodes[
+						    slot->dn_count++] = node;
+					}
+					continue;
+				}
+				slot->loads++;
+				if ((k == 1) && dm_slot_is_move(u) &&
+				    (u->operand[0].type == UD_OP_REG))
+					slot->reloads++;
+			}
+
+			/* What push and pop touch isn't an operand */
+			if (sp != DM_SP_UNKNOWN) {
+				w = dm_sp_push_width(u);
+				switch (u->mnemonic) {
+				case UD_Ipush:
+				case UD_Ipushfw:
+				case UD_Ipushfd:
+				case UD_Ipushfq:
+					s = dm_slot_get(DM_SLOT_FRAME, sp - w,
+					    w, NULL, 0);
+					ssa_slots.slots[s].flags |=
+					    DM_SLOT_PUSHED;
+					break;
+				case UD_Ipop:
+				case UD_Ipopfw:
+				case UD_Ipopfd:
+				case UD_Ipopfq:
+					s = dm_slot_get(DM_SLOT_FRAME, sp, w,
+					    NULL, 0);
+					ssa_slots.slots[s].flags |=
+					    DM_SLOT_PUSHED;
+					break;
+				default:
+					break;
+				}
+			}
+
+			/* So does a copy of the stack or frame pointer */
+			if ((u->mnemonic == UD_Imov) &&
+			    (u->operand[0].type == UD_OP_REG) &&
+			    (u->operand[1].type == UD_OP_REG)) {
+				r = u->operand[1].base;
+				if (((r == UD_R_RSP) || (r == UD_R_ESP)) &&
+				    (sp != DM_SP_UNKNOWN) &&
+				    (u->operand[0].base != UD_R_RBP) &&
+				    (u->operand[0].base != UD_R_EBP))
+					dm_slot_escape(DM_SLOT_FRAME, sp);
+				else if ((r == UD_R_RBP) || (r == UD_R_EBP)) {
+					if (fp != DM_SP_UNKNOWN)
+						dm_slot_escape(DM_SLOT_FRAME,
+						    fp);
+					else
+						dm_slot_escape(DM_SLOT_RBP, 0);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Is operand k a stack slot? Only direct accesses off the stack or frame
+ * pointer are, with no index register. Where dm_sp() lost track of rbp
+ * its accesses only name a slot if rbp holds the same value all through
+ * the function; otherwise rbp may just be another register.
+ */
+int
+dm_slot_key(struct ud *u, int k, int sp, int fp, int *kind, int *off)
+{
+	struct ud_operand	*op = &u->operand[k];
+	int			 disp = 0;
+
+	if ((op->type != UD_OP_MEM) || (op->index != UD_NONE) ||
+	    (u->pfx_seg))
+		return (DM_FAIL);
+	if (op->offset)
+		disp = (int)dm_sccp_sext(op, op->offset);
+
+	if ((op->base == UD_R_RSP) || (op->base == UD_R_ESP)) {
+		if (sp == DM_SP_UNKNOWN)
+			return (DM_FAIL);
+		*kind = DM_SLOT_FRAME;
+		*off = sp + disp;
+		return (DM_OK);
+	}
+	if ((op->base == UD_R_RBP) || (op->base == UD_R_EBP)) {
+		if ((fp == DM_SP_UNKNOWN) && (!ssa_slots.rbp_fixed))
+			return (DM_FAIL);
+		if (fp == DM_SP_UNKNOWN) {
+			*kind = DM_SLOT_RBP;
+			*off = disp;
+		} else {
+			*kind = DM_SLOT_FRAME;
+			*off = fp + disp;
+		}
+		return (DM_OK);
+	}
+	return (DM_FAIL);
+}
+
+/*
+ * Does nothing in the function write rbp, explicitly or not?
+ */
+int
+dm_slot_rbp_fixed()
+{
+	struct dm_cfg_node	*node = NULL;
+	struct ud		*u = NULL;
+	int			 regs[DM_SSA_MAX_CLOBBERS];
+	int			 rbp = dm_ssa_reg(UD_R_RBP);
+	int			 v = 0, i = 0, k = 0, n = 0;
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		for (i = 0; i < node->i_count; i++) {
+			u = &node->instructions[i]->ud;
+			if (instructions[u->mnemonic].write &&
+			    (u->operand[0].type == UD_OP_REG) &&
+			    (dm_ssa_reg(u->operand[0].base) == rbp))
+				return (0);
+			n = dm_ssa_insn_clobbers(u, regs);
+			for (k = 0; k < n; k++)
+				if (regs[k] == rbp)
+					return (0);
+		}
+	}
+	return (1);
+}
+
+/*
+ * The slot at an offset, added if it is new. It is named after the
+ * operand (if any) that first accessed it. Slots are found through an
+ * open addressed hash of kind and offset.
+ */
+int
+dm_slot_get(int kind, int off, int size, struct ud *u, int k)
+{
+	struct dm_slot		*slot = NULL;
+	struct ud_operand	*op = NULL;
+	int			 s = 0, disp = 0;
+	size_t			 h = 0;
+
+	/* Grow at half full, so probe sequences stay short */
+	if (ssa_slots.count * 2 >= ssa_slots.h_size)
+		dm_slot_rehash();
+
+	for (h = DM_SLOT_HASH(kind, off);; h++) {
+		s = ssa_slots.hash[h & (ssa_slots.h_size - 1)];
+		if (s == -1)
+			break;
+		slot = &ssa_slots.slots[s];
+		if ((slot->kind == kind) && (slot->off == off)) {
+			/*
+			 * A byte store into a qword slot only changes part of
+			 * it, so mixed widths can't be versioned as a whole
+			 */
+			if (size != slot->size)
+				slot->flags |= DM_SLOT_OVERLAP;
+			if (size > slot->size)
+				slot->size = size;
+			return (s);
+		}
+	}
+	ssa_slots.hash[h & (ssa_slots.h_size - 1)] = ssa_slots.count;
+
+	if (ssa_slots.count == ssa_slots.cap) {
+		ssa_slots.cap = ssa_slots.cap ? ssa_slots.cap * 2 : 16;
+		ssa_slots.slots = xrealloc(ssa_slots.slots,
+		    ssa_slots.cap * sizeof(struct dm_slot));
+	}
+	slot = &ssa_slots.slots[ssa_slots.count];
+	memset(slot, 0, sizeof(*slot));
+	slot->kind = kind;
+	slot->off = off;
+	slot->size = size ? size : 1;
+	if (!size)
+		slot->flags |= DM_SLOT_OVERLAP;
+
+	if (u != NULL) {
+		op = &u->operand[k];
+		disp = op->offset ? (int)dm_sccp_sext(op, op->offset) : 0;
+		snprintf(slot->name, sizeof(slot->name), "[%s%s0x%x]",
+		    ud_reg_tab[op->base - UD_R_AL], (disp < 0) ? "-" : "+",
+		    (disp < 0) ? -disp : disp);
+	} else
+		snprintf(slot->name, sizeof(slot->name), "[entry_sp%s0x%x]",
+		    (off < 0) ? "-" : "+", (off < 0) ? -off : off);
+
+	return (ssa_slots.count++);
+}
+
+/*
+ * Double the hash table (or make the first one) and put every slot back
+ */
+void
+dm_slot_rehash()
+{
+	struct dm_slot		*slot = NULL;
+	int			 s = 0;
+	size_t			 h = 0;
+
+	free(ssa_slots.hash);
+	ssa_slots.h_size = ssa_slots.h_size ? ssa_slots.h_size * 2 : 64;
+	ssa_slots.hash = xmalloc(ssa_slots.h_size * sizeof(int));
+	memset(ssa_slots.hash, 0xff, ssa_slots.h_size * sizeof(int));
+
+	for (s = 0; s < ssa_slots.count; s++) {
+		slot = &ssa_slots.slots[s];
+		for (h = DM_SLOT_HASH(slot->kind, slot->off);
+		    ssa_slots.hash[h & (ssa_slots.h_size - 1)] != -1; h++)
+			;
+		ssa_slots.hash[h & (ssa_slots.h_size - 1)] = s;
+	}
+}
+
+/*
+ * The address of the frame at this offset gets out. Anything at or above
+ * it could be reached through it.
+ */
+void
+dm_slot_escape(int kind, int off)
+{
+	if (off < ssa_slots.esc[kind])
+		ssa_slots.esc[kind] = off;
+}
+
+/*
+ * Mark the slots that can't be versioned: those reachable through an
+ * escaping address and those overlapping another slot
+ */
+void
+dm_slot_overlaps()
+{
+	struct dm_slot		*a = NULL, *b = NULL;
+	int			*order = NULL, i = 0, j = 0;
+
+	for (i = 0; i < ssa_slots.count; i++) {
+		a = &ssa_slots.slots[i];
+		if (a->off + a->size > ssa_slots.esc[a->kind])
+			a->flags |= DM_SLOT_ESCAPED;
+	}
+
+	order = xmalloc((ssa_slots.count + 1) * sizeof(int));
+	for (i = 0; i < ssa_slots.count; i++)
+		order[i] = i;
+	qsort(order, ssa_slots.count, sizeof(int), dm_slot_cmp);
+
+	for (i = 0; i < ssa_slots.count; i++) {
+		a = &ssa_slots.slots[order[i]];
+		for (j = i + 1; j < ssa_slots.count; j++) {
+			b = &ssa_slots.slots[order[j]];
+			if ((b->kind != a->kind) || (b->off >= a->off + a->size))
+				break;
+			a->flags |= DM_SLOT_OVERLAP;
+			b->flags |= DM_SLOT_OVERLAP;
+		}
+	}
+	free(order);
+}
+
+/* Order slot numbers by kind then offset */
+int
+dm_slot_cmp(const void *s1, const void *s2)
+{
+	struct dm_slot *a = &ssa_slots.slots[*(const int *)s1];
+	struct dm_slot *b = &ssa_slots.slots[*(const int *)s2];
+
+	if (a->kind != b->kind)
+		return (a->kind - b->kind);
+	if (a->off < b->off)
+		return (-1);
+	return (a->off > b->off);
+}
+
+int
+dm_slot_promoted(int s)
+{
+	return (ssa_slots.slots[s].flags == 0);
+}
+
+/*
+ * Moves between a register and memory, for counting spills and reloads
+ */
+int
+dm_slot_is_move(struct ud *u)
+{
+	switch (u->mnemonic) {
+	case UD_Imov:
+	case UD_Imovzx:
+	case UD_Imovsx:
+	case UD_Imovsxd:
+	case UD_Imovd:
+	case UD_Imovq:
+	case UD_Imovss:
+	case UD_Imovsd:
+	case UD_Imovaps:
+	case UD_Imovups:
+	case UD_Imovapd:
+	case UD_Imovupd:
+	case UD_Imovdqa:
+	case UD_Imovdqu:
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Iterated dominance frontiers of the blocks storing to each slot
+ */
+void
+dm_slot_place_phis()
+{
+	struct dm_cfg_node	**work = NULL, *x = NULL, *y = NULL;
+	struct dm_slot_phi	 *phi = NULL;
+	struct dm_slot		 *slot = NULL;
+	int			 *has = NULL, *queued = NULL;
+	int			  s = 0, i = 0, j = 0, w_count = 0, v = 0;
+
+	work = xmalloc((p_length + 1) * sizeof(struct dm_cfg_node *));
+	has = xmalloc((p_length + 1) * sizeof(int));
+	queued = xmalloc((p_length + 1) * sizeof(int));
+	memset(has, 0xff, (p_length + 1) * sizeof(int));
+	memset(queued, 0xff, (p_length + 1) * sizeof(int));
+
+	for (s = 0; s < ssa_slots.count; s++) {
+		if (!dm_slot_promoted(s))
+			continue;
+		slot = &ssa_slots.slots[s];
+		w_count = 0;
+		for (i = 0; i < slot->dn_count; i++) {
+			queued[slot->def_nodes[i]->rpost] = s;
+			work[w_count++] = slot->def_nodes[i];
+		}
+		while (w_count) {
+			x = work[--w_count];
+			for (i = 0; i < x->df_count; i++) {
+				y = x->df_set[i];
+				v = y->rpost;
+				if (has[v] == s)
+					continue;
+				has[v] = s;
+
+				ssa_slots.phis[v] = xrealloc(ssa_slots.phis[v],
+				    (ssa_slots.pf_count[v] + 1) *
+				    sizeof(struct dm_slot_phi));
+				phi = &ssa_slots.phis[v][ssa_slots.pf_count[v]++];
+				phi->slot = s;
+				phi->index = -1;
+				phi->arguments = y->p_count;
+				phi->indexes = xmalloc((y->p_count + 1) *
+				    sizeof(int));
+				for (j = 0; j < y->p_count; j++)
+					phi->indexes[j] = -1;
+				slot->phis++;
+
+				if (queued[v] != s) {
+					queued[v] = s;
+					work[w_count++] = y;
+				}
+			}
+		}
+	}
+
+	free(work);
+	free(has);
+	free(queued);
+}
+
+/*
+ * Give every access to a versioned slot its version, walking the
+ * dominator tree as register renaming does
+ */
+void
+dm_slot_rename(struct dm_cfg_node *cfg)
+{
+	struct dm_ssa_rename_frame	*frames = NULL, *f = NULL;
+	struct dm_cfg_node		*child = NULL;
+	struct dm_slot			*slot = NULL;
+	int				 f_count = 0, f_cap = 16, s = 0;
+
+	for (s = 0; s < ssa_slots.count; s++) {
+		slot = &ssa_slots.slots[s];
+		slot->s_cap = DM_SSA_STACK_INIT;
+		slot->stack = xmalloc(slot->s_cap * sizeof(int));
+		slot->stack[0] = 0;
+		slot->s_size = 1;
+		slot->count = 0;
+	}
+
+	frames = xmalloc(f_cap * sizeof(*frames));
+	frames[f_count].node = cfg;
+	frames[f_count].child = 0;
+	frames[f_count++].log = ssa_slots.log_count;
+	dm_slot_rename_block(cfg);
+
+	while (f_count) {
+		f = &frames[f_count - 1];
+		if (f->child < f->node->dc_count) {
+			child = f->node->dom_children[f->child++];
+			if (f_count == f_cap) {
+				f_cap *= 2;
+				frames = xrealloc(frames,
+				    f_cap * sizeof(*frames));
+			}
+			frames[f_count].node = child;
+			frames[f_count].child = 0;
+			frames[f_count++].log = ssa_slots.log_count;
+			dm_slot_rename_block(child);
+			continue;
+		}
+		while (ssa_slots.log_count > f->log)
+			ssa_slots.slots[ssa_slots.log[--ssa_slots.log_count]]
+			    .s_size--;
+		f_count--;
+	}
+	free(frames);
+}
+
+void
+dm_slot_rename_block(struct dm_cfg_node *n)
+{
+	struct instruction	*insn = NULL;
+	struct dm_slot_phi	*phi = NULL;
+	struct dm_slot		*slot = NULL;
+	struct dm_cfg_node	*child = NULL;
+	int			 i = 0, j = 0, k = 0, m = 0, c = 0, s = 0;
+
+	for (i = 0; i < ssa_slots.pf_count[n->rpost]; i++) {
+		phi = &ssa_slots.phis[n->rpost][i];
+		phi->index = dm_slot_rename_def(phi->slot);
+	}
+
+	for (i = 0; i < n->i_count; i++) {
+		insn = n->instructions[i];
+		/* Reads first, then the write to operand 0 */
+		for (m = 0; m < 3; m++) {
+			k = (m + 1) % 3;
+			s = insn->slot[k];
+			if ((s == -1) || !dm_slot_promoted(s))
+				continue;
+			slot = &ssa_slots.slots[s];
+			if ((k == 0) && instructions[insn->ud.mnemonic].write) {
+				insn->sindex[0][1] =
+				    instructions[insn->ud.mnemonic].kill ? -1 :
+				    slot->stack[slot->s_size - 1];
+				insn->sindex[0][0] = dm_slot_rename_def(s);
+			} else
+				insn->sindex[k][0] =
+				    slot->stack[slot->s_size - 1];
+		}
+	}
+
+	for (c = 0; n->children[c] != NULL; c++) {
+		child = n->children[c];
+		for (j = 0; j < child->p_count; j++)
+			if (child->parents[j] == n)
+				break;
+		for (i = 0; i < ssa_slots.pf_count[child->rpost]; i++) {
+			phi = &ssa_slots.phis[child->rpost][i];
+			slot = &ssa_slots.slots[phi->slot];
+			if (j < phi->arguments)
+				phi->indexes[j] = slot->stack[slot->s_size - 1];
+		}
+	}
+}
+
+/*
+ * Make a new version of a slot, returning it
+ */
+int
+dm_slot_rename_def(int s)
+{
+	struct dm_slot		*slot = &ssa_slots.slots[s];
+
+	if (ssa_slots.log_count == ssa_slots.log_cap) {
+		ssa_slots.log_cap = ssa_slots.log_cap ?
+		    ssa_slots.log_cap * 2 : 64;
+		ssa_slots.log = xrealloc(ssa_slots.log,
+		    ssa_slots.log_cap * sizeof(int));
+	}
+	ssa_slots.log[ssa_slots.log_count++] = s;
+
+	if (slot->s_size == slot->s_cap) {
+		slot->s_cap *= 2;
+		slot->stack = xrealloc(slot->stack, slot->s_cap * sizeof(int));
+	}
+	slot->stack[slot->s_size++] = ++slot->count;
+	return (slot->count);
+}
+
+/*
+ * Print the phi functions for stack slots at the start of a block
+ */
+void
+dm_slot_print_phis(struct dm_cfg_node *n)
+{
+	struct dm_slot_phi	*phi = NULL;
+	char			*name = NULL;
+	int			 i = 0, j = 0, k = 0;
+
+	if (ssa_slots.phis == NULL)
+		return;
+
+	for (i = 0; i < ssa_slots.pf_count[n->rpost]; i++) {
+		phi = &ssa_slots.phis[n->rpost][i];
+		name = ssa_slots.slots[phi->slot].name;
+		printf("%s%39smov %s_%d, phi(", ANSII_GREEN, "", name,
+		    phi->index);
+		for (j = 0; j < phi->arguments; j++) {
+			/* Several edges may bring the same version */
+			for (k = 0; k < j; k++)
+				if (phi->indexes[k] == phi->indexes[j])
+					break;
+			if (k < j)
+				continue;
+			printf("%s%s_%d", j ? ", " : "", name,
+			    phi->indexes[j]);
+		}
+		printf(")%s\n", ANSII_WHITE);
+	}
+}
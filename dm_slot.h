@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_SLOT_H
+#define __DM_SLOT_H
+
+#include "common.h"
+#include "dm_ssa.h"
+#include "dm_sp.h"
+
+/* What a slot's offset is relative to */
+#define DM_SLOT_FRAME		0	/* The stack pointer on entry */
+#define DM_SLOT_RBP		1	/* A frame pointer of unknown value */
+
+/* Where a slot starts probing in the hash of slots */
+#define DM_SLOT_HASH(kind, off)						\
+	((((size_t)(unsigned)(off)) * 2654435761u) ^ (size_t)(kind))
+
+/* Reasons a slot can't be made an SSA variable */
+#define DM_SLOT_ESCAPED		0x1	/* Its address is taken */
+#define DM_SLOT_OVERLAP		0x2	/* Partly accessed, or overlaps a slot */
+#define DM_SLOT_PUSHED		0x4	/* Written by push, read by pop */
+
+/*
+ * A local variable or spill slot in the stack frame, at [rbp-N] or
+ * [rsp+N]. Slots that are only ever accessed whole and directly are given
+ * versions and phi functions just like registers.
+ */
+struct dm_slot {
+	int			  kind;	  /* DM_SLOT_FRAME or _RBP */
+	int			  off;
+	int			  size;	  /* Bytes, the widest access */
+	int			  flags;  /* DM_SLOT_ESCAPED .. */
+	char			  name[32];
+	int			  count;  /* Versions */
+	int			 *stack;
+	int			  s_size;
+	int			  s_cap;
+	struct dm_cfg_node	**def_nodes;
+	int			  dn_count;
+	int			  phis;
+	int			  stores;
+	int			  loads;
+	int			  spills; /* mov [slot], reg */
+	int			  reloads;/* mov reg, [slot] */
+};
+
+struct dm_slot_phi {
+	int			  slot;
+	int			  index;
+	int			  arguments;
+	int			 *indexes;
+};
+
+/* The stack slots of the SSA form, phis indexed by reverse post-order */
+struct dm_slots {
+	struct dm_slot		 *slots;
+	int			  count;
+	int			  cap;
+	int			 *hash;	  /* Slot numbers by kind and offset */
+	int			  h_size; /* Always a power of 2 */
+	int			  rbp_fixed; /* Nothing in the function sets rbp */
+	struct dm_slot_phi	**phis;
+	int			 *pf_count;
+	int			 *log;	  /* Slots given a new version */
+	int			  log_count;
+	int			  log_cap;
+	int			  esc[2]; /* Lowest escaping offset by kind */
+	struct dm_flow		  sp;	  /* dm_sp() states at block entry */
+	struct dm_sp_func	  sp_fn;
+};
+
+extern struct dm_slots	ssa_slots;
+
+int		dm_cmd_slots(char **args);
+void		dm_slots(struct dm_cfg_node *cfg);
+void		dm_slots_free();
+void		dm_slots_find();
+int		dm_slot_key(struct ud *u, int k, int sp, int fp, int *kind,
+		    int *off);
+int		dm_slot_get(int kind, int off, int size, struct ud *u, int k);
+void		dm_slot_rehash();
+int		dm_slot_rbp_fixed();
+void		dm_slot_escape(int kind, int off);
+void		dm_slot_overlaps();
+int		dm_slot_cmp(const void *s1, const void *s2);
+int		dm_slot_promoted(int s);
+int		dm_slot_is_move(struct ud *u);
+void		dm_slot_place_phis();
+void		dm_slot_rename(struct dm_cfg_node *cfg);
+void		dm_slot_rename_block(struct dm_cfg_node *n);
+int		dm_slot_rename_def(int s);
+void		dm_slot_print_phis(struct dm_cfg_node *n);
+
+#endif
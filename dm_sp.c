@@ -0,0 +1,690 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "dm_sp.h"
+#include "dm_dom.h"
+#include "dm_dwarf.h"
+#include "dm_eh.h"
+#include "dm_elf.h"
+#include "dm_sccp.h"
+#include "dm_slot.h"
+#include "dm_ssa.h"
+#include "dm_util.h"
+
+extern int p_length;
+extern void **rpost;
+
+/*
+ * Show the stack pointer delta at each instruction of the current function.
+ * Building the SSA form has already run dm_sp(), for the stack slots.
+ */
+int
+dm_cmd_spdelta_noargs(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_cfg_node	*node = NULL;
+	struct instruction	 insn;
+	struct dm_sp_state	*in = NULL;
+	struct dm_sp_func	*fn = &ssa_slots.sp_fn;
+	struct dm_flow		*f = &ssa_slots.sp;
+	struct dm_graph		 g;
+	char			 b1[16], b2[16];
+	int			 v = 0, i = 0;
+
+	(void) args;
+
+	dm_ssa_open();
+	dm_cfg_graph(&g);
+
+	printf("\n");
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		in = DM_FLOW_IN(f, v);
+		dm_print_block_header(node);
+		printf("\tsp %s, fp %s%s\n",
+		    dm_sp_fmt(in->sp, b1, sizeof(b1)),
+		    dm_sp_fmt(in->fp, b2, sizeof(b2)),
+		    dm_sp_merge(f, &g, v) ? ", inconsistent merge" : "");
+		for (i = 0; i < node->i_count; i++) {
+			/* Decoded only, translate a copy to print */
+			insn = *node->instructions[i];
+			insn.ud.insn_buffer[0] = 0;
+			insn.ud.insn_fill = 0;
+			dm_translate_intel_ssa(&insn);
+			printf("\t" NADDR_FMT "  %8s  %s\n", insn.ud.pc -
+			    ud_insn_len(&insn.ud),
+			    dm_sp_fmt(insn.sp_delta, b1, sizeof(b1)),
+			    insn.ud.insn_buffer);
+		}
+	}
+	printf("\nFrame %d bytes, %d inconsistent merges, %d unbalanced "
+	    "returns, %d of %d instructions unknown, %d block evaluations\n\n",
+	    fn->frame, fn->conflicts, fn->unbalanced, fn->unknown, fn->insns,
+	    fn->evals);
+
+	dm_graph_free(&g);
+	dm_ssa_close();
+	dm_seek(addr);
+
+	return (DM_OK);
+}
+
+/*
+ * Check the stack pointer deltas of every function in .eh_frame, in
+ * parallel
+ */
+int
+dm_cmd_spdelta(char **args)
+{
+	struct dm_dwarf_sym_cache_entry	*sym = NULL;
+	struct dm_eh_func		*eh = NULL;
+	struct dm_sp_func		*fn = NULL;
+	struct dm_sp_job		 job;
+	size_t				 count = 0, i = 0;
+	double				 t0, t1;
+	int				 insns = 0, conflicts = 0, unbalanced = 0;
+
+	if (strcmp(args[0], "all") != 0) {
+		DPRINTF(DM_D_WARN, "Unknown argument: %s", args[0]);
+		return (DM_FAIL);
+	}
+
+	eh = dm_eh_funcs(&count);
+	if ((elf_img.base == NULL) || (count == 0)) {
+		DPRINTF(DM_D_WARN, "No function bounds (no .eh_frame?)");
+		return (DM_FAIL);
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.funcs = xcalloc(count, sizeof(struct dm_sp_func));
+	job.bits = file_info.bits;
+	for (i = 0; i < count; i++) {
+		if (!DM_ELF_IN_BOUNDS(eh[i].offset,
+		    eh[i].offset_end - eh[i].offset))
+			continue;
+		job.funcs[job.count].start = eh[i].offset;
+		job.funcs[job.count++].end = eh[i].offset_end;
+	}
+
+	t0 = dm_dom_bench_ms();
+	dm_sp_all(&job);
+	t1 = dm_dom_bench_ms();
+
+	printf("\n");
+	for (i = 0; i < (size_t)job.count; i++) {
+		fn = &job.funcs[i];
+
+		/* reprint headers every 20 lines */
+		if (i % 20 == 0) {
+			printf("%s\n", DM_RULE);
+			printf("%-10s | %-6s | %-6s | %-6s | %-6s | %-7s | %s\n",
+			    "Start", "Insns", "Frame", "Merges", "Rets",
+			    "Unknown", "Symbol");
+			printf("%s\n", DM_RULE);
+		}
+
+		printf(ADDR_FMT_64 " | %6d | %6d | %6d | %6d | %7d | %s\n",
+		    fn->start, fn->insns, fn->frame, fn->conflicts,
+		    fn->unbalanced, fn->unknown,
+		    (dm_dwarf_find_sym_at_offset(fn->start, &sym) == DM_OK) ?
+		    sym->name : "");
+		insns += fn->insns;
+		conflicts += (fn->conflicts != 0);
+		unbalanced += (fn->unbalanced != 0);
+	}
+	printf("%s\n", DM_RULE);
+	printf("%d functions, %d instructions, %d with inconsistent merges, "
+	    "%d with unbalanced returns, %.3f ms\n\n", job.count, insns,
+	    conflicts, unbalanced, t1 - t0);
+
+	free(job.funcs);
+
+	return (DM_OK);
+}
+
+/*
+ * Stack pointer deltas of the current function, which must be in SSA
+ * form as that is where blocks get their instructions. Every instruction
+ * is given the deltas on its way in, and f is left holding those of each
+ * block for the caller to dm_flow_free().
+ */
+void
+dm_sp(struct dm_flow *f, struct dm_sp_func *fn)
+{
+	struct dm_cfg_node	*node = NULL;
+	struct instruction	*insn = NULL;
+	struct dm_sp_state	 s;
+	struct dm_graph		 g;
+	int			 v = 0, i = 0;
+
+	memset(fn, 0, sizeof(*fn));
+	memset(f, 0, sizeof(*f));
+	dm_sp_flow(f);
+	f->threads = dm_threads;
+	f->transfer = dm_sp_transfer;
+
+	dm_cfg_graph(&g);
+	dm_flow_solve_graph(f, &g);
+	fn->evals = f->evals;
+
+	for (v = 0; v < p_length; v++) {
+		node = (struct dm_cfg_node*)rpost[v];
+		if (v == 0)
+			fn->start = node->start;
+		if (node->end > fn->end)
+			fn->end = node->end;
+		fn->conflicts += dm_sp_merge(f, &g, v);
+
+		memcpy(&s, DM_FLOW_IN(f, v), sizeof(s));
+		for (i = 0; i < node->i_count; i++) {
+			insn = node->instructions[i];
+			insn->sp_delta = (s.sp == DM_SP_TOP) ?
+			    DM_SP_UNKNOWN : s.sp;
+			insn->fp_delta = (s.fp == DM_SP_TOP) ?
+			    DM_SP_UNKNOWN : s.fp;
+			dm_sp_tally(fn, &insn->ud, &s);
+			if (s.sp != DM_SP_TOP)
+				dm_sp_step(&insn->ud, &s);
+		}
+	}
+
+	dm_graph_free(&g);
+}
+
+/*
+ * A forward problem over pairs of deltas. Each delta is a constant,
+ * DM_SP_TOP where nothing has arrived yet, or DM_SP_UNKNOWN where paths
+ * disagree. Entry (vertex 0) starts with the stack pointer at 0 and the
+ * caller's frame pointer, which we know nothing about.
+ */
+void
+dm_sp_flow(struct dm_flow *f)
+{
+	f->dir = DM_FLOW_FORWARD;
+	f->size = sizeof(struct dm_sp_state);
+	f->init = dm_sp_init;
+	f->top = dm_sp_top;
+	f->meet = dm_sp_meet;
+}
+
+void
+dm_sp_init(struct dm_flow *f, int v, void *in, void *out)
+{
+	struct dm_sp_state	*i = in;
+
+	dm_sp_top(f, in);
+	dm_sp_top(f, out);
+	if (v == 0) {
+		i->sp = 0;
+		i->fp = DM_SP_UNKNOWN;
+	}
+}
+
+void
+dm_sp_top(struct dm_flow *f, void *val)
+{
+	struct dm_sp_state	*s = val;
+
+	(void) f;
+
+	s->sp = s->fp = DM_SP_TOP;
+}
+
+void
+dm_sp_meet(struct dm_flow *f, void *dst, void *src)
+{
+	struct dm_sp_state	*d = dst, *s = src;
+
+	(void) f;
+
+	d->sp = dm_sp_meet_one(d->sp, s->sp);
+	d->fp = dm_sp_meet_one(d->fp, s->fp);
+}
+
+int
+dm_sp_meet_one(int a, int b)
+{
+	if (a == DM_SP_TOP)
+		return (b);
+	if ((b == DM_SP_TOP) || (a == b))
+		return (a);
+	return (DM_SP_UNKNOWN);
+}
+
+/*
+ * Step through the instructions of a block. Entry may be looped back to,
+ * so its starting value is met in again here.
+ */
+int
+dm_sp_transfer(struct dm_flow *f, int v, void *in, void *out)
+{
+	struct dm_cfg_node	*node = (struct dm_cfg_node*)rpost[v];
+	struct dm_sp_state	 s, entry = { 0, DM_SP_UNKNOWN };
+	int			 i = 0;
+
+	if (v == 0)
+		dm_sp_meet(f, in, &entry);
+
+	memcpy(&s, in, sizeof(s));
+	if (s.sp != DM_SP_TOP)
+		for (i = 0; i < node->i_count; i++)
+			dm_sp_step(&node->instructions[i]->ud, &s);
+
+	return (dm_sp_out(out, &s));
+}
+
+/*
+ * The same, where every instruction is a vertex of its own
+ */
+int
+dm_sp_insn_transfer(struct dm_flow *f, int v, void *in, void *out)
+{
+	struct dm_sp_code	*c = f->ctx;
+	struct dm_sp_state	 s, entry = { 0, DM_SP_UNKNOWN };
+
+	if (v == 0)
+		dm_sp_meet(f, in, &entry);
+
+	memcpy(&s, in, sizeof(s));
+	if (s.sp != DM_SP_TOP)
+		dm_sp_step(&c->insns[v], &s);
+
+	return (dm_sp_out(out, &s));
+}
+
+int
+dm_sp_out(void *out, struct dm_sp_state *s)
+{
+	if (memcmp(out, s, sizeof(*s)) == 0)
+		return (0);
+	memcpy(out, s, sizeof(*s));
+	return (1);
+}
+
+/*
+ * How an instruction moves the stack and frame pointers. A call is taken
+ * to return with the stack as it was before the call.
+ */
+void
+dm_sp_step(struct ud *u, struct dm_sp_state *s)
+{
+	struct ud_operand	*op0 = &u->operand[0], *op1 = &u->operand[1];
+	int64_t			 imm = 0;
+	int			 w = (u->dis_mode == 64) ? 8 : 4;
+
+	switch (u->mnemonic) {
+	case UD_Ipush:
+	case UD_Ipushfw:
+	case UD_Ipushfd:
+	case UD_Ipushfq:
+		s->sp = dm_sp_add(s->sp, -dm_sp_push_width(u));
+		return;
+	case UD_Ipop:
+	case UD_Ipopfw:
+	case UD_Ipopfd:
+	case UD_Ipopfq:
+		s->sp = dm_sp_add(s->sp, dm_sp_push_width(u));
+		if (dm_sp_is_reg(op0, UD_R_RSP, UD_R_ESP))
+			s->sp = DM_SP_UNKNOWN;
+		if (dm_sp_is_reg(op0, UD_R_RBP, UD_R_EBP))
+			s->fp = DM_SP_UNKNOWN;
+		return;
+	case UD_Ienter:
+		/* push rbp; mov rbp, rsp; sub rsp, N */
+		s->sp = dm_sp_add(s->sp, -w);
+		s->fp = s->sp;
+		s->sp = dm_sp_add(s->sp, -(int64_t)op0->lval.uword);
+		if (op1->lval.ubyte != 0)
+			s->sp = DM_SP_UNKNOWN;
+		return;
+	case UD_Ileave:
+		s->sp = dm_sp_add(s->fp, w);
+		s->fp = DM_SP_UNKNOWN;
+		return;
+	case UD_Icall:
+	case UD_Icmp:
+	case UD_Itest:
+	case UD_Ibt:
+		return;
+	default:
+		break;
+	}
+
+	if (op0->type != UD_OP_REG)
+		return;
+
+	if (dm_sp_is_reg(op0, UD_R_RSP, UD_R_ESP)) {
+		if (((u->mnemonic == UD_Iadd) || (u->mnemonic == UD_Isub)) &&
+		    (op1->type == UD_OP_IMM)) {
+			imm = (int64_t)dm_sccp_sext(op1, op1->size);
+			s->sp = dm_sp_add(s->sp,
+			    (u->mnemonic == UD_Iadd) ? imm : -imm);
+		} else if ((u->mnemonic == UD_Imov) &&
+		    dm_sp_is_reg(op1, UD_R_RBP, UD_R_EBP))
+			s->sp = s->fp;
+		else if (u->mnemonic == UD_Ilea)
+			s->sp = dm_sp_lea(op1, s);
+		else
+			s->sp = DM_SP_UNKNOWN;
+	} else if (dm_sp_is_reg(op0, UD_R_RBP, UD_R_EBP)) {
+		if ((u->mnemonic == UD_Imov) &&
+		    dm_sp_is_reg(op1, UD_R_RSP, UD_R_ESP))
+			s->fp = s->sp;
+		else if (u->mnemonic == UD_Ilea)
+			s->fp = dm_sp_lea(op1, s);
+		else
+			s->fp = DM_SP_UNKNOWN;
+	}
+}
+
+/*
+ * Bytes moved by a push or pop: a word for 16 bit operands, otherwise
+ * the stack width
+ */
+int
+dm_sp_push_width(struct ud *u)
+{
+	struct ud_operand	*op = &u->operand[0];
+
+	if ((u->mnemonic == UD_Ipushfw) || (u->mnemonic == UD_Ipopfw))
+		return (2);
+	if ((op->size == 16) && ((op->type == UD_OP_MEM) ||
+	    ((op->type == UD_OP_REG) && (op->base >= UD_R_AX) &&
+	    (op->base <= UD_R_R15W))))
+		return (2);
+	return ((u->dis_mode == 64) ? 8 : 4);
+}
+
+/* Is op the register, in either width? */
+int
+dm_sp_is_reg(struct ud_operand *op, enum ud_type r64, enum ud_type r32)
+{
+	return ((op->type == UD_OP_REG) &&
+	    ((op->base == r64) || (op->base == r32)));
+}
+
+/*
+ * lea off the stack or frame pointer
+ */
+int
+dm_sp_lea(struct ud_operand *op, struct dm_sp_state *s)
+{
+	int64_t			 disp = 0;
+
+	if ((op->type != UD_OP_MEM) || (op->index != UD_NONE))
+		return (DM_SP_UNKNOWN);
+	if (op->offset)
+		disp = (int64_t)dm_sccp_sext(op, op->offset);
+
+	if ((op->base == UD_R_RSP) || (op->base == UD_R_ESP))
+		return (dm_sp_add(s->sp, disp));
+	if ((op->base == UD_R_RBP) || (op->base == UD_R_EBP))
+		return (dm_sp_add(s->fp, disp));
+	return (DM_SP_UNKNOWN);
+}
+
+/*
+ * Add to a delta. Results too far out to be a real frame are taken as
+ * unknown, which also keeps them clear of DM_SP_TOP and DM_SP_UNKNOWN.
+ */
+int
+dm_sp_add(int delta, int64_t n)
+{
+	int64_t			 r = 0;
+
+	if ((delta == DM_SP_TOP) || (delta == DM_SP_UNKNOWN))
+		return (DM_SP_UNKNOWN);
+	r = (int64_t)delta + n;
+	if ((r <= -DM_SP_LIMIT) || (r >= DM_SP_LIMIT))
+		return (DM_SP_UNKNOWN);
+	return ((int)r);
+}
+
+/*
+ * Do the known stack pointer deltas flowing into v disagree? Entry also
+ * has the delta of 0 it is called with flowing in.
+ */
+int
+dm_sp_merge(struct dm_flow *f, struct dm_graph *g, int v)
+{
+	struct dm_sp_state	*s = NULL;
+	int			 known = (v == 0) ? 0 : DM_SP_TOP, e = 0;
+
+	for (e = g->pred_idx[v]; e < g->pred_idx[v + 1]; e++) {
+		s = DM_FLOW_OUT(f, g->pred[e]);
+		if ((s->sp == DM_SP_TOP) || (s->sp == DM_SP_UNKNOWN))
+			continue;
+		if (known == DM_SP_TOP)
+			known = s->sp;
+		else if (s->sp != known)
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Count an instruction towards the function's totals, given the deltas
+ * on its way in
+ */
+void
+dm_sp_tally(struct dm_sp_func *fn, struct ud *u, struct dm_sp_state *s)
+{
+	struct dm_sp_state	 after;
+
+	fn->insns++;
+	if (s->sp == DM_SP_TOP)
+		return;
+	if (s->sp == DM_SP_UNKNOWN) {
+		fn->unknown++;
+		return;
+	}
+	if ((u->mnemonic == UD_Iret) && (s->sp != 0))
+		fn->unbalanced++;
+
+	/* The deepest point may be just before a merge loses it */
+	after = *s;
+	dm_sp_step(u, &after);
+	if (-s->sp > fn->frame)
+		fn->frame = -s->sp;
+	if ((after.sp != DM_SP_UNKNOWN) && (-after.sp > fn->frame))
+		fn->frame = -after.sp;
+}
+
+/*
+ * Analyse one function straight from the mapped image. There is no CFG
+ * here, the graph is of single instructions with edges for fall through
+ * and direct jumps within the function. Only touches fn and its own
+ * memory, so any number of these may run at once.
+ */
+void
+dm_sp_func(struct dm_sp_func *fn, uint8_t bits)
+{
+	struct dm_sp_code	 c;
+	struct dm_flow		 f;
+	struct dm_graph		 g;
+	struct ud		 u;
+	int			 cap = 64, v = 0;
+
+	memset(&c, 0, sizeof(c));
+	c.insns = xmalloc(cap * sizeof(struct ud));
+	c.addrs = xmalloc(cap * sizeof(NADDR));
+
+	ud_init(&u);
+	ud_set_mode(&u, bits);
+	ud_set_input_buffer(&u, elf_img.base + fn->start,
+	    fn->end - fn->start);
+	ud_set_pc(&u, fn->start);
+	while (ud_disassemble(&u)) {
+		if (c.count == cap) {
+			cap *= 2;
+			c.insns = xrealloc(c.insns, cap * sizeof(struct ud));
+			c.addrs = xrealloc(c.addrs, cap * sizeof(NADDR));
+		}
+		c.addrs[c.count] = u.pc - ud_insn_len(&u);
+		c.insns[c.count++] = u;
+	}
+
+	if (c.count) {
+		dm_sp_code_graph(&c, &g);
+		memset(&f, 0, sizeof(f));
+		dm_sp_flow(&f);
+		f.threads = 1;
+		f.ctx = &c;
+		f.transfer = dm_sp_insn_transfer;
+		dm_flow_solve_graph(&f, &g);
+		fn->evals = f.evals;
+
+		for (v = 0; v < c.count; v++) {
+			fn->conflicts += dm_sp_merge(&f, &g, v);
+			dm_sp_tally(fn, &c.insns[v], DM_FLOW_IN(&f, v));
+		}
+		dm_flow_free(&f);
+		dm_graph_free(&g);
+	}
+
+	free(c.insns);
+	free(c.addrs);
+}
+
+/*
+ * Edges between the instructions of a function. Indirect jumps and jumps
+ * out of the function (tail calls) have none.
+ */
+void
+dm_sp_code_graph(struct dm_sp_code *c, struct dm_graph *g)
+{
+	struct ud		*u = NULL;
+	NADDR			 target = 0, *hit = NULL;
+	int			*from = NULL, *to = NULL, v = 0, m = 0;
+
+	from = xmalloc(2 * c->count * sizeof(int));
+	to = xmalloc(2 * c->count * sizeof(int));
+
+	for (v = 0; v < c->count; v++) {
+		u = &c->insns[v];
+		switch (u->mnemonic) {
+		case UD_Ijmp:
+		case UD_Iret:
+		case UD_Iretf:
+		case UD_Iiretw:
+		case UD_Iiretd:
+		case UD_Iiretq:
+		case UD_Ihlt:
+		case UD_Iud2:
+		case UD_Iinvalid:
+			break;
+		default:
+			if (v + 1 < c->count) {
+				from[m] = v;
+				to[m++] = v + 1;
+			}
+			break;
+		}
+
+		if ((u->mnemonic == UD_Icall) ||
+		    (u->operand[0].type != UD_OP_JIMM))
+			continue;
+		target = dm_get_jump_target(*u);
+		hit = bsearch(&target, c->addrs, c->count, sizeof(NADDR),
+		    dm_sp_addr_cmp);
+		if (hit != NULL) {
+			from[m] = v;
+			to[m++] = hit - c->addrs;
+		}
+	}
+
+	dm_graph_init(g, c->count, m, from, to);
+	free(from);
+	free(to);
+}
+
+int
+dm_sp_addr_cmp(const void *a1, const void *a2)
+{
+	NADDR			 a = *(const NADDR *)a1, b = *(const NADDR *)a2;
+
+	return ((a > b) - (a < b));
+}
+
+/*
+ * Run every function of the job. Functions are independent of each other
+ * so they are farmed out to worker threads, each claiming one at a time.
+ */
+void
+dm_sp_all(struct dm_sp_job *job)
+{
+	struct dm_sp_worker	*workers = NULL;
+	int			 nthreads = dm_nthreads(), i = 0;
+
+	if (nthreads > job->count)
+		nthreads = job->count;
+
+	if (nthreads > 1) {
+		DPRINTF(DM_D_INFO, "Analysing %d functions with %d threads",
+		    job->count, nthreads);
+
+		workers = xcalloc(nthreads, sizeof(struct dm_sp_worker));
+		for (i = 0; i < nthreads; i++) {
+			workers[i].job = job;
+			if (pthread_create(&workers[i].tid, NULL,
+			    dm_sp_worker, &workers[i]) != 0) {
+				DPRINTF(DM_D_WARN, "Can't start thread");
+				break;
+			}
+			workers[i].started = 1;
+		}
+
+		for (i = 0; i < nthreads; i++)
+			if (workers[i].started)
+				pthread_join(workers[i].tid, NULL);
+		free(workers);
+	}
+
+	/* Whatever the workers didn't get to (if any), we do here */
+	dm_sp_work(job);
+}
+
+void *
+dm_sp_worker(void *arg)
+{
+	struct dm_sp_worker	*w = arg;
+
+	dm_sp_work(w->job);
+
+	return (NULL);
+}
+
+void
+dm_sp_work(struct dm_sp_job *job)
+{
+	int			 i = 0;
+
+	while ((i = __atomic_fetch_add(&job->next, 1,
+	    __ATOMIC_RELAXED)) < job->count)
+		dm_sp_func(&job->funcs[i], job->bits);
+}
+
+char *
+dm_sp_fmt(int delta, char *buf, size_t len)
+{
+	if ((delta == DM_SP_UNKNOWN) || (delta == DM_SP_TOP))
+		snprintf(buf, len, "?");
+	else if (delta < 0)
+		snprintf(buf, len, "-0x%x", -delta);
+	else
+		snprintf(buf, len, "%s0x%x", delta ? "+" : "", delta);
+	return (buf);
+}
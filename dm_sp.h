@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2011, Ed Robbins <edd.robbins@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DM_SP_H
+#define __DM_SP_H
+
+#include <limits.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "dm_cfg.h"
+#include "dm_flow.h"
+
+/* Stack pointer deltas, relative to the stack pointer on entry */
+#define DM_SP_TOP		INT_MAX	/* Not reached (yet) */
+#define DM_SP_UNKNOWN		INT_MIN	/* Unknown, or differs by path */
+/* No frame is this big, deltas past it are garbage */
+#define DM_SP_LIMIT		(1 << 30)
+
+/* The stack and frame pointers at a point in a function */
+struct dm_sp_state {
+	int			 sp;
+	int			 fp;
+};
+
+/* What the analysis found in one function */
+struct dm_sp_func {
+	NADDR			 start;
+	NADDR			 end;
+	int			 insns;
+	int			 frame;	     /* Deepest the stack goes, bytes */
+	int			 conflicts;  /* Merges of differing deltas */
+	int			 unbalanced; /* Returns with a nonzero delta */
+	int			 unknown;    /* Insns with an unknown delta */
+	int			 evals;
+};
+
+/* A function being analysed straight from the image, without a CFG */
+struct dm_sp_code {
+	struct ud		*insns;
+	NADDR			*addrs;
+	int			 count;
+};
+
+/* All the functions of the binary, shared by all threads */
+struct dm_sp_job {
+	struct dm_sp_func	*funcs;
+	int			 count;
+	int			 next;	/* Next function to claim */
+	uint8_t			 bits;
+};
+
+struct dm_sp_worker {
+	pthread_t		 tid;
+	int			 started;
+	struct dm_sp_job	*job;
+};
+
+int			dm_cmd_spdelta(char **args);
+int			dm_cmd_spdelta_noargs(char **args);
+void			dm_sp(struct dm_flow *f, struct dm_sp_func *fn);
+void			dm_sp_flow(struct dm_flow *f);
+void			dm_sp_init(struct dm_flow *f, int v, void *in,
+			    void *out);
+void			dm_sp_top(struct dm_flow *f, void *val);
+void			dm_sp_meet(struct dm_flow *f, void *dst, void *src);
+int			dm_sp_meet_one(int a, int b);
+int			dm_sp_transfer(struct dm_flow *f, int v, void *in,
+			    void *out);
+int			dm_sp_insn_transfer(struct dm_flow *f, int v,
+			    void *in, void *out);
+int			dm_sp_out(void *out, struct dm_sp_state *s);
+void			dm_sp_step(struct ud *u, struct dm_sp_state *s);
+int			dm_sp_push_width(struct ud *u);
+int			dm_sp_is_reg(struct ud_operand *op, enum ud_type r64,
+			    enum ud_type r32);
+int			dm_sp_lea(struct ud_operand *op, struct dm_sp_state *s);
+int			dm_sp_add(int delta, int64_t n);
+int			dm_sp_merge(struct dm_flow *f, struct dm_graph *g,
+			    int v);
+void			dm_sp_tally(struct dm_sp_func *fn, struct ud *u,
+			    struct dm_sp_state *s);
+void			dm_sp_func(struct dm_sp_func *fn, uint8_t bits);
+void			dm_sp_code_graph(struct dm_sp_code *c,
+			    struct dm_graph *g);
+int			dm_sp_addr_cmp(const void *a1, const void *a2);
+void			dm_sp_all(struct dm_sp_job *job);
+void			*dm_sp_worker(void *arg);
+void			dm_sp_work(struct dm_sp_job *job);
+char			*dm_sp_fmt(int delta, char *buf, size_t len);
+
+#endif
@@ -16,6 +16,11 @@
 #define _GNU_SOURCE
 #include "dm_ssa.h"
 #include "dm_dwarf.h"
+#include "dm_util.h"
+#include "dm_bitset.h"
+#include "dm_live.h"
+#include "dm_slot.h"
+#include "dm_sp.h"
 
 void opr_cast(struct ud* u, struct ud_operand* op);
 
@@ -28,15 +33,50 @@ extern struct ptrs		*p_head;
 extern struct ptrs		*p;
 extern int			 p_length;
 
+extern void			**rpost;
+
 struct dm_ssa_index		*indices = NULL;
+int				 ssa_mode = DM_SSA_MINIMAL;
+
+/* Liveness, for semi-pruned and pruned SSA */
+struct dm_live			 ssa_live;
+/* Names used in some block other than the one defining them */
+uint64_t			 ssa_global[DM_BITSET_WORDS(DM_REG_COUNT)];
+
+/* Registers given a new version during renaming, in order */
+int				*ssa_log = NULL;
+int				 ssa_log_count = 0, ssa_log_cap = 0;
 
 int
 dm_cmd_ssa(char **args)
 {
 	NADDR			 addr = cur_addr;
-	struct dm_cfg_node	*cfg = NULL;
 	(void) args;
 
+	/* Build SSA form, pruned as the user likes */
+	dm_ssa_open();
+
+	/* Print SSA version of the function */
+	dm_print_ssa();
+
+	/* Free SSA, frontiers and CFG */
+	dm_ssa_close();
+
+	/* Rewind back */
+	dm_seek(addr);
+
+	return (0);
+}
+
+/*
+ * Recover the CFG of the current function and build SSA form of it in the
+ * mode the user has chosen. Undo with dm_ssa_close().
+ */
+struct dm_cfg_node *
+dm_ssa_open()
+{
+	struct dm_cfg_node	*cfg = NULL;
+
 	/* Initialise structures */
 	dm_init_cfg();
 
@@ -49,21 +89,18 @@ dm_cmd_ssa(char **args)
 	/* Build dominance frontier sets*/
 	dm_dom_frontiers();
 
-	/* Initialise register index structure */
-	dm_ssa_index_init();
-
-	/* Build lists of variables defined in each node */
-	dm_ssa_find_var_defs();
-
-	/* Place phi functions in correct nodes */
-	dm_place_phi_functions();
+	ssa_mode = dm_ssa_mode();
+	dm_ssa_build(cfg);
 
-	/* Rename all the variables with SSA indexes */
-	dm_rename_variables(cfg);
-
-	/* Print SSA version of the function */
-	dm_print_ssa();
+	return (cfg);
+}
 
+/*
+ * Free everything dm_ssa_open() built
+ */
+void
+dm_ssa_close()
+{
 	/* Free all memory used */
 	dm_free_ssa();
 
@@ -72,11 +109,114 @@ dm_cmd_ssa(char **args)
 
 	/* Free all CFG structures */
 	dm_free_cfg();
+}
 
-	/* Rewind back */
+/*
+ * Build minimal, semi-pruned and pruned SSA of the current function and
+ * compare how many phi functions each places and how long each takes
+ */
+int
+dm_cmd_ssastat(char **args)
+{
+	NADDR			 addr = cur_addr;
+	struct dm_cfg_node	*cfg = NULL, *node = NULL;
+	char			*names[] = {"minimal", "semi-pruned", "pruned"};
+	int			 mode = 0, phis = 0, phi_args = 0, i = 0;
+	double			 t0, t1;
+
+	(void) args;
+
+	dm_init_cfg();
+	cfg = dm_recover_cfg();
+	dm_dom(cfg);
+	dm_dom_frontiers();
+
+	printf("\n%s\n", DM_RULE);
+	printf("%-12s | %-8s | %-10s | %s\n", "Mode", "Phis", "Phi args",
+	    "Build (ms)");
+	printf("%s\n", DM_RULE);
+	for (mode = DM_SSA_MINIMAL; mode <= DM_SSA_PRUNED; mode++) {
+		ssa_mode = mode;
+		t0 = dm_dom_bench_ms();
+		dm_ssa_build(cfg);
+		t1 = dm_dom_bench_ms();
+
+		phis = phi_args = 0;
+		for (p = p_head; p != NULL; p = p->next) {
+			node = (struct dm_cfg_node*)p->ptr;
+			phis += node->pf_count;
+			for (i = 0; i < node->pf_count; i++)
+				phi_args += node->phi_functions[i].arguments;
+		}
+		printf("%-12s | %-8d | %-10d | %10.3f\n", names[mode], phis,
+		    phi_args, t1 - t0);
+
+		dm_free_ssa();
+	}
+	printf("%s\n\n", DM_RULE);
+
+	dm_dom_frontiers_free();
+	dm_free_cfg();
 	dm_seek(addr);
 
-	return (0);
+	return (DM_OK);
+}
+
+/*
+ * Which flavour of SSA does the user want?
+ */
+int
+dm_ssa_mode()
+{
+	struct dm_setting	*s = NULL;
+
+	if (dm_find_setting("ssa.mode", &s) != DM_OK)
+		return (DM_SSA_MINIMAL);
+	if (strcmp(s->val.sval, "semi") == 0)
+		return (DM_SSA_SEMI);
+	if (strcmp(s->val.sval, "pruned") == 0)
+		return (DM_SSA_PRUNED);
+
+	return (DM_SSA_MINIMAL);
+}
+
+/*
+ * Build SSA form of a CFG whose dominators and dominance frontiers are
+ * known, in the current ssa_mode
+ */
+void
+dm_ssa_build(struct dm_cfg_node *cfg)
+{
+	int			 i = 0;
+
+	/* Initialise register index structure */
+	dm_ssa_index_init();
+
+	/* Build lists of variables defined in each node */
+	dm_ssa_find_var_defs();
+
+	/*
+	 * Anything a block uses before defining it is used across blocks.
+	 * Pruned SSA needs to know what is live where too.
+	 */
+	memset(ssa_global, 0, sizeof(ssa_global));
+	if (ssa_mode != DM_SSA_MINIMAL) {
+		dm_live_init(&ssa_live);
+		dm_live_local(&ssa_live);
+		for (i = 0; i < ssa_live.n * ssa_live.words; i++)
+			ssa_global[i % ssa_live.words] |= ssa_live.use[i];
+		if (ssa_mode == DM_SSA_PRUNED)
+			dm_live_solve(&ssa_live);
+	}
+
+	/* Place phi functions in correct nodes */
+	dm_place_phi_functions();
+
+	/* Rename all the variables with SSA indexes */
+	dm_rename_variables(cfg);
+
+	/* Then the stack slots */
+	dm_slots(cfg);
 }
 
 /*
@@ -88,7 +228,7 @@ dm_ssa_free()
 	struct dm_cfg_node	*node = NULL;
 	int			 i = 0;
 
-	for (i = 0; i < UD_OP_CONST + 1; i++)
+	for (i = 0; i < DM_REG_COUNT; i++)
 		free(indices[i].stack);
 	free(indices);
 
@@ -176,9 +316,11 @@ dm_print_ssa()
 {
 	int				 i = 0;
 	struct dm_cfg_node		*node = NULL;
+	NADDR				 addr;
 
 	/* Sort blocks in order of starting address */
 	p_head = mergeSort(p_head);
+	dm_dwarf_source_reset();
 
 	/* Print blocks in ssa assembler */
 	for (p = p_head; (p != NULL); p = p->next) {
@@ -191,8 +333,13 @@ dm_print_ssa()
 			dm_print_phi_function(&node->phi_functions[i]);
 			printf("\n");
 		}
+		dm_slot_print_phis(node);
 		/* Print standard instructions */
 		for (i = 0; i < node->i_count; i++) {
+			addr = node->instructions[i]->ud.pc -
+			    ud_insn_len(&(node->instructions[i]->ud));
+			dm_dwarf_show_inline(addr);
+			dm_dwarf_show_source(addr);
 			dm_print_ssa_instruction(node->instructions[i]);
 			printf("\n");
 		}
@@ -226,11 +373,11 @@ dm_print_phi_function(struct phi_function *phi)
 	char	*temp = NULL, *temp2 = NULL;
 
 	printf("%s", ANSII_GREEN);
-	length2 += asprintf(&temp, "%39smov %s_%d, phi(", "", ud_reg_tab[phi->var - 1], phi->index);
+	length2 += asprintf(&temp, "%39smov %s_%d, phi(", "", dm_ssa_reg_name(phi->var), phi->index);
 
 	for (i = 0; i < phi->arguments; i++){
 		temp2 = temp;
-		length2 += asprintf(&temp, "%s%s_%d", temp, ud_reg_tab[phi->var - 1], phi->indexes[i]);
+		length2 += asprintf(&temp, "%s%s_%d", temp, dm_ssa_reg_name(phi->var), phi->indexes[i]);
 		free(temp2);
 		if (i != phi->arguments - 1) {
 			temp2 = temp;
@@ -285,10 +432,9 @@ dm_phi_remove_duplicates(struct phi_function *phi)
 int
 dm_print_ssa_instruction(struct instruction *insn)
 {
-	struct dm_dwarf_sym_cache_entry *sym = NULL;
 	struct dm_cfg_node		*found_node = NULL;
 	NADDR				 addr = 0;
-	char				*hex = NULL, *temp = NULL;
+	char				*hex = NULL, *temp = NULL, desc[128];
 	int				 colour_set = 0, length = 0;
 	/* Translate into ssa assembler */
 	dm_translate_intel_ssa(insn);
@@ -323,8 +469,8 @@ dm_print_ssa_instruction(struct instruction *insn)
 		free(temp);
 	}
 	else if ((insn->ud.mnemonic == UD_Icall) &&
-	    (dm_dwarf_find_sym_at_offset(addr, &sym) == DM_OK)) {
-		asprintf(&temp, "%s (%s)", insn->ud.insn_buffer, sym->name);
+	    (dm_dwarf_describe_offset(addr, desc, sizeof(desc)))) {
+		asprintf(&temp, "%s (%s)", insn->ud.insn_buffer, desc);
 		length += printf(": %-25s%-40s  ", hex, temp);
 		free(temp);
 	}
@@ -340,36 +486,97 @@ dm_print_ssa_instruction(struct instruction *insn)
 }
 
 /*
- * Index all variable uses, build a list of instructions for each block
+ * Index all variable uses, build a list of instructions for each block.
+ *
+ * Walks the dominator tree with an explicit stack so that deep trees can't
+ * overflow the C stack. Every version pushed is noted in a log, and when
+ * the walk leaves a block the log is unwound back to where it was on entry,
+ * rather than disassembling the block again to find its definitions.
  */
 void
 dm_rename_variables(struct dm_cfg_node *n)
+{
+	struct dm_ssa_rename_frame	*frames = NULL, *f = NULL;
+	struct dm_cfg_node		*child = NULL;
+	int				 f_count = 0, f_cap = 16;
+
+	frames = xmalloc(f_cap * sizeof(*frames));
+	frames[f_count].node = n;
+	frames[f_count].child = 0;
+	frames[f_count++].log = ssa_log_count;
+	dm_ssa_rename_block(n);
+
+	while (f_count) {
+		f = &frames[f_count - 1];
+		if (f->child < f->node->dc_count) {
+			child = f->node->dom_children[f->child++];
+			if (f_count == f_cap) {
+				f_cap *= 2;
+				frames = xrealloc(frames,
+				    f_cap * sizeof(*frames));
+			}
+			frames[f_count].node = child;
+			frames[f_count].child = 0;
+			frames[f_count++].log = ssa_log_count;
+			dm_ssa_rename_block(child);
+			continue;
+		}
+		/* Pop every version this block pushed */
+		while (ssa_log_count > f->log)
+			dm_ssa_index_stack_pop(ssa_log[--ssa_log_count]);
+		f_count--;
+	}
+	free(frames);
+	free(ssa_log);
+	ssa_log = NULL;
+	ssa_log_count = ssa_log_cap = 0;
+}
+
+/*
+ * Make a new version of a register, returning it
+ */
+int
+dm_ssa_rename_def(int reg)
+{
+	if (ssa_log_count == ssa_log_cap) {
+		ssa_log_cap = ssa_log_cap ? ssa_log_cap * 2 : 64;
+		ssa_log = xrealloc(ssa_log, ssa_log_cap * sizeof(int));
+	}
+	ssa_log[ssa_log_count++] = reg;
+	indices[reg].count++;
+	dm_ssa_index_stack_push(reg, indices[reg].count);
+	return (indices[reg].count);
+}
+
+/*
+ * Rename the phi functions and instructions of one block, and fill in its
+ * arguments to the phi functions of its successors
+ */
+void
+dm_ssa_rename_block(struct dm_cfg_node *n)
 {
 	struct instruction	*insn = NULL;
-	struct ptrs		*p_iter = NULL;
 	struct dm_cfg_node	*node = NULL;
 	int			 index[3][2] = {{0, 0}, {0, 0}, {0, 0}};
-	int			 reg = 0, s_size = 0;
+	int			 cl[DM_SSA_MAX_CLOBBERS];
+	int			 cl_index[DM_SSA_MAX_CLOBBERS];
+	int			 reg = 0, s_size = 0, def = 0, cl_count = 0;
 	int			 i = 0, j = 0, k = 0;
 	/* For each statement in node n */
 	/* Start with phi functions */
-	for (i = 0; i < n->pf_count; i++) {
-		reg = n->phi_functions[i].var;
-		indices[reg].count++;
-		dm_ssa_index_stack_push((enum ud_type)reg, indices[reg].count);
+	for (i = 0; i < n->pf_count; i++)
 		n->phi_functions[i].index =
-		    indices[reg].stack[indices[reg].s_size - 1];
-	}
+		    dm_ssa_rename_def(n->phi_functions[i].var);
 	/* Then normal instructions/statements */
 	for (dm_seek(n->start); ud.pc - ud_insn_len(&ud) != n->end;) {
 		dm_ssa_disassemble(&ud);
 		/* For each use of a variable, use the correct index */
 		/* Operand 0 */
 		if (ud.operand[0].type == UD_OP_MEM) {
-			reg = (int)ud.operand[0].base;
+			reg = dm_ssa_reg(ud.operand[0].base);
 			s_size = indices[reg].s_size - 1;
 			index[0][0] = indices[reg].stack[s_size];
-			reg = (int)ud.operand[0].index;
+			reg = dm_ssa_reg(ud.operand[0].index);
 			s_size = indices[reg].s_size - 1;
 			index[0][1] = indices[reg].stack[s_size];
 		}
@@ -377,15 +584,15 @@ dm_rename_variables(struct dm_cfg_node *n)
 			index[0][0] = index[0][1] = -1;
 		/* Operand 1 */
 		if (ud.operand[1].type == UD_OP_MEM) {
-			reg = (int)ud.operand[1].base;
+			reg = dm_ssa_reg(ud.operand[1].base);
 			s_size = indices[reg].s_size - 1;
 			index[1][0] = indices[reg].stack[s_size];
-			reg = (int)ud.operand[1].index;
+			reg = dm_ssa_reg(ud.operand[1].index);
 			s_size = indices[reg].s_size - 1;
 			index[1][1] = indices[reg].stack[s_size];
 		}
 		else if (ud.operand[1].type == UD_OP_REG) {
-			reg = (int)ud.operand[1].base;
+			reg = dm_ssa_reg(ud.operand[1].base);
 			s_size = indices[reg].s_size - 1;
 			index[1][0] = indices[reg].stack[s_size];
 			index[1][1] = -1;
@@ -394,41 +601,61 @@ dm_rename_variables(struct dm_cfg_node *n)
 			index[1][0] = index[1][1] = -1;
 		/* Operand 3 */
 		if (ud.operand[2].type == UD_OP_MEM) {
-			reg = (int)ud.operand[2].base;
+			reg = dm_ssa_reg(ud.operand[2].base);
 			s_size = indices[reg].s_size - 1;
 			index[2][0] = indices[reg].stack[s_size];
-			reg = (int)ud.operand[2].index;
+			reg = dm_ssa_reg(ud.operand[2].index);
 			s_size = indices[reg].s_size - 1;
 			index[2][1] = indices[reg].stack[s_size];
 		}
 		else if (ud.operand[2].type == UD_OP_REG) {
-			reg = (int)ud.operand[2].base;
+			reg = dm_ssa_reg(ud.operand[2].base);
 			s_size = indices[reg].s_size - 1;
 			index[2][0] = indices[reg].stack[s_size];
 			index[2][1] = -1;
 		}
-		/* Is there a definition of a variable? */
+		/*
+		 * Is there a definition of a variable? If the old value is
+		 * read as well (add, or a write to al only) keep the version
+		 * read in index[0][1]
+		 */
+		def = DM_REG_NONE;
 		if (instructions[ud.mnemonic].write &&
 		    ud.operand[0].type == UD_OP_REG) {
-			reg = (int)ud.operand[0].base;
-			indices[reg].count++;
-			dm_ssa_index_stack_push((enum ud_type)reg,
-			    indices[reg].count);
+			reg = def = dm_ssa_reg(ud.operand[0].base);
 			s_size = indices[reg].s_size - 1;
-			index[0][0] = indices[reg].stack[s_size];
-			index[0][1] = -1;
+			index[0][1] = dm_ssa_insn_rmw(&ud) ?
+			    indices[reg].stack[s_size] : -1;
+			index[0][0] = dm_ssa_rename_def(reg);
 		}
 		else if (ud.operand[0].type == UD_OP_REG) {
-			reg = (int)ud.operand[0].base;
+			reg = dm_ssa_reg(ud.operand[0].base);
 			s_size = indices[reg].s_size - 1;
 			index[0][0] = indices[reg].stack[s_size];
 			index[0][1] = -1;
 		}
 
+		/*
+		 * Registers written implicitly (rax by a call, rdx by div..)
+		 * get a new version too, after the explicit definition
+		 */
+		memset(cl_index, 0xff, sizeof(cl_index));
+		cl_count = dm_ssa_insn_clobbers(&ud, cl);
+		for (k = 0; k < cl_count; k++)
+			if ((cl[k] != def) && (cl[k] != DM_REG_NONE))
+				cl_index[k] = dm_ssa_rename_def(cl[k]);
+
 		/* Create a new instruction object and store this data */
 		insn = malloc(sizeof(struct instruction));
 		insn->ud = ud;
 		memcpy(insn->index, index, sizeof(index));
+		memcpy(insn->cl_index, cl_index, sizeof(cl_index));
+		/* Stack slots are versioned later, by dm_slots() */
+		for (k = 0; k < 3; k++) {
+			insn->slot[k] = -1;
+			insn->sindex[k][0] = insn->sindex[k][1] = -1;
+		}
+		insn->sp_delta = insn->fp_delta = DM_SP_UNKNOWN;
 		insn->constraints = NULL;
 		insn->c_counts = NULL;
 		insn->d_count = 0;
@@ -452,27 +679,6 @@ dm_rename_variables(struct dm_cfg_node *n)
 			    indices[reg].stack[indices[reg].s_size - 1];
 		}
 	}
-	/* Call this function on all children (in dom tree) of this node */
-	for (p_iter = p_head; p_iter != NULL; p_iter = p_iter->next) {
-		node = (struct dm_cfg_node*)p_iter->ptr;
-		if ((node->idom == n) && (node != n))
-			dm_rename_variables(node);
-	}
-	/* Now for every definition of a variable in this node pop the ssa
-	 * index that was added */
-	for (dm_seek(n->start); ud.pc - ud_insn_len(&ud) != n->end;) {
-		ud_disassemble(&ud);
-		if (instructions[ud.mnemonic].write &&
-		    ud.operand[0].type == UD_OP_REG) {
-			reg = (int)ud.operand[0].base;
-			dm_ssa_index_stack_pop(reg);
-		}
-	}
-	/* Same for phi functions */
-	for (i = 0; i < n->pf_count; i++) {
-		reg = n->phi_functions[i].var;
-		dm_ssa_index_stack_pop(reg);
-	}
 }
 
 /*
@@ -550,6 +756,8 @@ dm_translate_intel_ssa(struct instruction *insn)
 				cast = 1;
 		insn->cast[0] = cast;
 		gen_operand_ssa(u, &u->operand[0], cast, index[0]);
+		if (insn->sindex[0][0] != -1)
+			mkasm(u, "_%d", insn->sindex[0][0]);
 	}
 	/* operand 2 */
 	if (u->operand[1].type != UD_NONE) {
@@ -569,6 +777,8 @@ dm_translate_intel_ssa(struct instruction *insn)
 		}
 		insn->cast[1] = cast;
 		gen_operand_ssa(u, &u->operand[1], cast, index[1]);
+		if (insn->sindex[1][0] != -1)
+			mkasm(u, "_%d", insn->sindex[1][0]);
 	}
 
 	/* operand 3 */
@@ -576,6 +786,8 @@ dm_translate_intel_ssa(struct instruction *insn)
 		mkasm(u, ", ");
 		insn->cast[2] = u->c3;
 		gen_operand_ssa(u, &u->operand[2], u->c3, index[2]);
+		if (insn->sindex[2][0] != -1)
+			mkasm(u, "_%d", insn->sindex[2][0]);
 	}
 }
 
@@ -721,82 +933,106 @@ gen_operand_ssa(struct ud* u, struct ud_operand* op, int syn_cast, int *index)
 }
 
 /*
- * Place phi functions in all the correct nodes
+ * Place phi functions in all the correct nodes. This is Cytron et al's
+ * iterated dominance frontier walk: has_already[] and work[] are stamped
+ * with the variable number rather than cleared for each variable, so each
+ * node is put on the worklist and given a phi at most once per variable.
  */
 void
 dm_place_phi_functions()
 {
-	struct dm_cfg_node	**W = NULL, *n = NULL, *dn = NULL;//, **B = NULL;
-	unsigned int		  i = 0;
-	int			  j = 0, k = 0;
-	int			  w_size = 0, duplicate = 0;//, b_size = 0;
-
-	/* For each variable */
-	for (i = 0; i < UD_OP_CONST + 1; i++) {
-		/* Build a worklist W */
-		free(W);
-		W = malloc(indices[i].dn_count * sizeof(void*));
-		for (j = 0; j < indices[i].dn_count; j++)
-			W[j] = indices[i].def_nodes[j];
-		w_size = indices[i].dn_count;
-		/* While the worklist is not empty */
+	struct dm_cfg_node	**W = NULL, **placed = NULL, *n = NULL, *dn = NULL;
+	struct phi_function	 *phi = NULL;
+	int			 *has_already = NULL, *work = NULL;
+	int			  i = 0, j = 0, w_size = 0, stamp = 0;
+
+	W = malloc(p_length * sizeof(void*));
+	placed = malloc(p_length * sizeof(void*));
+	has_already = calloc(p_length, sizeof(int));
+	work = calloc(p_length, sizeof(int));
+
+	/* For each variable that is ever defined */
+	for (i = 0; i < DM_REG_COUNT; i++) {
+		if (!indices[i].dn_count)
+			continue;
+		/* A name never used outside its defining block needs no phi */
+		if ((ssa_mode != DM_SSA_MINIMAL) &&
+		    !DM_BITSET_ISSET(ssa_global, i))
+			continue;
+		stamp = i + 1;
+
+		/* Start the worklist W with the defining nodes */
+		w_size = 0;
+		for (j = 0; j < indices[i].dn_count; j++) {
+			n = indices[i].def_nodes[j];
+			work[n->rpost] = stamp;
+			W[w_size++] = n;
+		}
+
+		indices[i].pn_count = 0;
 		while (w_size) {
-			/* Find a node n that hasn't already been checked */
-			/*while (w_size &&
-			    dm_array_contains(B, b_size, W[w_size -1]))
-				w_size--;*/
-			/*if (!w_size)
-				break;*/
-			/* Remove node n from W */
-			n = W[w_size - 1];
-			W = realloc(W, --w_size * sizeof(void*));
-			/* Add n to blacklist so we dont check it twice or get
-			 * stuck in an infinite loop */
-			/*B = realloc(B, ++b_size * sizeof(void*));
-			B[b_size - 1] = n;*/
+			n = W[--w_size];
 			/* For each node dn in DF of n */
 			for (j = 0; j < n->df_count; j++) {
 				dn = (struct dm_cfg_node*)n->df_set[j];
+				if (has_already[dn->rpost] == stamp)
+					continue;
 				/* Note in i that i has a phi node in dn */
-				if (!dm_array_contains(indices[i].phi_nodes,
-				    indices[i].pn_count, dn)) {
-					indices[i].phi_nodes =
-					    realloc(indices[i].phi_nodes,
-					    ++indices[i].pn_count *
-					    sizeof(void*));
-					indices[i].phi_nodes
-					    [indices[i].pn_count -1] = dn;
+				has_already[dn->rpost] = stamp;
+				/*
+				 * Pruned SSA only wants the phi if i is live
+				 * into dn, but the walk still goes through dn
+				 */
+				if ((ssa_mode != DM_SSA_PRUNED) ||
+				    DM_BITSET_ISSET(DM_LIVE_SET(&ssa_live,
+				    ssa_live.in, dn->rpost), i)) {
+					placed[indices[i].pn_count++] = dn;
+					dn->pf_count++;
 				}
-				duplicate = 0;
-				/* Put phi functions in block dn */
-				for (k = 0; k < dn->pf_count; k++)
-					if (dn->phi_functions[k].var == i) {
-						duplicate = 1;
-						break;
-					}
-				if (!duplicate) {
-					dn->phi_functions =
-					    realloc(dn->phi_functions,
-					    ++dn->pf_count * sizeof(struct phi_function));
-					dn->phi_functions[dn->pf_count - 1].var = i;
-					dn->phi_functions[dn->pf_count - 1].arguments = dn->p_count;
-					dn->phi_functions[dn->pf_count - 1].indexes = malloc(dn->p_count * sizeof(int));
-					dn->phi_functions[dn->pf_count - 1].index = 0;
-					dn->phi_functions[dn->pf_count - 1].constraints = NULL;
-					dn->phi_functions[dn->pf_count - 1].c_counts = NULL;
-					dn->phi_functions[dn->pf_count - 1].d_count = 0;
-				}
-				/* Add dn to worklist */
-				if (dn != n) { //!dm_array_contains(W, w_size, dn)) {
-					W = realloc(W, ++w_size *
-					    sizeof(void*));
-					W[w_size - 1] = dn;
+				/* A phi is a definition too */
+				if (work[dn->rpost] != stamp) {
+					work[dn->rpost] = stamp;
+					W[w_size++] = dn;
 				}
 			}
 		}
+
+		if (indices[i].pn_count) {
+			indices[i].phi_nodes = malloc(indices[i].pn_count *
+			    sizeof(void*));
+			memcpy(indices[i].phi_nodes, placed,
+			    indices[i].pn_count * sizeof(void*));
+		}
+	}
+
+	/* Now we know how many phis each node gets, allocate them once */
+	for (p = p_head; p != NULL; p = p->next) {
+		n = (struct dm_cfg_node*)p->ptr;
+		if (n->pf_count)
+			n->phi_functions = malloc(n->pf_count *
+			    sizeof(struct phi_function));
+		n->pf_count = 0;
+	}
+
+	/* Put phi functions in the blocks */
+	for (i = 0; i < DM_REG_COUNT; i++) {
+		for (j = 0; j < indices[i].pn_count; j++) {
+			dn = indices[i].phi_nodes[j];
+			phi = &dn->phi_functions[dn->pf_count++];
+			phi->var = i;
+			phi->arguments = dn->p_count;
+			phi->indexes = malloc(dn->p_count * sizeof(int));
+			phi->index = 0;
+			phi->constraints = NULL;
+			phi->c_counts = NULL;
+			phi->d_count = 0;
+		}
 	}
-	//free(B);
+
 	free(W);
+	free(placed);
+	free(has_already);
+	free(work);
 }
 
 /*
@@ -820,73 +1056,384 @@ void
 dm_ssa_find_var_defs()
 {
 	struct dm_cfg_node	*n = NULL;
-	unsigned int		 read = 0;
-	enum ud_type		 reg = 0;
-	int			 duplicate = 0, i =0;
+	int			 uses[DM_SSA_MAX_USES];
+	int			 cl[DM_SSA_MAX_CLOBBERS];
+	int			 reg = 0, cl_count = 0, k = 0;
 
 	/* For all nodes n */
 	for (p = p_head; p != NULL; p = p->next) {
 		n = (struct dm_cfg_node*)p->ptr;
 		/* For all statements in node n */
 		for (dm_seek(n->start); ud.pc - ud_insn_len(&ud) != n->end;) {
-			read = ud_disassemble(&ud);
-			//n->s_count++;
+			ud_disassemble(&ud);
+			dm_ssa_insn_vars(&ud, uses, &reg);
 			/* If instruction writes to a register */
-			if ((instructions[ud.mnemonic].write)
-			    && (ud.operand[0].type == UD_OP_REG)) {
-				reg = ud.operand[0].base;
-				/* Record that n contains definition of reg */
-				if (!dm_array_contains(indices[reg].def_nodes,
-				    indices[reg].dn_count, n)) {
-					indices[reg].def_nodes
-					    = realloc(indices[reg].def_nodes,
-					    ++indices[reg].dn_count
-					    * sizeof(void*));
-					indices[reg].def_nodes
-					    [indices[reg].dn_count -1] = n;
-				}
-				duplicate = 0;
-				for (i = 0; i < n->dv_count; i++)
-					if (n->def_vars[i] == reg) {
-						duplicate = 1;
-						break;
-					}
-				if (!duplicate) {
-					n->def_vars = realloc(n->def_vars,
-					    ++n->dv_count * sizeof(int));
-					n->def_vars[n->dv_count -1] = reg;
-				}
-			}
+			if (reg != -1)
+				dm_ssa_add_var_def(n, reg);
+			/* Implicit writes are renamed too, so need phis */
+			cl_count = dm_ssa_insn_clobbers(&ud, cl);
+			for (k = 0; k < cl_count; k++)
+				if ((cl[k] != reg) && (cl[k] != DM_REG_NONE))
+					dm_ssa_add_var_def(n, cl[k]);
+		}
+	}
+}
+
+/*
+ * Record that n contains a definition of reg. Nodes are visited one at a
+ * time, so n can only be a duplicate of the last entry.
+ */
+void
+dm_ssa_add_var_def(struct dm_cfg_node *n, int reg)
+{
+	int			 i = 0;
+
+	if (!indices[reg].dn_count ||
+	    (indices[reg].def_nodes[indices[reg].dn_count - 1] != n)) {
+		indices[reg].def_nodes = realloc(indices[reg].def_nodes,
+		    ++indices[reg].dn_count * sizeof(void*));
+		indices[reg].def_nodes[indices[reg].dn_count - 1] = n;
+	}
+	for (i = 0; i < n->dv_count; i++)
+		if (n->def_vars[i] == reg)
+			return;
+	n->def_vars = realloc(n->def_vars, ++n->dv_count * sizeof(int));
+	n->def_vars[n->dv_count - 1] = reg;
+}
+
+/*
+ * Does this instruction zero its destination whatever was in it
+ * (xor eax, eax)?
+ */
+int
+dm_ssa_insn_zero(struct ud *u)
+{
+	switch (u->mnemonic) {
+	case UD_Ixor:
+	case UD_Isub:
+	case UD_Ipxor:
+	case UD_Ixorps:
+	case UD_Ixorpd:
+		return ((u->operand[0].type == UD_OP_REG) &&
+		    (u->operand[1].type == UD_OP_REG) &&
+		    (u->operand[0].base == u->operand[1].base));
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Does this instruction read the register it writes? True of most
+ * things (add), and of writes to part of a register (mov al, 1).
+ */
+int
+dm_ssa_insn_rmw(struct ud *u)
+{
+	if ((!instructions[u->mnemonic].write) ||
+	    (u->operand[0].type != UD_OP_REG))
+		return (0);
+	if ((!instructions[u->mnemonic].kill) && (!dm_ssa_insn_zero(u)))
+		return (1);
+
+	/*
+	 * A 32 bit write zero extends, 8 and 16 bit writes merge. That goes
+	 * for xor al, al too, it keeps the rest of rax.
+	 */
+	return ((dm_ssa_reg(u->operand[0].base) < DM_REG_SEG) &&
+	    (dm_ssa_reg_width(u->operand[0].base) < 32));
+}
+
+/*
+ * The names an instruction reads and the name it defines (or -1). Only
+ * explicit register operands are considered.
+ */
+int
+dm_ssa_insn_vars(struct ud *u, int *uses, int *def)
+{
+	int			 n = 0, i = 0, reg = 0;
+
+	*def = -1;
+	for (i = 0; i < 3; i++) {
+		if (u->operand[i].type == UD_OP_MEM) {
+			if ((reg = dm_ssa_reg(u->operand[i].base)) !=
+			    DM_REG_NONE)
+				uses[n++] = reg;
+			if ((reg = dm_ssa_reg(u->operand[i].index)) !=
+			    DM_REG_NONE)
+				uses[n++] = reg;
+		}
+		else if ((u->operand[i].type == UD_OP_REG) && (i > 0) &&
+		    (!dm_ssa_insn_zero(u)))
+			uses[n++] = dm_ssa_reg(u->operand[i].base);
+	}
+
+	if (u->operand[0].type == UD_OP_REG) {
+		reg = dm_ssa_reg(u->operand[0].base);
+		if (instructions[u->mnemonic].write) {
+			*def = reg;
+			if (dm_ssa_insn_rmw(u))
+				uses[n++] = reg;
+		}
+		else
+			uses[n++] = reg;
+	}
+
+	return (n);
+}
+
+/*
+ * The registers an instruction writes without naming them as its
+ * destination, at most DM_SSA_MAX_CLOBBERS. A call may write any caller
+ * saved register. Returns how many there are.
+ */
+int
+dm_ssa_insn_clobbers(struct ud *u, int *regs)
+{
+	static const enum ud_type	 saved[] = {
+	    UD_R_RAX, UD_R_RCX, UD_R_RDX, UD_R_RSI, UD_R_RDI,
+	    UD_R_R8, UD_R_R9, UD_R_R10, UD_R_R11 };
+	int				 n = 0, i = 0;
+
+	switch (u->mnemonic) {
+	case UD_Icall:
+		for (i = 0; i < (int)(sizeof(saved) / sizeof(saved[0])); i++)
+			regs[n++] = dm_ssa_reg(saved[i]);
+		regs[n++] = dm_ssa_reg(UD_R_RSP);
+		break;
+	case UD_Isyscall:
+		regs[n++] = dm_ssa_reg(UD_R_RAX);
+		regs[n++] = dm_ssa_reg(UD_R_RCX);
+		regs[n++] = dm_ssa_reg(UD_R_R11);
+		break;
+	case UD_Ixchg:
+	case UD_Ixadd:
+		if (u->operand[1].type == UD_OP_REG)
+			regs[n++] = dm_ssa_reg(u->operand[1].base);
+		break;
+	case UD_Icmpxchg:
+	case UD_Ilahf:
+	case UD_Ixlatb:
+	case UD_Icbw:
+	case UD_Icwde:
+	case UD_Icdqe:
+	case UD_Iint:
+		regs[n++] = dm_ssa_reg(UD_R_RAX);
+		break;
+	case UD_Icwd:
+	case UD_Icdq:
+	case UD_Icqo:
+		regs[n++] = dm_ssa_reg(UD_R_RDX);
+		break;
+	case UD_Iimul:
+		/* Only the one operand form */
+		if (u->operand[1].type != UD_NONE)
+			break;
+		/* FALLTHROUGH */
+	case UD_Imul:
+	case UD_Idiv:
+	case UD_Iidiv:
+	case UD_Icmpxchg8b:
+	case UD_Irdtsc:
+	case UD_Irdmsr:
+	case UD_Irdpmc:
+		regs[n++] = dm_ssa_reg(UD_R_RAX);
+		regs[n++] = dm_ssa_reg(UD_R_RDX);
+		break;
+	case UD_Irdtscp:
+		regs[n++] = dm_ssa_reg(UD_R_RAX);
+		regs[n++] = dm_ssa_reg(UD_R_RCX);
+		regs[n++] = dm_ssa_reg(UD_R_RDX);
+		break;
+	case UD_Icpuid:
+		regs[n++] = dm_ssa_reg(UD_R_RAX);
+		regs[n++] = dm_ssa_reg(UD_R_RBX);
+		regs[n++] = dm_ssa_reg(UD_R_RCX);
+		regs[n++] = dm_ssa_reg(UD_R_RDX);
+		break;
+	case UD_Iloop:
+	case UD_Iloope:
+	case UD_Iloopnz:
+		regs[n++] = dm_ssa_reg(UD_R_RCX);
+		break;
+	case UD_Imovsb:
+	case UD_Imovsw:
+	case UD_Imovsd:
+	case UD_Imovsq:
+	case UD_Istosb:
+	case UD_Istosw:
+	case UD_Istosd:
+	case UD_Istosq:
+	case UD_Ilodsb:
+	case UD_Ilodsw:
+	case UD_Ilodsd:
+	case UD_Ilodsq:
+	case UD_Iscasb:
+	case UD_Iscasw:
+	case UD_Iscasd:
+	case UD_Iscasq:
+	case UD_Icmpsb:
+	case UD_Icmpsw:
+	case UD_Icmpsd:
+	case UD_Icmpsq:
+	case UD_Iinsb:
+	case UD_Iinsw:
+	case UD_Iinsd:
+	case UD_Ioutsb:
+	case UD_Ioutsw:
+	case UD_Ioutsd:
+		/* movsd and cmpsd with operands are the SSE ones */
+		if (u->operand[0].type != UD_NONE)
+			break;
+		regs[n++] = dm_ssa_reg(UD_R_RSI);
+		regs[n++] = dm_ssa_reg(UD_R_RDI);
+		regs[n++] = dm_ssa_reg(UD_R_RCX);
+		if ((u->mnemonic >= UD_Ilodsb) && (u->mnemonic <= UD_Ilodsq))
+			regs[n++] = dm_ssa_reg(UD_R_RAX);
+		break;
+	case UD_Ipopa:
+	case UD_Ipopad:
+		for (i = 0; i < 8; i++)
+			regs[n++] = DM_REG_GPR + i;
+		break;
+	case UD_Ienter:
+	case UD_Ileave:
+		regs[n++] = dm_ssa_reg(UD_R_RBP);
+		/* FALLTHROUGH */
+	case UD_Ipush:
+	case UD_Ipop:
+	case UD_Ipushfw:
+	case UD_Ipushfd:
+	case UD_Ipushfq:
+	case UD_Ipopfw:
+	case UD_Ipopfd:
+	case UD_Ipopfq:
+	case UD_Ipusha:
+	case UD_Ipushad:
+	case UD_Iret:
+	case UD_Iretf:
+		regs[n++] = dm_ssa_reg(UD_R_RSP);
+		break;
+	default:
+		break;
+	}
+
+	return (n);
+}
+
+/*
+ * Map a udis86 register onto the dense register space, see dm_ssa.h
+ */
+int
+dm_ssa_reg(enum ud_type r)
+{
+	if ((r >= UD_R_AL) && (r <= UD_R_R15B)) {
+		r -= UD_R_AL;
+		/* ah .. bh are part of rax .. rbx, spl .. dil follow them */
+		return (DM_REG_GPR + ((r < 4) ? r : r - 4));
+	}
+	if ((r >= UD_R_AX) && (r <= UD_R_R15W))
+		return (DM_REG_GPR + r - UD_R_AX);
+	if ((r >= UD_R_EAX) && (r <= UD_R_R15D))
+		return (DM_REG_GPR + r - UD_R_EAX);
+	if ((r >= UD_R_RAX) && (r <= UD_R_R15))
+		return (DM_REG_GPR + r - UD_R_RAX);
+	if ((r >= UD_R_ES) && (r <= UD_R_GS))
+		return (DM_REG_SEG + r - UD_R_ES);
+	if ((r >= UD_R_CR0) && (r <= UD_R_CR15))
+		return (DM_REG_CR + r - UD_R_CR0);
+	if ((r >= UD_R_DR0) && (r <= UD_R_DR15))
+		return (DM_REG_DR + r - UD_R_DR0);
+	if ((r >= UD_R_MM0) && (r <= UD_R_MM7))
+		return (DM_REG_ST + r - UD_R_MM0);
+	if ((r >= UD_R_ST0) && (r <= UD_R_ST7))
+		return (DM_REG_ST + r - UD_R_ST0);
+	if ((r >= UD_R_XMM0) && (r <= UD_R_XMM15))
+		return (DM_REG_XMM + r - UD_R_XMM0);
+	if (r == UD_R_RIP)
+		return (DM_REG_RIP);
+
+	return (DM_REG_NONE);
+}
+
+/*
+ * Width in bits of a udis86 register
+ */
+int
+dm_ssa_reg_width(enum ud_type r)
+{
+	if ((r >= UD_R_AL) && (r <= UD_R_R15B))
+		return (8);
+	if (((r >= UD_R_AX) && (r <= UD_R_R15W)) ||
+	    ((r >= UD_R_ES) && (r <= UD_R_GS)))
+		return (16);
+	if ((r >= UD_R_EAX) && (r <= UD_R_R15D))
+		return (32);
+	if (((r >= UD_R_RAX) && (r <= UD_R_R15)) ||
+	    ((r >= UD_R_MM0) && (r <= UD_R_MM7)) || (r == UD_R_RIP))
+		return (64);
+	if ((r >= UD_R_ST0) && (r <= UD_R_ST7))
+		return (80);
+	if ((r >= UD_R_XMM0) && (r <= UD_R_XMM15))
+		return (128);
+	if ((r >= UD_R_CR0) && (r <= UD_R_DR15))
+		return (bits);
+
+	return (0);
+}
+
+/*
+ * Name of an SSA variable: general purpose registers are named by their
+ * width in the current mode (eax or rax), anything else by its widest
+ * member (st0, not mm0)
+ */
+const char*
+dm_ssa_reg_name(int reg)
+{
+	const char	*name = "none";
+	int		 r = 0, width = 0, best = 0;
+
+	for (r = UD_R_AL; r <= UD_R_RIP; r++) {
+		if (dm_ssa_reg(r) != reg)
+			continue;
+		width = dm_ssa_reg_width(r);
+		if ((reg < DM_REG_SEG) && (width == bits))
+			return (ud_reg_tab[r - UD_R_AL]);
+		if (width > best) {
+			best = width;
+			name = ud_reg_tab[r - UD_R_AL];
 		}
 	}
+
+	return (name);
 }
 
 /*
  * Push an index onto the stack for a register
  */
 void
-dm_ssa_index_stack_push(enum ud_type reg, int i)
+dm_ssa_index_stack_push(int reg, int i)
 {
-	indices[reg].stack = realloc(indices[reg].stack,
-	    (++indices[reg].s_size) * sizeof(int));
-	indices[reg].stack[indices[reg].s_size - 1] = i;
+	struct dm_ssa_index	*idx = &indices[reg];
+
+	if (idx->s_size == idx->s_cap) {
+		idx->s_cap *= 2;
+		idx->stack = xrealloc(idx->stack, idx->s_cap * sizeof(int));
+	}
+	idx->stack[idx->s_size++] = i;
 }
 
 /*
- * Pop an index from a reisters stack
+ * Pop an index from a registers stack
  */
 int
-dm_ssa_index_stack_pop(enum ud_type reg)
+dm_ssa_index_stack_pop(int reg)
 {
 	if (!indices[reg].s_size) {
 		printf("Tried to pop empty stack (reg %s %d)!\n",
-		    ud_reg_tab[reg - 1], reg);
+		    dm_ssa_reg_name(reg), reg);
 		return -1;
 	}
-	int i = indices[reg].stack[indices[reg].s_size - 1];
-	indices[reg].stack = realloc(indices[reg].stack,
-	    (--indices[reg].s_size) * sizeof(int));
-	return i;
+	return (indices[reg].stack[--indices[reg].s_size]);
 }
 
 /*
@@ -897,13 +1444,14 @@ dm_ssa_index_init()
 {
 	int	i;
 
-	indices = malloc(sizeof(struct dm_ssa_index) * (UD_OP_CONST + 1));
+	indices = malloc(sizeof(struct dm_ssa_index) * (DM_REG_COUNT));
 
 	/* Initialise struct for SSA indexes */
-	for (i = 0; i < UD_OP_CONST + 1; i++) {
-		indices[i].reg = (enum ud_type)i;
+	for (i = 0; i < DM_REG_COUNT; i++) {
+		indices[i].reg = i;
 		indices[i].count = 0;
-		indices[i].stack = malloc(sizeof(int));
+		indices[i].s_cap = DM_SSA_STACK_INIT;
+		indices[i].stack = xmalloc(indices[i].s_cap * sizeof(int));
 		indices[i].stack[0] = 0;
 		indices[i].s_size = 1;
 		indices[i].def_nodes = NULL;
@@ -930,12 +1478,22 @@ dm_free_ssa()
 			free(node->instructions[i]);
 		}
 		free(node->instructions);
+		/* The CFG may be reused for another build */
+		node->def_vars = NULL;
+		node->dv_count = 0;
+		node->phi_functions = NULL;
+		node->pf_count = 0;
+		node->instructions = NULL;
+		node->i_count = 0;
 	}
-	for (i = 0; i < UD_OP_CONST + 1; i++) {
+	for (i = 0; i < DM_REG_COUNT; i++) {
 		free(indices[i].stack);
 		free(indices[i].def_nodes);
 		free(indices[i].phi_nodes);
 	}
 	free(indices);
+	indices = NULL;
+	dm_live_free(&ssa_live);
+	dm_slots_free();
 }
 
@@ -21,11 +21,48 @@
 #include "dm_dom.h"
 #include "dm_cfg.h"
 
+/*
+ * SSA variables live in a dense register space rather than enum ud_type.
+ * Sub-registers share the number of the register they are part of (al,
+ * ah, ax, eax and rax are all DM_REG_GPR + 0), and mmx registers share
+ * the x87 registers they alias.
+ */
+#define DM_REG_GPR		0	/* rax .. r15 */
+#define DM_REG_SEG		16	/* es .. gs */
+#define DM_REG_CR		22	/* cr0 .. cr15 */
+#define DM_REG_DR		38	/* dr0 .. dr15 */
+#define DM_REG_ST		54	/* st0 .. st7 and mm0 .. mm7 */
+#define DM_REG_XMM		62	/* xmm0 .. xmm15 */
+#define DM_REG_RIP		78
+#define DM_REG_NONE		79	/* not a register */
+#define DM_REG_COUNT		80
+
+/* SSA flavours, chosen with the ssa.mode setting */
+#define DM_SSA_MINIMAL		0	/* phi at every iterated frontier */
+#define DM_SSA_SEMI		1	/* only for names used across blocks */
+#define DM_SSA_PRUNED		2	/* only where the name is live in */
+
+/* Initial depth of each register's version stack */
+#define DM_SSA_STACK_INIT	16
+
+/* Most registers an instruction can read */
+#define DM_SSA_MAX_USES		8
+
+extern int		 ssa_mode;
+
+/* A block being renamed: next dominator tree child and rename log mark */
+struct dm_ssa_rename_frame {
+	struct dm_cfg_node	*node;
+	int			 child;
+	int			 log;
+};
+
 struct dm_ssa_index {
-	enum ud_type		  reg;
+	int			  reg;	/* DM_REG_* number */
 	int			  count;
 	int			 *stack;
 	int			  s_size;
+	int			  s_cap;
 	struct dm_cfg_node	**def_nodes; /* Nodes where var defined */
 	int			  dn_count;
 	struct dm_cfg_node	**phi_nodes; /* Nodes with phi funcs for var*/
@@ -41,16 +78,31 @@ int		dm_print_block_header(struct dm_cfg_node *node);
 int		dm_print_phi_function(struct phi_function *phi);
 int		dm_print_ssa_instruction(struct instruction *insn);
 void		dm_phi_remove_duplicates(struct phi_function *phi);
-void		dm_ssa_index_stack_push(enum ud_type reg, int i);
-int		dm_ssa_index_stack_pop(enum ud_type reg);
+void		dm_ssa_index_stack_push(int reg, int i);
+int		dm_ssa_index_stack_pop(int reg);
+int		dm_ssa_reg(enum ud_type r);
+int		dm_ssa_reg_width(enum ud_type r);
+const char*	dm_ssa_reg_name(int reg);
 void		dm_rename_variables(struct dm_cfg_node *n);
+void		dm_ssa_rename_block(struct dm_cfg_node *n);
+int		dm_ssa_rename_def(int reg);
 void		gen_operand_ssa(struct ud* u, struct ud_operand* op, int syn_cast,
 		    int *index);
 void		dm_translate_intel_ssa(struct instruction *insn);
 void		dm_place_phi_functions();
 void		dm_ssa_find_var_defs();
+void		dm_ssa_add_var_def(struct dm_cfg_node *n, int reg);
 void		dm_ssa_index_init();
 int		dm_cmd_ssa(char **args);
+int		dm_cmd_ssastat(char **args);
+int		dm_ssa_mode();
+void		dm_ssa_build(struct dm_cfg_node *cfg);
+struct dm_cfg_node	*dm_ssa_open();
+void		dm_ssa_close();
+int		dm_ssa_insn_zero(struct ud *u);
+int		dm_ssa_insn_rmw(struct ud *u);
+int		dm_ssa_insn_vars(struct ud *u, int *uses, int *def);
+int		dm_ssa_insn_clobbers(struct ud *u, int *regs);
 int		dm_array_contains(struct dm_cfg_node **list, int c,
 		    struct dm_cfg_node *term);
 
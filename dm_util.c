@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include "common.h"
+#include "dm_util.h"
 
 void *
 xmalloc(size_t sz)
@@ -95,3 +96,25 @@ xasprintf(char **buf, char *fmt, ...)
 
 	return (ret);
 }
+
+/*
+ * The code below is not from hgd, it is dismantle's own
+ */
+
+/*
+ * how many threads should parallel work use
+ */
+int
+dm_nthreads()
+{
+	long			n;
+
+	if (dm_threads > 0)
+		return (dm_threads);
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		n = 1;
+
+	return ((int) n);
+}
@@ -24,6 +24,7 @@
 #define DM_UTIL_H_
 
 #include <stdarg.h>
+#include <stddef.h>
 
 void	*xmalloc(size_t sz);
 void	*xcalloc(size_t sz, size_t size);
@@ -31,4 +32,7 @@ void	*xrealloc(void *old_p, size_t sz);
 char	*xstrdup(const char *s);
 int	 xasprintf(char **buf, char *fmt, ...);
 
+/* Not from hgd, dismantle's own */
+int	 dm_nthreads();
+
 #endif